@@ -6,9 +6,12 @@
 #include <crypto/crypto_accel.h>
 #include <kernel/thread.h>
 
-/* Prototype for assembly function */
+/* Prototypes for assembly functions */
 void sha256_ce_transform(uint32_t state[8], const void *src,
 			 unsigned int block_count);
+void sha256_ce_transform_x2(uint32_t state_a[8], uint32_t state_b[8],
+			    const void *src_a, const void *src_b,
+			    unsigned int block_count);
 
 void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 				  unsigned int block_count)
@@ -19,3 +22,21 @@ void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 	sha256_ce_transform(state, src, block_count);
 	thread_kernel_disable_vfp(vfp_state);
 }
+
+void crypto_accel_sha256_compress_x2(uint32_t state_a[8],
+				     uint32_t state_b[8],
+				     const void *src_a, const void *src_b,
+				     unsigned int block_count)
+{
+	uint32_t vfp_state = 0;
+
+	vfp_state = thread_kernel_enable_vfp();
+#ifdef ARM64
+	sha256_ce_transform_x2(state_a, state_b, src_a, src_b, block_count);
+#else
+	/* Too few SIMD registers in AArch32 to interleave two streams */
+	sha256_ce_transform(state_a, src_a, block_count);
+	sha256_ce_transform(state_b, src_b, block_count);
+#endif
+	thread_kernel_disable_vfp(vfp_state);
+}
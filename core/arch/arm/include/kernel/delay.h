@@ -42,6 +42,14 @@ static inline uint64_t arm_cnt_us2cnt(uint32_t us)
 	return ((uint64_t)us * (uint64_t)read_cntfrq()) / 1000000ULL;
 }
 
+/* Converts @cnt counter ticks to nanoseconds, dividing first to not overflow */
+static inline uint64_t arm_cnt_cnt2ns(uint64_t cnt)
+{
+	uint64_t frq = read_cntfrq();
+
+	return (cnt / frq) * 1000000000ULL + (cnt % frq) * 1000000000ULL / frq;
+}
+
 static inline uint64_t timeout_init_us(uint32_t us)
 {
 	return barrier_read_counter_timer() + arm_cnt_us2cnt(us);
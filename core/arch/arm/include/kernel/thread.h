@@ -34,6 +34,31 @@
 #define THREAD_CORE_LOCAL_ALIGNED __aligned(8)
 #endif
 
+/*
+ * struct thread_alloc_stats - thread allocation statistics of a core
+ * @allocs:	threads allocated to serve standard calls
+ * @contended:	attempts to claim a free thread lost to another core
+ * @migrations:	threads allocated or resumed on another core than the one
+ *		they last ran on
+ */
+struct thread_alloc_stats {
+	uint32_t allocs;
+	uint32_t contended;
+	uint32_t migrations;
+};
+
+/*
+ * struct thread_rpc_shm_stats - RPC shared memory statistics
+ * @alloc_rpcs:	OPTEE_RPC_CMD_SHM_ALLOC requests sent to normal world
+ * @free_rpcs:	OPTEE_RPC_CMD_SHM_FREE requests sent to normal world
+ * @pool_hits:	payload allocations served from a thread's buffer pool
+ */
+struct thread_rpc_shm_stats {
+	uint32_t alloc_rpcs;
+	uint32_t free_rpcs;
+	uint32_t pool_hits;
+};
+
 struct thread_core_local {
 #ifdef ARM32
 	uint32_t r[2];
@@ -52,6 +77,8 @@ struct thread_core_local {
 #ifdef CFG_CORE_DEBUG_CHECK_STACKS
 	bool stackcheck_recursion;
 #endif
+	short int last_thread;
+	struct thread_alloc_stats alloc_stats;
 } THREAD_CORE_LOCAL_ALIGNED;
 
 struct thread_vector_table {
@@ -287,6 +314,18 @@ void thread_init_per_cpu(void);
 
 struct thread_core_local *thread_get_core_local(void);
 
+/*
+ * Returns the thread allocation statistics of the core at @core_pos, the
+ * counters are never reset.
+ */
+void thread_get_alloc_stats(size_t core_pos, struct thread_alloc_stats *stats);
+
+/*
+ * Returns the RPC shared memory statistics summed over all threads, the
+ * counters are never reset.
+ */
+void thread_get_rpc_shm_stats(struct thread_rpc_shm_stats *stats);
+
 /*
  * Sets the stacks to be used by the different threads. Use THREAD_ID_0 for
  * first stack, THREAD_ID_0 + 1 for the next and so on.
@@ -258,6 +258,17 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t pmem_lookups;	/* number of physical page lookups */
+	/* time spent in lookups, only with CFG_CORE_PAGER_LOOKUP_TIMING=y */
+	size_t pmem_lookup_ns;
+	size_t clean_evictions;	/* evicted pages not needing a save */
+	size_t dirty_evictions;	/* evicted pages saved first */
+	size_t refaults;	/* pages loaded again soon after eviction */
+	size_t ws_pages;	/* estimated working set, in pages */
+	size_t prefetched;	/* pages loaded by fault-around */
+	size_t writebacks;	/* batches of dirty pages saved */
+	size_t writeback_ahead;	/* dirty pages saved ahead of eviction */
+	size_t writeback_ns;	/* time spent saving dirty pages */
 };
 
 #ifdef CFG_WITH_PAGER
@@ -275,6 +286,12 @@ static inline void tee_pager_get_stats(struct tee_pager_stats *stats)
 }
 #endif /*CFG_WITH_PAGER*/
 
+/*
+ * tee_pager_invalidate_fobj() - Drop all physical pages of a fobj
+ * @fobj:	fobj being torn down, no longer mapped by any region
+ *
+ * Also frees the physical page index of @fobj.
+ */
 void tee_pager_invalidate_fobj(struct fobj *fobj);
 
 #endif /*MM_TEE_PAGER_H*/
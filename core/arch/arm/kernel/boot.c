@@ -391,9 +391,49 @@ static struct fobj *ro_paged_alloc(tee_mm_entry_t *mm, void *hashes,
 #endif
 }
 
+/* Number of pages verified with a single hash_sha256_check_multi() call */
+#define PAGEABLE_HASH_BATCH	8
+
+static void check_pageable_hashes(const uint8_t *hashes,
+				  const uint8_t *paged_store,
+				  size_t num_pages)
+{
+	const uint8_t *hash_ptrs[PAGEABLE_HASH_BATCH] = { };
+	const uint8_t *page_ptrs[PAGEABLE_HASH_BATCH] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t num = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	for (n = 0; n < num_pages; n += num) {
+		num = MIN(num_pages - n, (size_t)PAGEABLE_HASH_BATCH);
+		for (m = 0; m < num; m++) {
+			hash_ptrs[m] = hashes + (n + m) * TEE_SHA256_HASH_SIZE;
+			page_ptrs[m] = paged_store + (n + m) * SMALL_PAGE_SIZE;
+		}
+
+		DMSG("hash pg_idx %zu..%zu", n, n + num - 1);
+		res = hash_sha256_check_multi(hash_ptrs, page_ptrs,
+					      SMALL_PAGE_SIZE, num);
+		if (res == TEE_SUCCESS)
+			continue;
+
+		/* Find the offending page to report it */
+		for (m = 0; m < num; m++) {
+			res = hash_sha256_check(hash_ptrs[m], page_ptrs[m],
+						SMALL_PAGE_SIZE);
+			if (res != TEE_SUCCESS) {
+				EMSG("Hash failed for page %zu at %p: res 0x%x",
+				     n + m, (void *)page_ptrs[m], res);
+				panic();
+			}
+		}
+		panic("Inconsistent hash check of pageable area");
+	}
+}
+
 static void init_runtime(unsigned long pageable_part)
 {
-	size_t n;
 	size_t init_size = (size_t)(__init_end - __init_start);
 	size_t pageable_start = (size_t)__pageable_start;
 	size_t pageable_end = (size_t)__pageable_end;
@@ -465,19 +505,8 @@ static void init_runtime(unsigned long pageable_part)
 
 	/* Check that hashes of what's in pageable area is OK */
 	DMSG("Checking hashes of pageable area");
-	for (n = 0; (n * SMALL_PAGE_SIZE) < pageable_size; n++) {
-		const uint8_t *hash = hashes + n * TEE_SHA256_HASH_SIZE;
-		const uint8_t *page = paged_store + n * SMALL_PAGE_SIZE;
-		TEE_Result res;
-
-		DMSG("hash pg_idx %zu hash %p page %p", n, hash, page);
-		res = hash_sha256_check(hash, page, SMALL_PAGE_SIZE);
-		if (res != TEE_SUCCESS) {
-			EMSG("Hash failed for page %zu at %p: res 0x%x",
-			     n, (void *)page, res);
-			panic();
-		}
-	}
+	check_pageable_hashes(hashes, paged_store,
+			      pageable_size / SMALL_PAGE_SIZE);
 
 	/*
 	 * Assert prepaged init sections are page aligned so that nothing
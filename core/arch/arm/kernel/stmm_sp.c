@@ -98,6 +98,7 @@ static struct stmm_ctx *stmm_alloc_ctx(const TEE_UUID *uuid)
 	}
 
 	spc->ta_ctx.ref_count = 1;
+	mutex_init(&spc->ta_ctx.busy_mutex);
 	condvar_init(&spc->ta_ctx.busy_cv);
 
 	return spc;
@@ -9,6 +9,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <config.h>
 #include <io.h>
 #include <keep.h>
@@ -41,6 +42,16 @@ struct thread_ctx threads[CFG_NUM_THREADS];
 
 struct thread_core_local thread_core_local[CFG_TEE_CORE_NB_CORE] __nex_bss;
 
+/*
+ * Bit n is set while threads[n] is in use, that is, isn't in
+ * THREAD_STATE_FREE. A free thread is claimed by setting its bit with
+ * compare-and-swap so allocation doesn't need thread_global_lock. The bit
+ * is only cleared once the thread state is updated to THREAD_STATE_FREE.
+ */
+#define THREAD_BUSY_WORDS	((CFG_NUM_THREADS + 31) / 32)
+
+static uint32_t thread_busy_bits[THREAD_BUSY_WORDS];
+
 /*
  * Stacks
  *
@@ -514,6 +525,116 @@ static void init_regs(struct thread_ctx *thread, uint32_t a0, uint32_t a1,
 }
 #endif /*ARM64*/
 
+static uint32_t busy_word_mask(size_t w)
+{
+	if (w == THREAD_BUSY_WORDS - 1 && CFG_NUM_THREADS % 32)
+		return BIT32(CFG_NUM_THREADS % 32) - 1;
+	return UINT32_MAX;
+}
+
+static bool claim_thread(struct thread_core_local *l, size_t n)
+{
+	uint32_t *word = thread_busy_bits + n / 32;
+	uint32_t bit = BIT32(n % 32);
+	uint32_t old = atomic_load_u32(word);
+
+	while (!(old & bit)) {
+		if (atomic_cas_u32(word, &old, old | bit))
+			return true;
+		if (!(old & bit))
+			l->alloc_stats.contended++;
+	}
+
+	return false;
+}
+
+static bool claim_free_thread(struct thread_core_local *l, size_t *n)
+{
+	uint32_t old = 0;
+	uint32_t free = 0;
+	size_t w = 0;
+
+	for (w = 0; w < THREAD_BUSY_WORDS; w++) {
+		old = atomic_load_u32(thread_busy_bits + w);
+		while ((free = ~old & busy_word_mask(w))) {
+			if (atomic_cas_u32(thread_busy_bits + w, &old,
+					   old | (free & -free))) {
+				*n = w * 32 + __builtin_ctz(free);
+				return true;
+			}
+			l->alloc_stats.contended++;
+		}
+	}
+
+	return false;
+}
+
+static void __nostackcheck release_thread(size_t n)
+{
+	atomic_fetch_and_release_u32(thread_busy_bits + n / 32,
+				     ~BIT32(n % 32));
+}
+
+static void set_thread_core(struct thread_core_local *l, size_t n)
+{
+	int core = get_core_pos();
+
+	if (threads[n].last_core >= 0 && threads[n].last_core != core)
+		l->alloc_stats.migrations++;
+	threads[n].last_core = core;
+	l->last_thread = n;
+}
+
+bool thread_block_alloc(void)
+{
+	uint32_t old = 0;
+	size_t w = 0;
+	size_t n = 0;
+
+	for (w = 0; w < THREAD_BUSY_WORDS; w++) {
+		old = 0;
+		while (!atomic_cas_u32(thread_busy_bits + w, &old,
+				       busy_word_mask(w))) {
+			if (old) {
+				for (n = 0; n < w; n++)
+					atomic_store_u32(thread_busy_bits + n,
+							 0);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void thread_unblock_alloc(void)
+{
+	size_t w = 0;
+
+	for (w = 0; w < THREAD_BUSY_WORDS; w++)
+		atomic_fetch_and_release_u32(thread_busy_bits + w, 0);
+}
+
+void thread_get_alloc_stats(size_t core_pos, struct thread_alloc_stats *stats)
+{
+	assert(core_pos < CFG_TEE_CORE_NB_CORE);
+	*stats = thread_core_local[core_pos].alloc_stats;
+}
+
+void thread_get_rpc_shm_stats(struct thread_rpc_shm_stats *stats)
+{
+	struct thread_rpc_shm_stats *s = NULL;
+	size_t n = 0;
+
+	*stats = (struct thread_rpc_shm_stats){ };
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		s = &threads[n].rpc_shm_stats;
+		stats->alloc_rpcs += READ_ONCE(s->alloc_rpcs);
+		stats->free_rpcs += READ_ONCE(s->free_rpcs);
+		stats->pool_hits += READ_ONCE(s->pool_hits);
+	}
+}
+
 void thread_init_boot_thread(void)
 {
 	struct thread_core_local *l = thread_get_core_local();
@@ -521,6 +642,7 @@ void thread_init_boot_thread(void)
 	thread_init_threads();
 
 	l->curr_thread = 0;
+	claim_thread(l, 0);
 	threads[0].state = THREAD_STATE_ACTIVE;
 }
 
@@ -531,6 +653,7 @@ void __nostackcheck thread_clr_boot_thread(void)
 	assert(l->curr_thread >= 0 && l->curr_thread < CFG_NUM_THREADS);
 	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
 	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	release_thread(l->curr_thread);
 	l->curr_thread = THREAD_ID_INVALID;
 }
 
@@ -539,27 +662,35 @@ static void __thread_alloc_and_run(uint32_t a0, uint32_t a1, uint32_t a2,
 				   uint32_t a6, uint32_t a7,
 				   void *pc)
 {
-	size_t n;
 	struct thread_core_local *l = thread_get_core_local();
+	size_t n = l->last_thread;
 	bool found_thread = false;
 
 	assert(l->curr_thread == THREAD_ID_INVALID);
 
-	thread_lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
-		}
+	/*
+	 * Prefer the thread last run on this core, its stack is more
+	 * likely to still be in the caches of this core.
+	 */
+	found_thread = claim_thread(l, n);
+	if (!found_thread)
+		found_thread = claim_free_thread(l, &n);
+	if (!found_thread) {
+		/*
+		 * All threads may be blocked by thread_block_alloc() for
+		 * the moment, wait for that to complete before giving up.
+		 */
+		thread_lock_global();
+		found_thread = claim_free_thread(l, &n);
+		thread_unlock_global();
 	}
 
-	thread_unlock_global();
-
 	if (!found_thread)
 		return;
 
+	threads[n].state = THREAD_STATE_ACTIVE;
+	l->alloc_stats.allocs++;
+	set_thread_core(l, n);
 	l->curr_thread = n;
 
 	threads[n].flags = 0;
@@ -690,6 +821,7 @@ void thread_resume_from_rpc(uint32_t thread_id, uint32_t a0, uint32_t a1,
 	if (!found_thread)
 		return;
 
+	set_thread_core(l, n);
 	l->curr_thread = n;
 
 	if (threads[n].have_user_map) {
@@ -849,6 +981,7 @@ void thread_state_free(void)
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
 	threads[ct].state = THREAD_STATE_FREE;
 	threads[ct].flags = 0;
+	release_thread(ct);
 	l->curr_thread = THREAD_ID_INVALID;
 
 	if (IS_ENABLED(CFG_VIRTUALIZATION))
@@ -1083,6 +1216,7 @@ void thread_init_threads(void)
 	for (n = 0; n < CFG_NUM_THREADS; n++) {
 		TAILQ_INIT(&threads[n].tsd.sess_stack);
 		SLIST_INIT(&threads[n].tsd.pgt_cache);
+		threads[n].last_core = -1;
 	}
 }
 
@@ -27,6 +27,11 @@
 static bool thread_prealloc_rpc_cache;
 static unsigned int thread_rpc_pnum;
 
+/* Size of the smallest payload pool class, each next class is 4 times larger */
+#define RPC_POOL_MIN_SIZE	SMALL_PAGE_SIZE
+
+static void rpc_pool_clear(struct thread_ctx *thr, bool kernel);
+
 void thread_handle_fast_smc(struct thread_smc_args *args)
 {
 	thread_check_canaries();
@@ -214,6 +219,12 @@ uint32_t __weak __thread_std_smc_entry(uint32_t a0, uint32_t a1, uint32_t a2,
 		struct thread_ctx *thr = threads + thread_get_id();
 
 		thread_rpc_shm_cache_clear(&thr->shm_cache);
+		/*
+		 * Kernel buffers are kept across calls unless the guest
+		 * owning them may change with the next call.
+		 */
+		rpc_pool_clear(thr, !thread_prealloc_rpc_cache ||
+				    IS_ENABLED(CFG_VIRTUALIZATION));
 		if (!thread_prealloc_rpc_cache) {
 			thread_rpc_free_arg(mobj_get_cookie(thr->rpc_mobj));
 			mobj_put(thr->rpc_mobj);
@@ -227,17 +238,17 @@ uint32_t __weak __thread_std_smc_entry(uint32_t a0, uint32_t a1, uint32_t a2,
 
 bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 {
+	struct mobj **slot = NULL;
 	bool rv = false;
 	size_t n = 0;
+	size_t m = 0;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
 	thread_lock_global();
 
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!thread_block_alloc()) {
+		rv = false;
+		goto out;
 	}
 
 	rv = true;
@@ -249,13 +260,24 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 				mobj_put(threads[n].rpc_mobj);
 				threads[n].rpc_arg = NULL;
 				threads[n].rpc_mobj = NULL;
-				goto out;
+				goto out_unblock;
+			}
+			for (m = 0; m < THREAD_RPC_POOL_CLASSES; m++) {
+				slot = threads[n].rpc_pool.kernel + m;
+				if (*slot) {
+					*cookie = mobj_get_cookie(*slot);
+					mobj_put(*slot);
+					*slot = NULL;
+					goto out_unblock;
+				}
 			}
 		}
 	}
 
 	*cookie = 0;
 	thread_prealloc_rpc_cache = false;
+out_unblock:
+	thread_unblock_alloc();
 out:
 	thread_unlock_global();
 	thread_unmask_exceptions(exceptions);
@@ -265,7 +287,6 @@ out:
 bool thread_enable_prealloc_rpc_cache(void)
 {
 	bool rv = false;
-	size_t n = 0;
 	uint32_t exceptions = 0;
 
 	if (!IS_ENABLED(CFG_PREALLOC_RPC_CACHE))
@@ -274,16 +295,12 @@ bool thread_enable_prealloc_rpc_cache(void)
 	exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 	thread_lock_global();
 
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (thread_block_alloc()) {
+		rv = true;
+		thread_prealloc_rpc_cache = true;
+		thread_unblock_alloc();
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
 	thread_unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
@@ -525,6 +542,7 @@ static void thread_rpc_free(unsigned int bt, uint64_t cookie, struct mobj *mobj)
 	mobj_put(mobj);
 
 	if (!ret) {
+		threads[thread_get_id()].rpc_shm_stats.free_rpcs++;
 		reg_pair_from_64(carg, rpc_args + 1, rpc_args + 2);
 		thread_rpc(rpc_args);
 	}
@@ -588,15 +606,112 @@ static struct mobj *thread_rpc_alloc(size_t size, size_t align, unsigned int bt)
 	if (ret)
 		return NULL;
 
+	threads[thread_get_id()].rpc_shm_stats.alloc_rpcs++;
 	reg_pair_from_64(carg, rpc_args + 1, rpc_args + 2);
 	thread_rpc(rpc_args);
 
 	return get_rpc_alloc_res(arg, bt, size);
 }
 
+static size_t rpc_pool_class_size(unsigned int class)
+{
+	return RPC_POOL_MIN_SIZE << (2 * class);
+}
+
+static struct mobj **rpc_pool_slots(struct thread_ctx *thr, unsigned int bt)
+{
+	if (bt == OPTEE_RPC_SHM_TYPE_KERNEL)
+		return thr->rpc_pool.kernel;
+	return thr->rpc_pool.appl;
+}
+
+/*
+ * Returns a payload buffer of at least @size bytes, preferably the smallest
+ * large enough buffer in the pool of the current thread. This may be a
+ * buffer of a larger class than @size needs if the slots below are empty.
+ * Buffers which are allocated via RPC are rounded up to a size class so
+ * they can be pooled once freed, requests larger than the largest class
+ * bypass the pool.
+ */
+static struct mobj *rpc_pool_alloc(size_t size, unsigned int bt)
+{
+	struct thread_ctx *thr = threads + thread_get_id();
+	struct mobj **slots = rpc_pool_slots(thr, bt);
+	struct mobj *mobj = NULL;
+	unsigned int n = 0;
+
+	while (n < THREAD_RPC_POOL_CLASSES && size > rpc_pool_class_size(n))
+		n++;
+	if (n == THREAD_RPC_POOL_CLASSES)
+		return thread_rpc_alloc(size, 8, bt);
+
+	size = rpc_pool_class_size(n);
+	for (; n < THREAD_RPC_POOL_CLASSES; n++) {
+		if (slots[n]) {
+			mobj = slots[n];
+			slots[n] = NULL;
+			thr->rpc_shm_stats.pool_hits++;
+			return mobj;
+		}
+	}
+
+	return thread_rpc_alloc(size, 8, bt);
+}
+
+/*
+ * Keeps @mobj in the pool of the current thread if its size falls within
+ * a size class, the slot of that class is free and nobody else holds a
+ * reference, else frees it via RPC.
+ */
+static void rpc_pool_free(struct mobj *mobj, unsigned int bt)
+{
+	struct thread_ctx *thr = threads + thread_get_id();
+	struct mobj **slots = rpc_pool_slots(thr, bt);
+	unsigned int n = THREAD_RPC_POOL_CLASSES;
+
+	if (mobj && refcount_val(&mobj->refc) == 1 &&
+	    mobj->size <= rpc_pool_class_size(n - 1)) {
+		while (n && mobj->size < rpc_pool_class_size(n - 1))
+			n--;
+		if (n && !slots[n - 1]) {
+			slots[n - 1] = mobj;
+			return;
+		}
+	}
+
+	thread_rpc_free(bt, mobj_get_cookie(mobj), mobj);
+}
+
+/*
+ * Frees the pooled OPTEE_RPC_SHM_TYPE_APPL buffers of @thr, and the
+ * OPTEE_RPC_SHM_TYPE_KERNEL buffers too if @kernel is true. Application
+ * buffers are owned by tee-supplicant and can't be reclaimed with
+ * thread_disable_prealloc_rpc_cache() so they don't outlive the call.
+ */
+static void rpc_pool_clear(struct thread_ctx *thr, bool kernel)
+{
+	struct mobj *mobj = NULL;
+	unsigned int n = 0;
+
+	for (n = 0; n < THREAD_RPC_POOL_CLASSES; n++) {
+		mobj = thr->rpc_pool.appl[n];
+		if (mobj) {
+			thr->rpc_pool.appl[n] = NULL;
+			thread_rpc_free(OPTEE_RPC_SHM_TYPE_APPL,
+					mobj_get_cookie(mobj), mobj);
+		}
+		mobj = thr->rpc_pool.kernel[n];
+		if (kernel && mobj) {
+			thr->rpc_pool.kernel[n] = NULL;
+			thread_rpc_free(OPTEE_RPC_SHM_TYPE_KERNEL,
+					mobj_get_cookie(mobj), mobj);
+		}
+	}
+}
+
 struct mobj *thread_rpc_alloc_payload(size_t size)
 {
-	return thread_rpc_alloc(size, 8, OPTEE_RPC_SHM_TYPE_APPL);
+	return rpc_pool_alloc(size, OPTEE_RPC_SHM_TYPE_APPL);
 }
 
 struct mobj *thread_rpc_alloc_kernel_payload(size_t size)
@@ -609,18 +724,17 @@ struct mobj *thread_rpc_alloc_kernel_payload(size_t size)
 	if (IS_ENABLED(CFG_CORE_DYN_SHM) && size > SMALL_PAGE_SIZE)
 		return NULL;
 
-	return thread_rpc_alloc(size, 8, OPTEE_RPC_SHM_TYPE_KERNEL);
+	return rpc_pool_alloc(size, OPTEE_RPC_SHM_TYPE_KERNEL);
 }
 
 void thread_rpc_free_kernel_payload(struct mobj *mobj)
 {
-	thread_rpc_free(OPTEE_RPC_SHM_TYPE_KERNEL, mobj_get_cookie(mobj), mobj);
+	rpc_pool_free(mobj, OPTEE_RPC_SHM_TYPE_KERNEL);
 }
 
 void thread_rpc_free_payload(struct mobj *mobj)
 {
-	thread_rpc_free(OPTEE_RPC_SHM_TYPE_APPL, mobj_get_cookie(mobj),
-			mobj);
+	rpc_pool_free(mobj, OPTEE_RPC_SHM_TYPE_APPL);
 }
 
 struct mobj *thread_rpc_alloc_global_payload(size_t size)
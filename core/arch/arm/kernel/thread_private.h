@@ -53,6 +53,21 @@ struct thread_shm_cache_entry {
 
 SLIST_HEAD(thread_shm_cache, thread_shm_cache_entry);
 
+/* Number of size classes of pooled RPC payload buffers, 4 KiB to 256 KiB */
+#define THREAD_RPC_POOL_CLASSES		4
+
+/*
+ * struct thread_rpc_pool - RPC payload buffers kept by a thread once freed
+ * @appl:	OPTEE_RPC_SHM_TYPE_APPL buffers, one per size class, released
+ *		at the end of each standard call
+ * @kernel:	OPTEE_RPC_SHM_TYPE_KERNEL buffers, one per size class, kept
+ *		as long as the preallocated RPC cache is enabled
+ */
+struct thread_rpc_pool {
+	struct mobj *appl[THREAD_RPC_POOL_CLASSES];
+	struct mobj *kernel[THREAD_RPC_POOL_CLASSES];
+};
+
 struct thread_ctx {
 	struct thread_ctx_regs regs;
 	enum thread_state state;
@@ -66,9 +81,12 @@ struct thread_ctx {
 #ifdef CFG_WITH_VFP
 	struct thread_vfp_state vfp_state;
 #endif
+	int last_core;		/* -1 until the thread has run */
 	void *rpc_arg;
 	struct mobj *rpc_mobj;
 	struct thread_shm_cache shm_cache;
+	struct thread_rpc_pool rpc_pool;
+	struct thread_rpc_shm_stats rpc_shm_stats;
 	struct thread_specific_data tsd;
 };
 #endif /*__ASSEMBLER__*/
@@ -195,6 +213,16 @@ void thread_resume_from_rpc(uint32_t thread_id, uint32_t a0, uint32_t a1,
 void thread_lock_global(void);
 void thread_unlock_global(void);
 
+/*
+ * Marks all threads as busy if all of them are free, keeping
+ * __thread_alloc_and_run() from allocating a thread until
+ * thread_unblock_alloc() is called. Returns false if a thread is in use.
+ * Must be called with thread_lock_global() held, which callers of
+ * __thread_alloc_and_run() finding no free thread wait for.
+ */
+bool thread_block_alloc(void);
+void thread_unblock_alloc(void);
+
 
 /*
  * Suspends current thread and temorarily exits to non-secure world.
@@ -3,9 +3,11 @@
  * Copyright (c) 2016-2017, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <initcall.h>
 #include <keep.h>
+#include <kernel/delay.h>
 #include <kernel/linker.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
@@ -55,14 +57,59 @@ static size_t mobj_reg_shm_size(size_t nr_pages)
 	return s;
 }
 
-static SLIST_HEAD(reg_shm_head, mobj_reg_shm) reg_shm_list =
-	SLIST_HEAD_INITIALIZER(reg_shm_head);
+/*
+ * Registered shared memory is looked up by cookie for each
+ * OPTEE_MSG_ATTR_TYPE_RMEM_* parameter, a hash table on the cookie keeps
+ * the walk done with reg_shm_slist_lock held short. With CFG_WITH_STATS
+ * the hold times are reported by mobj_reg_shm_get_lock_stats().
+ */
+#define REG_SHM_HASH_SHIFT	8
+
+SLIST_HEAD(reg_shm_head, mobj_reg_shm);
+
+static struct reg_shm_head reg_shm_buckets[BIT(REG_SHM_HASH_SHIFT)];
 
 static unsigned int reg_shm_slist_lock = SPINLOCK_UNLOCK;
 static unsigned int reg_shm_map_lock = SPINLOCK_UNLOCK;
 
+#ifdef CFG_WITH_STATS
+/* Hold times of reg_shm_slist_lock in counter ticks, updated with it held */
+static uint64_t reg_shm_lock_begin;
+static uint64_t reg_shm_lock_count;
+static uint64_t reg_shm_lock_max_ticks;
+static uint64_t reg_shm_lock_total_ticks;
+#endif
+
+static uint32_t reg_shm_lock(void)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+
+#ifdef CFG_WITH_STATS
+	reg_shm_lock_begin = barrier_read_counter_timer();
+#endif
+	return exceptions;
+}
+
+static void reg_shm_unlock(uint32_t exceptions)
+{
+#ifdef CFG_WITH_STATS
+	uint64_t ticks = barrier_read_counter_timer() - reg_shm_lock_begin;
+
+	reg_shm_lock_count++;
+	reg_shm_lock_total_ticks += ticks;
+	if (ticks > reg_shm_lock_max_ticks)
+		reg_shm_lock_max_ticks = ticks;
+#endif
+	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+}
+
 static struct mobj_reg_shm *to_mobj_reg_shm(struct mobj *mobj);
 
+static struct reg_shm_head *reg_shm_bucket(uint64_t cookie)
+{
+	return reg_shm_buckets + mobj_cookie_hash(cookie, REG_SHM_HASH_SHIFT);
+}
+
 static TEE_Result mobj_reg_shm_get_pa(struct mobj *mobj, size_t offst,
 				      size_t granule, paddr_t *pa)
 {
@@ -130,7 +177,8 @@ static void reg_shm_free_helper(struct mobj_reg_shm *mobj_reg_shm)
 
 	cpu_spin_unlock_xrestore(&reg_shm_map_lock, exceptions);
 
-	SLIST_REMOVE(&reg_shm_list, mobj_reg_shm, mobj_reg_shm, next);
+	SLIST_REMOVE(reg_shm_bucket(mobj_reg_shm->cookie), mobj_reg_shm,
+		     mobj_reg_shm, next);
 	free(mobj_reg_shm);
 }
 
@@ -147,17 +195,17 @@ static void mobj_reg_shm_free(struct mobj *mobj)
 		 * unless mobj_reg_shm_release_by_cookie() is waiting for
 		 * the mobj to be released.
 		 */
-		exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+		exceptions = reg_shm_lock();
 		reg_shm_free_helper(r);
-		cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+		reg_shm_unlock(exceptions);
 	} else {
 		/*
 		 * We've reached the point where an unguarded reg shm can
 		 * be released by cookie. Notify eventual waiters.
 		 */
-		exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+		exceptions = reg_shm_lock();
 		r->release_frees = true;
-		cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+		reg_shm_unlock(exceptions);
 
 		mutex_lock(&shm_mu);
 		if (shm_release_waiters)
@@ -331,9 +379,9 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 			goto err;
 	}
 
-	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_INSERT_HEAD(&reg_shm_list, mobj_reg_shm, next);
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+	exceptions = reg_shm_lock();
+	SLIST_INSERT_HEAD(reg_shm_bucket(cookie), mobj_reg_shm, next);
+	reg_shm_unlock(exceptions);
 
 	return &mobj_reg_shm->mobj;
 err:
@@ -343,29 +391,44 @@ err:
 
 void mobj_reg_shm_unguard(struct mobj *mobj)
 {
-	uint32_t exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+	uint32_t exceptions = reg_shm_lock();
 
 	to_mobj_reg_shm(mobj)->guarded = false;
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+	reg_shm_unlock(exceptions);
 }
 
 static struct mobj_reg_shm *reg_shm_find_unlocked(uint64_t cookie)
 {
 	struct mobj_reg_shm *mobj_reg_shm = NULL;
 
-	SLIST_FOREACH(mobj_reg_shm, &reg_shm_list, next)
+	SLIST_FOREACH(mobj_reg_shm, reg_shm_bucket(cookie), next)
 		if (mobj_reg_shm->cookie == cookie)
 			return mobj_reg_shm;
 
 	return NULL;
 }
 
-struct mobj *mobj_reg_shm_get_by_cookie(uint64_t cookie)
+#ifdef CFG_WITH_STATS
+void mobj_reg_shm_get_lock_stats(struct mobj_shm_lock_stats *stats)
 {
 	uint32_t exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	struct mobj_reg_shm *r = reg_shm_find_unlocked(cookie);
+	uint64_t max_ticks = reg_shm_lock_max_ticks;
+	uint64_t total_ticks = reg_shm_lock_total_ticks;
 
+	stats->count = reg_shm_lock_count;
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+
+	stats->max_ns = arm_cnt_cnt2ns(max_ticks);
+	stats->total_ns = arm_cnt_cnt2ns(total_ticks);
+}
+#endif
+
+struct mobj *mobj_reg_shm_get_by_cookie(uint64_t cookie)
+{
+	uint32_t exceptions = reg_shm_lock();
+	struct mobj_reg_shm *r = reg_shm_find_unlocked(cookie);
+
+	reg_shm_unlock(exceptions);
 	if (!r)
 		return NULL;
 
@@ -383,14 +446,14 @@ TEE_Result mobj_reg_shm_release_by_cookie(uint64_t cookie)
 	 * wrong cookie and perhaps a second time, regardless return
 	 * TEE_ERROR_BAD_PARAMETERS.
 	 */
-	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+	exceptions = reg_shm_lock();
 	r = reg_shm_find_unlocked(cookie);
 	if (!r || r->guarded || r->releasing)
 		r = NULL;
 	else
 		r->releasing = true;
 
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+	reg_shm_unlock(exceptions);
 
 	if (!r)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -411,12 +474,12 @@ TEE_Result mobj_reg_shm_release_by_cookie(uint64_t cookie)
 	assert(shm_release_waiters);
 
 	while (true) {
-		exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+		exceptions = reg_shm_lock();
 		if (r->release_frees) {
 			reg_shm_free_helper(r);
 			r = NULL;
 		}
-		cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+		reg_shm_unlock(exceptions);
 
 		if (!r)
 			break;
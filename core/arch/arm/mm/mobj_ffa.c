@@ -3,11 +3,13 @@
  * Copyright (c) 2016-2020, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <bitstring.h>
 #include <ffa.h>
 #include <initcall.h>
 #include <keep.h>
+#include <kernel/delay.h>
 #include <kernel/refcount.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread_spmc.h>
@@ -35,14 +37,66 @@ SLIST_HEAD(mobj_ffa_head, mobj_ffa);
 static bitstr_t bit_decl(shm_bits, NUM_SHMS);
 #endif
 
-static struct mobj_ffa_head shm_head = SLIST_HEAD_INITIALIZER(shm_head);
-static struct mobj_ffa_head shm_inactive_head =
-	SLIST_HEAD_INITIALIZER(shm_inactive_head);
+/*
+ * Active and inactive mobjs are kept in hash tables on the cookie to keep
+ * the walk done with shm_lock held short. With CFG_WITH_STATS the hold
+ * times are reported by mobj_ffa_get_lock_stats().
+ */
+#define SHM_HASH_SHIFT	6
+
+static struct mobj_ffa_head shm_head[BIT(SHM_HASH_SHIFT)];
+static struct mobj_ffa_head shm_inactive_head[BIT(SHM_HASH_SHIFT)];
 
 static unsigned int shm_lock = SPINLOCK_UNLOCK;
 
+#ifdef CFG_WITH_STATS
+/* Hold times of shm_lock in counter ticks, updated with it held */
+static uint64_t shm_lock_begin;
+static uint64_t shm_lock_count;
+static uint64_t shm_lock_max_ticks;
+static uint64_t shm_lock_total_ticks;
+#endif
+
 const struct mobj_ops mobj_ffa_ops;
 
+static uint32_t shm_lock_xsave(void)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&shm_lock);
+
+#ifdef CFG_WITH_STATS
+	shm_lock_begin = barrier_read_counter_timer();
+#endif
+	return exceptions;
+}
+
+static void shm_unlock_xrestore(uint32_t exceptions)
+{
+#ifdef CFG_WITH_STATS
+	uint64_t ticks = barrier_read_counter_timer() - shm_lock_begin;
+
+	shm_lock_count++;
+	shm_lock_total_ticks += ticks;
+	if (ticks > shm_lock_max_ticks)
+		shm_lock_max_ticks = ticks;
+#endif
+	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+}
+
+#ifdef CFG_WITH_STATS
+void mobj_ffa_get_lock_stats(struct mobj_shm_lock_stats *stats)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&shm_lock);
+	uint64_t max_ticks = shm_lock_max_ticks;
+	uint64_t total_ticks = shm_lock_total_ticks;
+
+	stats->count = shm_lock_count;
+	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+
+	stats->max_ns = arm_cnt_cnt2ns(max_ticks);
+	stats->total_ns = arm_cnt_cnt2ns(total_ticks);
+}
+#endif
+
 static struct mobj_ffa *to_mobj_ffa(struct mobj *mobj)
 {
 	assert(mobj->ops == &mobj_ffa_ops);
@@ -94,7 +148,7 @@ struct mobj_ffa *mobj_ffa_sel1_spmc_new(unsigned int num_pages)
 	if (!mf)
 		return NULL;
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
+	exceptions = shm_lock_xsave();
 	bit_ffc(shm_bits, NUM_SHMS, &i);
 	if (i != -1) {
 		bit_set(shm_bits, i);
@@ -105,7 +159,7 @@ struct mobj_ffa *mobj_ffa_sel1_spmc_new(unsigned int num_pages)
 		mf->cookie = i | FFA_MEMORY_HANDLE_NONE_SECURE_BIT;
 
 	}
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 
 	if (i == -1) {
 		free(mf);
@@ -121,6 +175,13 @@ static size_t get_page_count(struct mobj_ffa *mf)
 	return ROUNDUP(mf->mobj.size, SMALL_PAGE_SIZE) / SMALL_PAGE_SIZE;
 }
 
+/* Returns the bucket of @cookie in the hash table @table */
+static struct mobj_ffa_head *shm_bucket(struct mobj_ffa_head *table,
+					uint64_t cookie)
+{
+	return table + mobj_cookie_hash(cookie, SHM_HASH_SHIFT);
+}
+
 static bool cmp_cookie(struct mobj_ffa *mf, uint64_t cookie)
 {
 	return mf->cookie == cookie;
@@ -181,11 +242,11 @@ void mobj_ffa_sel1_spmc_delete(struct mobj_ffa *mf)
 
 	assert(i >= 0 && i < NUM_SHMS);
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
+	exceptions = shm_lock_xsave();
 	assert(bit_test(shm_bits, i));
 	bit_clear(shm_bits, i);
 	assert(!mf->mm);
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 
 	free(mf);
 }
@@ -238,12 +299,16 @@ uint64_t mobj_ffa_push_to_inactive(struct mobj_ffa *mf)
 {
 	uint32_t exceptions = 0;
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	assert(!find_in_list(&shm_inactive_head, cmp_ptr, (vaddr_t)mf));
-	assert(!find_in_list(&shm_inactive_head, cmp_cookie, mf->cookie));
-	assert(!find_in_list(&shm_head, cmp_cookie, mf->cookie));
-	SLIST_INSERT_HEAD(&shm_inactive_head, mf, link);
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	exceptions = shm_lock_xsave();
+	assert(!find_in_list(shm_bucket(shm_inactive_head, mf->cookie),
+			     cmp_ptr, (vaddr_t)mf));
+	assert(!find_in_list(shm_bucket(shm_inactive_head, mf->cookie),
+			     cmp_cookie, mf->cookie));
+	assert(!find_in_list(shm_bucket(shm_head, mf->cookie),
+			     cmp_cookie, mf->cookie));
+	SLIST_INSERT_HEAD(shm_bucket(shm_inactive_head, mf->cookie), mf,
+			  link);
+	shm_unlock_xrestore(exceptions);
 
 	return mf->cookie;
 }
@@ -265,8 +330,8 @@ TEE_Result mobj_ffa_sel1_spmc_reclaim(uint64_t cookie)
 	struct mobj_ffa *mf = NULL;
 	uint32_t exceptions = 0;
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
+	exceptions = shm_lock_xsave();
+	mf = find_in_list(shm_bucket(shm_head, cookie), cmp_cookie, cookie);
 	/*
 	 * If the mobj is found here it's still active and cannot be
 	 * reclaimed.
@@ -278,7 +343,8 @@ TEE_Result mobj_ffa_sel1_spmc_reclaim(uint64_t cookie)
 		goto out;
 	}
 
-	mf = find_in_list(&shm_inactive_head, cmp_cookie, cookie);
+	mf = find_in_list(shm_bucket(shm_inactive_head, cookie),
+			  cmp_cookie, cookie);
 	if (!mf) {
 		res = TEE_ERROR_ITEM_NOT_FOUND;
 		goto out;
@@ -293,11 +359,12 @@ TEE_Result mobj_ffa_sel1_spmc_reclaim(uint64_t cookie)
 		goto out;
 	}
 
-	if (!pop_from_list(&shm_inactive_head, cmp_ptr, (vaddr_t)mf))
+	if (!pop_from_list(shm_bucket(shm_inactive_head, mf->cookie), cmp_ptr,
+			   (vaddr_t)mf))
 		panic();
 	res = TEE_SUCCESS;
 out:
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 	if (!res)
 		mobj_ffa_sel1_spmc_delete(mf);
 	return res;
@@ -311,8 +378,8 @@ TEE_Result mobj_ffa_unregister_by_cookie(uint64_t cookie)
 	uint32_t exceptions = 0;
 
 	assert(cookie != OPTEE_MSG_FMEM_INVALID_GLOBAL_ID);
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
+	exceptions = shm_lock_xsave();
+	mf = find_in_list(shm_bucket(shm_head, cookie), cmp_cookie, cookie);
 	/*
 	 * If the mobj is found here it's still active and cannot be
 	 * unregistered.
@@ -323,7 +390,8 @@ TEE_Result mobj_ffa_unregister_by_cookie(uint64_t cookie)
 		res = TEE_ERROR_BUSY;
 		goto out;
 	}
-	mf = find_in_list(&shm_inactive_head, cmp_cookie, cookie);
+	mf = find_in_list(shm_bucket(shm_inactive_head, cookie),
+			  cmp_cookie, cookie);
 	/*
 	 * If the mobj isn't found or if it already has been unregistered.
 	 */
@@ -337,7 +405,8 @@ TEE_Result mobj_ffa_unregister_by_cookie(uint64_t cookie)
 	}
 
 #ifdef CFG_CORE_SEL2_SPMC
-	mf = pop_from_list(&shm_inactive_head, cmp_cookie, cookie);
+	mf = pop_from_list(shm_bucket(shm_inactive_head, cookie),
+			   cmp_cookie, cookie);
 	mobj_ffa_sel2_spmc_delete(mf);
 	thread_spmc_relinquish(cookie);
 #else
@@ -346,7 +415,7 @@ TEE_Result mobj_ffa_unregister_by_cookie(uint64_t cookie)
 	res = TEE_SUCCESS;
 
 out:
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 	return res;
 }
 
@@ -358,8 +427,8 @@ struct mobj *mobj_ffa_get_by_cookie(uint64_t cookie,
 
 	if (internal_offs >= SMALL_PAGE_SIZE)
 		return NULL;
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
-	mf = find_in_list(&shm_head, cmp_cookie, cookie);
+	exceptions = shm_lock_xsave();
+	mf = find_in_list(shm_bucket(shm_head, cookie), cmp_cookie, cookie);
 	if (mf) {
 		if (mf->page_offset == internal_offs) {
 			if (!refcount_inc(&mf->mobj.refc)) {
@@ -379,7 +448,8 @@ struct mobj *mobj_ffa_get_by_cookie(uint64_t cookie,
 			mf = NULL;
 		}
 	} else {
-		mf = pop_from_list(&shm_inactive_head, cmp_cookie, cookie);
+		mf = pop_from_list(shm_bucket(shm_inactive_head, cookie),
+				   cmp_cookie, cookie);
 #if defined(CFG_CORE_SEL2_SPMC)
 		/* Try to retrieve it from the SPM at S-EL2 */
 		if (mf) {
@@ -417,11 +487,12 @@ struct mobj *mobj_ffa_get_by_cookie(uint64_t cookie,
 			mf->mobj.size -= internal_offs;
 			mf->page_offset = internal_offs;
 
-			SLIST_INSERT_HEAD(&shm_head, mf, link);
+			SLIST_INSERT_HEAD(shm_bucket(shm_head, cookie), mf,
+					  link);
 		}
 	}
 
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 
 	if (!mf) {
 		EMSG("Failed to get cookie %#"PRIx64" internal_offs %#x",
@@ -485,7 +556,7 @@ static void ffa_inactivate(struct mobj *mobj)
 	struct mobj_ffa *mf = to_mobj_ffa(mobj);
 	uint32_t exceptions = 0;
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
+	exceptions = shm_lock_xsave();
 	/*
 	 * If refcount isn't 0 some other thread has found this mobj in
 	 * shm_head after the mobj_put() that put us here and before we got
@@ -497,12 +568,14 @@ static void ffa_inactivate(struct mobj *mobj)
 	}
 
 	DMSG("cookie %#"PRIx64, mf->cookie);
-	if (!pop_from_list(&shm_head, cmp_ptr, (vaddr_t)mf))
+	if (!pop_from_list(shm_bucket(shm_head, mf->cookie), cmp_ptr,
+			   (vaddr_t)mf))
 		panic();
 	unmap_helper(mf);
-	SLIST_INSERT_HEAD(&shm_inactive_head, mf, link);
+	SLIST_INSERT_HEAD(shm_bucket(shm_inactive_head, mf->cookie), mf,
+			  link);
 out:
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 }
 
 static TEE_Result ffa_get_cattr(struct mobj *mobj __unused, uint32_t *cattr)
@@ -538,7 +611,7 @@ static TEE_Result ffa_inc_map(struct mobj *mobj)
 		if (refcount_inc(&mf->mapcount))
 			return TEE_SUCCESS;
 
-		exceptions = cpu_spin_lock_xsave(&shm_lock);
+		exceptions = shm_lock_xsave();
 
 		if (!refcount_val(&mf->mapcount))
 			break; /* continue to reinitialize */
@@ -546,7 +619,7 @@ static TEE_Result ffa_inc_map(struct mobj *mobj)
 		 * If another thread beat us to initialize mapcount,
 		 * restart to make sure we still increase it.
 		 */
-		cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+		shm_unlock_xrestore(exceptions);
 	}
 
 	/*
@@ -573,7 +646,7 @@ static TEE_Result ffa_inc_map(struct mobj *mobj)
 
 	refcount_set(&mf->mapcount, 1);
 out:
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 
 	return res;
 }
@@ -586,10 +659,10 @@ static TEE_Result ffa_dec_map(struct mobj *mobj)
 	if (!refcount_dec(&mf->mapcount))
 		return TEE_SUCCESS;
 
-	exceptions = cpu_spin_lock_xsave(&shm_lock);
+	exceptions = shm_lock_xsave();
 	if (!refcount_val(&mf->mapcount))
 		unmap_helper(mf);
-	cpu_spin_unlock_xrestore(&shm_lock, exceptions);
+	shm_unlock_xrestore(exceptions);
 
 	return TEE_SUCCESS;
 }
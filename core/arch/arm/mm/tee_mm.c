@@ -35,6 +35,236 @@ static void pfree(tee_mm_pool_t *pool, void *ptr)
 		free(ptr);
 }
 
+/*
+ * The entries are ordered by position, which is the offset for normal
+ * pools and the offset counted downwards from the top of the pool for
+ * TEE_MM_POOL_HI_ALLOC pools. This way the first free gap found in
+ * position order is the one a simple list walk would have found.
+ */
+static uint32_t pool_units(const tee_mm_pool_t *pool)
+{
+	return pool->size >> pool->shift;
+}
+
+static uint32_t pos_start(const tee_mm_entry_t *e)
+{
+	if (e->pool->flags & TEE_MM_POOL_HI_ALLOC)
+		return pool_units(e->pool) - e->offset - e->size;
+	return e->offset;
+}
+
+static uint32_t pos_end(const tee_mm_entry_t *e)
+{
+	return pos_start(e) + e->size;
+}
+
+static uint32_t pos_to_offset(const tee_mm_pool_t *pool, uint32_t pos,
+			      uint32_t size)
+{
+	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+		return pool_units(pool) - pos - size;
+	return pos;
+}
+
+static uint32_t next_prio(tee_mm_pool_t *pool)
+{
+	/* xorshift32, only needs to be random enough to balance the treap */
+	uint32_t x = pool->prio_seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pool->prio_seed = x;
+
+	return x;
+}
+
+static void update_max_gap(tee_mm_entry_t *e)
+{
+	e->max_gap = e->gap;
+	if (e->left && e->left->max_gap > e->max_gap)
+		e->max_gap = e->left->max_gap;
+	if (e->right && e->right->max_gap > e->max_gap)
+		e->max_gap = e->right->max_gap;
+}
+
+static void update_max_gap_path(tee_mm_entry_t *e)
+{
+	while (e) {
+		update_max_gap(e);
+		e = e->parent;
+	}
+}
+
+static void replace_child(tee_mm_pool_t *pool, tee_mm_entry_t *parent,
+			  tee_mm_entry_t *old, tee_mm_entry_t *new)
+{
+	if (!parent)
+		pool->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+	if (new)
+		new->parent = parent;
+}
+
+/* Rotates @e up one level, replacing its parent */
+static void rotate_up(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *p = e->parent;
+
+	replace_child(pool, p->parent, p, e);
+	if (p->left == e) {
+		p->left = e->right;
+		if (p->left)
+			p->left->parent = p;
+		e->right = p;
+	} else {
+		p->right = e->left;
+		if (p->right)
+			p->right->parent = p;
+		e->left = p;
+	}
+	p->parent = e;
+
+	update_max_gap(p);
+	update_max_gap(e);
+}
+
+static tee_mm_entry_t *first_entry(tee_mm_entry_t *e)
+{
+	while (e && e->left)
+		e = e->left;
+	return e;
+}
+
+static tee_mm_entry_t *last_entry(tee_mm_entry_t *e)
+{
+	while (e && e->right)
+		e = e->right;
+	return e;
+}
+
+static tee_mm_entry_t *next_entry(tee_mm_entry_t *e)
+{
+	if (e->right)
+		return first_entry(e->right);
+
+	while (e->parent && e->parent->right == e)
+		e = e->parent;
+
+	return e->parent;
+}
+
+/* Free units after the last entry */
+static uint32_t tail_gap(tee_mm_pool_t *pool)
+{
+	tee_mm_entry_t *last = last_entry(pool->root);
+
+	if (!last)
+		return pool_units(pool);
+	return pool_units(pool) - pos_end(last);
+}
+
+/*
+ * Inserts @e in the position just before @next, or last if @next is NULL.
+ * The gaps of @e and @next must already be updated.
+ */
+static void insert_entry(tee_mm_pool_t *pool, tee_mm_entry_t *e,
+			 tee_mm_entry_t *next)
+{
+	tee_mm_entry_t *p = NULL;
+
+	e->left = NULL;
+	e->right = NULL;
+	e->prio = next_prio(pool);
+
+	if (next && !next->left) {
+		next->left = e;
+		e->parent = next;
+	} else {
+		if (next)
+			p = last_entry(next->left);
+		else
+			p = last_entry(pool->root);
+		if (p)
+			p->right = e;
+		else
+			pool->root = e;
+		e->parent = p;
+	}
+
+	update_max_gap_path(e);
+	while (e->parent && e->parent->prio < e->prio)
+		rotate_up(pool, e);
+	update_max_gap_path(e);
+	update_max_gap_path(next);
+}
+
+static void remove_entry(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *next = next_entry(e);
+	tee_mm_entry_t *child = NULL;
+	tee_mm_entry_t *parent = NULL;
+
+	if (next)
+		next->gap += e->gap + e->size;
+
+	/* Rotate @e down until it has at most one child */
+	while (e->left && e->right) {
+		if (e->left->prio > e->right->prio)
+			rotate_up(pool, e->left);
+		else
+			rotate_up(pool, e->right);
+	}
+
+	child = e->left;
+	if (!child)
+		child = e->right;
+	parent = e->parent;
+	replace_child(pool, parent, e, child);
+
+	update_max_gap_path(parent);
+	update_max_gap_path(next);
+}
+
+/* Returns the first entry with at least @psize free units in front of it */
+static tee_mm_entry_t *find_gap(tee_mm_pool_t *pool, uint32_t psize)
+{
+	tee_mm_entry_t *e = pool->root;
+
+	if (!e || e->max_gap < psize)
+		return NULL;
+
+	while (true) {
+		if (e->left && e->left->max_gap >= psize)
+			e = e->left;
+		else if (e->gap >= psize)
+			return e;
+		else
+			e = e->right;
+	}
+}
+
+/* Returns the first entry with a position ending after @pos */
+static tee_mm_entry_t *find_pos(const tee_mm_pool_t *pool, uint32_t pos)
+{
+	tee_mm_entry_t *e = pool->root;
+	tee_mm_entry_t *ret = NULL;
+
+	while (e) {
+		if (pos < pos_end(e)) {
+			ret = e;
+			e = e->left;
+		} else {
+			e = e->right;
+		}
+	}
+
+	return ret;
+}
+
 bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_size_t size,
 		 uint8_t shift, uint32_t flags)
 {
@@ -54,56 +284,28 @@ bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_size_t size,
 	pool->size = size;
 	pool->shift = shift;
 	pool->flags = flags;
-	pool->entry = pcalloc(pool, 1, sizeof(tee_mm_entry_t));
-
-	if (pool->entry == NULL)
-		return false;
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		pool->entry->offset = ((size - 1) >> shift) + 1;
-
-	pool->entry->pool = pool;
+	pool->root = NULL;
+	pool->prio_seed = 0x2545f491;
 	pool->lock = SPINLOCK_UNLOCK;
+#ifdef CFG_WITH_STATS
+	pool->allocated = 0;
+#endif
+	pool->initialized = true;
 
 	return true;
 }
 
 void tee_mm_final(tee_mm_pool_t *pool)
 {
-	if (pool == NULL || pool->entry == NULL)
+	if (pool == NULL || !pool->initialized)
 		return;
 
-	while (pool->entry->next != NULL)
-		tee_mm_free(pool->entry->next);
-	pfree(pool, pool->entry);
-	pool->entry = NULL;
-}
-
-static void tee_mm_add(tee_mm_entry_t *p, tee_mm_entry_t *nn)
-{
-	/* add to list */
-	nn->next = p->next;
-	p->next = nn;
+	while (pool->root)
+		tee_mm_free(pool->root);
+	pool->initialized = false;
 }
 
 #ifdef CFG_WITH_STATS
-static size_t tee_mm_stats_allocated(tee_mm_pool_t *pool)
-{
-	tee_mm_entry_t *entry;
-	uint32_t sz = 0;
-
-	if (!pool)
-		return 0;
-
-	entry = pool->entry;
-	while (entry) {
-		sz += entry->size;
-		entry = entry->next;
-	}
-
-	return sz << pool->shift;
-}
-
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
 			   bool reset)
 {
@@ -118,22 +320,31 @@ void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
 
 	stats->size = pool->size;
 	stats->max_allocated = pool->max_allocated;
-	stats->allocated = tee_mm_stats_allocated(pool);
+	stats->allocated = pool->allocated << pool->shift;
 
 	if (reset)
 		pool->max_allocated = 0;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 }
 
-static void update_max_allocated(tee_mm_pool_t *pool)
+static void update_allocated(tee_mm_pool_t *pool, tee_mm_entry_t *e,
+			     bool add)
 {
-	size_t sz = tee_mm_stats_allocated(pool);
+	size_t sz = 0;
 
+	if (add)
+		pool->allocated += e->size;
+	else
+		pool->allocated -= e->size;
+
+	sz = pool->allocated << pool->shift;
 	if (sz > pool->max_allocated)
 		pool->max_allocated = sz;
 }
 #else /* CFG_WITH_STATS */
-static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
+static inline void update_allocated(tee_mm_pool_t *pool __unused,
+				    tee_mm_entry_t *e __unused,
+				    bool add __unused)
 {
 }
 #endif /* CFG_WITH_STATS */
@@ -141,80 +352,53 @@ static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
 tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 {
 	size_t psize;
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *next;
 	tee_mm_entry_t *nn;
-	size_t remaining;
+	uint32_t remaining;
+	uint32_t pos;
 	uint32_t exceptions;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
-	nn = pmalloc(pool, sizeof(tee_mm_entry_t));
+	nn = pcalloc(pool, 1, sizeof(tee_mm_entry_t));
 	if (!nn)
 		return NULL;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	entry = pool->entry;
 	if (!size)
 		psize = 0;
 	else
 		psize = ((size - 1) >> pool->shift) + 1;
 
 	/* find free slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL && psize >
-		       (entry->offset - entry->next->offset -
-			entry->next->size))
-			entry = entry->next;
+	next = find_gap(pool, psize);
+	if (next) {
+		pos = pos_start(next) - next->gap;
+		nn->gap = 0;
+		next->gap -= psize;
 	} else {
-		while (entry->next != NULL && psize >
-		       (entry->next->offset - entry->size - entry->offset))
-			entry = entry->next;
-	}
-
-	/* check if we have enough memory */
-	if (entry->next == NULL) {
-		if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-			/*
-			 * entry->offset is a "block count" offset from
-			 * pool->lo. The byte offset is
-			 * (entry->offset << pool->shift).
-			 * In the HI_ALLOC allocation scheme the memory is
-			 * allocated from the end of the segment, thus to
-			 * validate there is sufficient memory validate that
-			 * (entry->offset << pool->shift) > size.
-			 */
-			if ((entry->offset << pool->shift) < size) {
-				/* out of memory */
-				goto err;
-			}
-		} else {
-			if (!pool->size)
-				panic("invalid pool");
-
-			remaining = pool->size;
-			remaining -= ((entry->offset + entry->size) <<
-				      pool->shift);
-
-			if (remaining < size) {
-				/* out of memory */
-				goto err;
-			}
+		if (!pool->size)
+			panic("invalid pool");
+
+		/* check if we have enough memory */
+		remaining = tail_gap(pool);
+		if (remaining < psize) {
+			/* out of memory */
+			goto err;
 		}
+		pos = pool_units(pool) - remaining;
+		nn->gap = 0;
 	}
 
-	tee_mm_add(entry, nn);
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		nn->offset = entry->offset - psize;
-	else
-		nn->offset = entry->offset + entry->size;
+	nn->offset = pos_to_offset(pool, pos, psize);
 	nn->size = psize;
 	nn->pool = pool;
+	insert_entry(pool, nn, next);
 
-	update_max_allocated(pool);
+	update_allocated(pool, nn, true);
 
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return nn;
@@ -224,74 +408,68 @@ err:
 	return NULL;
 }
 
-static inline bool fit_in_gap(tee_mm_pool_t *pool, tee_mm_entry_t *e,
-			      paddr_t offslo, paddr_t offshi)
-{
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		if (offshi > e->offset ||
-		    (e->next != NULL &&
-		     (offslo < e->next->offset + e->next->size)) ||
-		    (offshi << pool->shift) - 1 > pool->size)
-			/* memory not available */
-			return false;
-	} else {
-		if (offslo < (e->offset + e->size) ||
-		    (e->next != NULL && (offshi > e->next->offset)) ||
-		    (offshi << pool->shift) > pool->size)
-			/* memory not available */
-			return false;
-	}
-
-	return true;
-}
-
 tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *next;
 	paddr_t offslo;
 	paddr_t offshi;
+	uint32_t poslo;
+	uint32_t poshi;
+	uint32_t gap_start;
 	tee_mm_entry_t *mm;
 	uint32_t exceptions;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
 	/* Wrapping and sanity check */
 	if ((base + size) < base || base < pool->lo)
 		return NULL;
 
-	mm = pmalloc(pool, sizeof(tee_mm_entry_t));
+	mm = pcalloc(pool, 1, sizeof(tee_mm_entry_t));
 	if (!mm)
 		return NULL;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	entry = pool->entry;
 	offslo = (base - pool->lo) >> pool->shift;
 	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
 
-	/* find slot */
+	/* Check that memory is available */
+	if (offshi > pool_units(pool))
+		goto err;
+
 	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL &&
-		       offshi < entry->next->offset + entry->next->size)
-			entry = entry->next;
+		poslo = pool_units(pool) - offshi;
+		poshi = pool_units(pool) - offslo;
 	} else {
-		while (entry->next != NULL && offslo > entry->next->offset)
-			entry = entry->next;
+		poslo = offslo;
+		poshi = offshi;
 	}
 
-	/* Check that memory is available */
-	if (!fit_in_gap(pool, entry, offslo, offshi))
-		goto err;
-
-	tee_mm_add(entry, mm);
+	/* find slot */
+	next = find_pos(pool, poslo);
+	if (next) {
+		if (poshi > pos_start(next))
+			goto err;
+		gap_start = pos_start(next) - next->gap;
+		if (poslo < gap_start)
+			goto err;
+		next->gap = pos_start(next) - poshi;
+	} else {
+		gap_start = pool_units(pool) - tail_gap(pool);
+		if (poslo < gap_start)
+			goto err;
+	}
 
 	mm->offset = offslo;
 	mm->size = offshi - offslo;
+	mm->gap = poslo - gap_start;
 	mm->pool = pool;
+	insert_entry(pool, mm, next);
 
-	update_max_allocated(pool);
+	update_allocated(pool, mm, true);
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return mm;
 err:
@@ -309,16 +487,16 @@ void tee_mm_free(tee_mm_entry_t *p)
 		return;
 
 	exceptions = cpu_spin_lock_xsave(&p->pool->lock);
-	entry = p->pool->entry;
 
-	/* remove entry from list */
-	while (entry->next != NULL && entry->next != p)
-		entry = entry->next;
-
-	if (!entry->next)
+	/* check that the entry is in the tree of the pool */
+	entry = p;
+	while (entry->parent)
+		entry = entry->parent;
+	if (entry != p->pool->root)
 		panic("invalid mm_entry");
 
-	entry->next = entry->next->next;
+	remove_entry(p->pool, p);
+	update_allocated(p->pool, p, false);
 	cpu_spin_unlock_xrestore(&p->pool->lock, exceptions);
 
 	pfree(p->pool, p);
@@ -343,11 +521,11 @@ bool tee_mm_is_empty(tee_mm_pool_t *pool)
 	bool ret;
 	uint32_t exceptions;
 
-	if (pool == NULL || pool->entry == NULL)
+	if (pool == NULL || !pool->initialized)
 		return true;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
-	ret = pool->entry == NULL || pool->entry->next == NULL;
+	ret = !pool->root;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 
 	return ret;
@@ -364,28 +542,27 @@ tee_mm_pool_t tee_mm_shm;
 
 tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 {
-	tee_mm_entry_t *entry = pool->entry;
-	uint16_t offset = (addr - pool->lo) >> pool->shift;
+	tee_mm_entry_t *entry = NULL;
+	uint32_t offset = (addr - pool->lo) >> pool->shift;
+	uint32_t pos = 0;
 	uint32_t exceptions;
 
 	if (!tee_mm_addr_is_within_range(pool, addr))
 		return NULL;
 
-	exceptions = cpu_spin_lock_xsave(&((tee_mm_pool_t *)pool)->lock);
+	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+		pos = pool_units(pool) - offset - 1;
+	else
+		pos = offset;
 
-	while (entry->next != NULL) {
-		entry = entry->next;
+	exceptions = cpu_spin_lock_xsave(&((tee_mm_pool_t *)pool)->lock);
 
-		if ((offset >= entry->offset) &&
-		    (offset < (entry->offset + entry->size))) {
-			cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock,
-						 exceptions);
-			return entry;
-		}
-	}
+	entry = find_pos(pool, pos);
+	if (entry && pos < pos_start(entry))
+		entry = NULL;
 
 	cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock, exceptions);
-	return NULL;
+	return entry;
 }
 
 uintptr_t tee_mm_get_smem(const tee_mm_entry_t *mm)
@@ -11,6 +11,7 @@
 #include <kernel/abort.h>
 #include <kernel/asan.h>
 #include <kernel/cache_helpers.h>
+#include <kernel/delay.h>
 #include <kernel/linker.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
@@ -84,6 +85,24 @@ static struct tee_pager_pmem *pager_spare_pmem;
 
 #ifdef CFG_WITH_STATS
 static struct tee_pager_stats pager_stats;
+static uint64_t pmem_lookup_ticks;
+static uint64_t writeback_ticks;
+
+/*
+ * A page loaded again within this many page-ins after being evicted is
+ * counted as a refault.
+ */
+#define PAGER_REFAULT_WINDOW	32
+
+static struct pager_evicted_page {
+	struct fobj *fobj;
+	unsigned int fobj_pgidx;
+} pager_evicted[PAGER_REFAULT_WINDOW];
+static size_t pager_num_loads;
+
+/* Pages examined and pages found used by the clock hand this revolution */
+static size_t clock_steps;
+static size_t clock_refs;
 
 static inline void incr_ro_hits(void)
 {
@@ -110,19 +129,116 @@ static inline void incr_npages_all(void)
 	pager_stats.npages_all++;
 }
 
+static inline void incr_prefetched(void)
+{
+	pager_stats.prefetched++;
+}
+
 static inline void set_npages(void)
 {
 	pager_stats.npages = tee_pager_npages;
 }
 
+static inline uint64_t pmem_lookup_begin(void)
+{
+	if (!IS_ENABLED(CFG_CORE_PAGER_LOOKUP_TIMING))
+		return 0;
+	return barrier_read_counter_timer();
+}
+
+static inline void pmem_lookup_end(uint64_t begin)
+{
+	pager_stats.pmem_lookups++;
+	if (IS_ENABLED(CFG_CORE_PAGER_LOOKUP_TIMING))
+		pmem_lookup_ticks += barrier_read_counter_timer() - begin;
+}
+
+static inline uint64_t writeback_begin(void)
+{
+	return barrier_read_counter_timer();
+}
+
+static inline void writeback_end(uint64_t begin, size_t num_ahead)
+{
+	pager_stats.writebacks++;
+	pager_stats.writeback_ahead += num_ahead;
+	writeback_ticks += barrier_read_counter_timer() - begin;
+}
+
+static inline void note_eviction(struct fobj *fobj, unsigned int fobj_pgidx,
+				 bool dirty)
+{
+	struct pager_evicted_page *e = NULL;
+
+	if (dirty)
+		pager_stats.dirty_evictions++;
+	else
+		pager_stats.clean_evictions++;
+
+	e = pager_evicted + pager_num_loads % PAGER_REFAULT_WINDOW;
+	e->fobj = fobj;
+	e->fobj_pgidx = fobj_pgidx;
+}
+
+static inline void note_load(struct fobj *fobj, unsigned int fobj_pgidx)
+{
+	size_t n = 0;
+
+	for (n = 0; n < PAGER_REFAULT_WINDOW; n++) {
+		if (pager_evicted[n].fobj == fobj &&
+		    pager_evicted[n].fobj_pgidx == fobj_pgidx) {
+			pager_evicted[n].fobj = NULL;
+			pager_stats.refaults++;
+			break;
+		}
+	}
+	pager_num_loads++;
+}
+
+static inline void forget_evicted(struct fobj *fobj)
+{
+	size_t n = 0;
+
+	for (n = 0; n < PAGER_REFAULT_WINDOW; n++)
+		if (pager_evicted[n].fobj == fobj)
+			pager_evicted[n].fobj = NULL;
+}
+
+/*
+ * The pages found used during one revolution of the clock hand is the
+ * estimate of the working set.
+ */
+static inline void note_clock_step(bool referenced)
+{
+	clock_steps++;
+	if (referenced)
+		clock_refs++;
+	if (clock_steps >= tee_pager_npages) {
+		pager_stats.ws_pages = clock_refs;
+		clock_steps = 0;
+		clock_refs = 0;
+	}
+}
+
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	*stats = pager_stats;
+	stats->pmem_lookup_ns = arm_cnt_cnt2ns(pmem_lookup_ticks);
+	stats->writeback_ns = arm_cnt_cnt2ns(writeback_ticks);
 
 	pager_stats.hidden_hits = 0;
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.pmem_lookups = 0;
+	pmem_lookup_ticks = 0;
+	pager_stats.clean_evictions = 0;
+	pager_stats.dirty_evictions = 0;
+	pager_stats.refaults = 0;
+	pager_stats.prefetched = 0;
+	pager_stats.writebacks = 0;
+	pager_stats.writeback_ahead = 0;
+	writeback_ticks = 0;
 }
 
 #else /* CFG_WITH_STATS */
@@ -131,7 +247,20 @@ static inline void incr_rw_hits(void) { }
 static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
 static inline void incr_npages_all(void) { }
+static inline void incr_prefetched(void) { }
 static inline void set_npages(void) { }
+static inline uint64_t pmem_lookup_begin(void) { return 0; }
+static inline void pmem_lookup_end(uint64_t begin __unused) { }
+static inline uint64_t writeback_begin(void) { return 0; }
+static inline void writeback_end(uint64_t begin __unused,
+				 size_t num_ahead __unused) { }
+static inline void note_eviction(struct fobj *fobj __unused,
+				 unsigned int fobj_pgidx __unused,
+				 bool dirty __unused) { }
+static inline void note_load(struct fobj *fobj __unused,
+			     unsigned int fobj_pgidx __unused) { }
+static inline void forget_evicted(struct fobj *fobj __unused) { }
+static inline void note_clock_step(bool referenced __unused) { }
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
@@ -480,7 +609,6 @@ static void tblidx_tlbi_entry(struct tblidx tblidx)
 static void pmem_assign_fobj_page(struct tee_pager_pmem *pmem,
 				  struct vm_paged_region *reg, vaddr_t va)
 {
-	struct tee_pager_pmem *p = NULL;
 	unsigned int fobj_pgidx = 0;
 
 	assert(!pmem->fobj && pmem->fobj_pgidx == INVALID_PGIDX);
@@ -488,8 +616,8 @@ static void pmem_assign_fobj_page(struct tee_pager_pmem *pmem,
 	assert(va >= reg->base && va < (reg->base + reg->size));
 	fobj_pgidx = (va - reg->base) / SMALL_PAGE_SIZE + reg->fobj_pgoffs;
 
-	TAILQ_FOREACH(p, &tee_pager_pmem_head, link)
-		assert(p->fobj != reg->fobj || p->fobj_pgidx != fobj_pgidx);
+	assert(reg->fobj->pmems && !reg->fobj->pmems[fobj_pgidx]);
+	reg->fobj->pmems[fobj_pgidx] = pmem;
 
 	pmem->fobj = reg->fobj;
 	pmem->fobj_pgidx = fobj_pgidx;
@@ -497,6 +625,10 @@ static void pmem_assign_fobj_page(struct tee_pager_pmem *pmem,
 
 static void pmem_clear(struct tee_pager_pmem *pmem)
 {
+	if (pmem->fobj) {
+		assert(pmem->fobj->pmems[pmem->fobj_pgidx] == pmem);
+		pmem->fobj->pmems[pmem->fobj_pgidx] = NULL;
+	}
 	pmem->fobj = NULL;
 	pmem->fobj_pgidx = INVALID_PGIDX;
 	pmem->flags = 0;
@@ -598,6 +730,36 @@ static void region_insert(struct vm_paged_region_head *regions,
 }
 DECLARE_KEEP_PAGER(region_insert);
 
+/*
+ * Allocates the index of physical pages of @fobj unless already done.
+ * Must be called before the first region using @fobj is inserted.
+ */
+static TEE_Result alloc_fobj_pmems(struct fobj *fobj)
+{
+	struct tee_pager_pmem **pmems = NULL;
+	uint32_t exceptions = 0;
+
+	if (fobj->pmems)
+		return TEE_SUCCESS;
+
+	pmems = calloc(fobj->num_pages, sizeof(*pmems));
+	if (!pmems)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	/* Another thread may have mapped the same fobj meanwhile */
+	exceptions = pager_lock_check_stack(8);
+	if (!fobj->pmems) {
+		fobj->pmems = pmems;
+		pmems = NULL;
+	}
+	pager_unlock(exceptions);
+
+	free(pmems);
+
+	return TEE_SUCCESS;
+}
+DECLARE_KEEP_PAGER(alloc_fobj_pmems);
+
 static struct vm_paged_region *alloc_region(vaddr_t base, size_t size)
 {
 	struct vm_paged_region *reg = NULL;
@@ -633,6 +795,9 @@ void tee_pager_add_core_region(vaddr_t base, enum vm_paged_region_type type,
 	DMSG("0x%" PRIxPTR " - 0x%" PRIxPTR " : type %d",
 	     base, base + fobj->num_pages * SMALL_PAGE_SIZE, type);
 
+	if (alloc_fobj_pmems(fobj))
+		panic("alloc_fobj_pmems");
+
 	reg = alloc_region(base, fobj->num_pages * SMALL_PAGE_SIZE);
 	if (!reg)
 		panic("alloc_region");
@@ -758,6 +923,9 @@ static TEE_Result pager_add_um_region(struct user_mode_ctx *uctx, vaddr_t base,
 		reg = TAILQ_NEXT(reg, link);
 	}
 
+	if (alloc_fobj_pmems(fobj))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
 	reg = alloc_region(b, s);
 	if (!reg)
 		return TEE_ERROR_OUT_OF_MEMORY;
@@ -1015,16 +1183,16 @@ static void rem_region(struct vm_paged_region_head *regions,
 	uint32_t exceptions;
 	struct tblidx tblidx = { };
 	uint32_t a = 0;
+	size_t n = 0;
 
 	exceptions = pager_lock_check_stack(64);
 
 	TAILQ_REMOVE(regions, reg, link);
 	TAILQ_REMOVE(&reg->fobj->regions, reg, fobj_link);
 
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		if (pmem->fobj != reg->fobj ||
-		    pmem->fobj_pgidx < reg->fobj_pgoffs ||
-		    pmem->fobj_pgidx > last_pgoffs)
+	for (n = reg->fobj_pgoffs; n <= last_pgoffs; n++) {
+		pmem = reg->fobj->pmems[n];
+		if (!pmem)
 			continue;
 
 		tblidx = pmem_get_region_tblidx(pmem, reg);
@@ -1104,6 +1272,7 @@ bool tee_pager_set_um_region_attr(struct user_mode_ctx *uctx, vaddr_t base,
 	uint32_t mattr = 0;
 	uint32_t f2 = 0;
 	struct tblidx tblidx = { };
+	size_t n = 0;
 
 	f = (flags & TEE_MATTR_URWX) | TEE_MATTR_UR | TEE_MATTR_PR;
 	if (f & TEE_MATTR_UW)
@@ -1124,8 +1293,9 @@ bool tee_pager_set_um_region_attr(struct user_mode_ctx *uctx, vaddr_t base,
 		if (reg->flags == f)
 			goto next_region;
 
-		TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-			if (!pmem_is_covered_by_region(pmem, reg))
+		for (n = 0; n < reg->size >> SMALL_PAGE_SHIFT; n++) {
+			pmem = reg->fobj->pmems[reg->fobj_pgoffs + n];
+			if (!pmem)
 				continue;
 
 			tblidx = pmem_get_region_tblidx(pmem, reg);
@@ -1182,32 +1352,40 @@ DECLARE_KEEP_PAGER(tee_pager_set_um_region_attr);
 
 void tee_pager_invalidate_fobj(struct fobj *fobj)
 {
-	struct tee_pager_pmem *pmem;
-	uint32_t exceptions;
+	struct tee_pager_pmem **pmems = NULL;
+	uint32_t exceptions = 0;
+	size_t n = 0;
 
 	exceptions = pager_lock_check_stack(64);
 
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link)
-		if (pmem->fobj == fobj)
-			pmem_clear(pmem);
+	pmems = fobj->pmems;
+	if (pmems) {
+		for (n = 0; n < fobj->num_pages; n++)
+			if (pmems[n])
+				pmem_clear(pmems[n]);
+		fobj->pmems = NULL;
+	}
+	forget_evicted(fobj);
 
 	pager_unlock(exceptions);
+
+	free(pmems);
 }
 DECLARE_KEEP_PAGER(tee_pager_invalidate_fobj);
 
 static struct tee_pager_pmem *pmem_find(struct vm_paged_region *reg, vaddr_t va)
 {
+	uint64_t begin = pmem_lookup_begin();
 	struct tee_pager_pmem *pmem = NULL;
 	size_t fobj_pgidx = 0;
 
 	assert(va >= reg->base && va < (reg->base + reg->size));
 	fobj_pgidx = (va - reg->base) / SMALL_PAGE_SIZE + reg->fobj_pgoffs;
 
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link)
-		if (pmem->fobj == reg->fobj && pmem->fobj_pgidx == fobj_pgidx)
-			return pmem;
+	pmem = reg->fobj->pmems[fobj_pgidx];
+	pmem_lookup_end(begin);
 
-	return NULL;
+	return pmem;
 }
 
 static bool tee_pager_unhide_page(struct vm_paged_region *reg, vaddr_t page_va)
@@ -1303,6 +1481,39 @@ static void tee_pager_hide_pages(void)
 	}
 }
 
+/*
+ * Returns the physical page to use for the next page-in, the oldest page
+ * unless CFG_CORE_PAGER_CLOCK is enabled.
+ *
+ * With CFG_CORE_PAGER_CLOCK the head of tee_pager_pmem_head is the clock
+ * hand and the hidden flag serves as an inverted reference bit: a page
+ * which has been used since it was last hidden is hidden again and moved
+ * to the tail, the first unused or still hidden page is returned.
+ */
+static struct tee_pager_pmem *pager_select_victim(void)
+{
+	struct tee_pager_pmem *pmem = NULL;
+
+	if (!IS_ENABLED(CFG_CORE_PAGER_CLOCK))
+		return TAILQ_FIRST(&tee_pager_pmem_head);
+
+	while (true) {
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (!pmem)
+			return NULL;
+		if (!pmem->fobj || pmem_is_hidden(pmem)) {
+			note_clock_step(false);
+			return pmem;
+		}
+
+		pmem->flags |= PMEM_FLAG_HIDDEN;
+		pmem_unmap(pmem, NULL);
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+		note_clock_step(true);
+	}
+}
+
 static unsigned int __maybe_unused
 num_regions_with_pmem(struct tee_pager_pmem *pmem)
 {
@@ -1331,35 +1542,64 @@ static bool tee_pager_release_one_phys(struct vm_paged_region *reg,
 	fobj_pgidx = (page_va - reg->base) / SMALL_PAGE_SIZE +
 		     reg->fobj_pgoffs;
 
-	TAILQ_FOREACH(pmem, &tee_pager_lock_pmem_head, link) {
-		if (pmem->fobj != reg->fobj || pmem->fobj_pgidx != fobj_pgidx)
-			continue;
+	/* Only pages of locked regions are kept in the lock list */
+	if (reg->type != PAGED_REGION_TYPE_LOCK)
+		return false;
+	pmem = reg->fobj->pmems[fobj_pgidx];
+	if (!pmem)
+		return false;
 
-		/*
-		 * Locked pages may not be shared. We're asserting that the
-		 * number of regions using this pmem is one and only one as
-		 * we're about to unmap it.
-		 */
-		assert(num_regions_with_pmem(pmem) == 1);
+	/*
+	 * Locked pages may not be shared. We're asserting that the
+	 * number of regions using this pmem is one and only one as
+	 * we're about to unmap it.
+	 */
+	assert(num_regions_with_pmem(pmem) == 1);
+
+	tblidx = pmem_get_region_tblidx(pmem, reg);
+	tblidx_set_entry(tblidx, 0, 0);
+	pgt_dec_used_entries(tblidx.pgt);
+	TAILQ_REMOVE(&tee_pager_lock_pmem_head, pmem, link);
+	pmem_clear(pmem);
+	tee_pager_npages++;
+	set_npages();
+	TAILQ_INSERT_HEAD(&tee_pager_pmem_head, pmem, link);
+	incr_zi_released();
+	return true;
+}
 
-		tblidx = pmem_get_region_tblidx(pmem, reg);
-		tblidx_set_entry(tblidx, 0, 0);
-		pgt_dec_used_entries(tblidx.pgt);
-		TAILQ_REMOVE(&tee_pager_lock_pmem_head, pmem, link);
-		pmem_clear(pmem);
-		tee_pager_npages++;
-		set_npages();
-		TAILQ_INSERT_HEAD(&tee_pager_pmem_head, pmem, link);
-		incr_zi_released();
-		return true;
+/*
+ * Ensures we are allowed to write to the aliased virtual page of @pmem,
+ * returns the table info, index and entry of the alias mapping.
+ */
+static struct core_mmu_table_info *
+pmem_alias_make_writable(struct tee_pager_pmem *pmem, unsigned int *idx,
+			 paddr_t *pa, uint32_t *attr)
+{
+	struct core_mmu_table_info *ti = NULL;
+	vaddr_t va_alias = (vaddr_t)pmem->va_alias;
+
+	ti = find_table_info(va_alias);
+	*idx = core_mmu_va2idx(ti, va_alias);
+	core_mmu_get_entry(ti, *idx, pa, attr);
+	if (!(*attr & TEE_MATTR_PW)) {
+		*attr |= TEE_MATTR_PW;
+		core_mmu_set_entry(ti, *idx, *pa, *attr);
+		tlbi_mva_allasid(va_alias);
 	}
 
-	return false;
+	return ti;
 }
 
+/*
+ * Maps @pmem at @page_va in @reg. The content of the page is loaded
+ * from the fobj unless @loaded is true, in which case the caller has
+ * already loaded it via the writable alias.
+ */
 static void pager_deploy_page(struct tee_pager_pmem *pmem,
 			      struct vm_paged_region *reg, vaddr_t page_va,
-			      bool clean_user_cache, bool writable)
+			      bool clean_user_cache, bool writable,
+			      bool loaded)
 {
 	struct tblidx tblidx = region_va2tblidx(reg, page_va);
 	uint32_t attr = get_region_mattr(reg->flags);
@@ -1370,18 +1610,11 @@ static void pager_deploy_page(struct tee_pager_pmem *pmem,
 	uint32_t attr_alias = 0;
 	paddr_t pa_alias = 0;
 
-	/* Ensure we are allowed to write to aliased virtual page */
-	ti = find_table_info((vaddr_t)va_alias);
-	idx_alias = core_mmu_va2idx(ti, (vaddr_t)va_alias);
-	core_mmu_get_entry(ti, idx_alias, &pa_alias, &attr_alias);
-	if (!(attr_alias & TEE_MATTR_PW)) {
-		attr_alias |= TEE_MATTR_PW;
-		core_mmu_set_entry(ti, idx_alias, pa_alias, attr_alias);
-		tlbi_mva_allasid((vaddr_t)va_alias);
-	}
+	ti = pmem_alias_make_writable(pmem, &idx_alias, &pa_alias, &attr_alias);
 
 	asan_tag_access(va_alias, va_alias + SMALL_PAGE_SIZE);
-	if (fobj_load_page(pmem->fobj, pmem->fobj_pgidx, va_alias)) {
+	if (!loaded &&
+	    fobj_load_page(pmem->fobj, pmem->fobj_pgidx, va_alias)) {
 		EMSG("PH 0x%" PRIxVA " failed", page_va);
 		panic();
 	}
@@ -1537,7 +1770,8 @@ static void make_iv_available(struct fobj *fobj, unsigned int fobj_pgidx,
 			pmem->flags |= PMEM_FLAG_DIRTY;
 
 		pager_deploy_page(pmem, reg, page_va,
-				  false /*!clean_user_cache*/, writable);
+				  false /*!clean_user_cache*/, writable,
+				  false /*!loaded*/);
 	} else if (writable && !(attr & TEE_MATTR_PW)) {
 		pmem = pmem_find(reg, page_va);
 		/* Note that pa is valid since TEE_MATTR_VALID_BLOCK is set */
@@ -1545,21 +1779,90 @@ static void make_iv_available(struct fobj *fobj, unsigned int fobj_pgidx,
 	}
 }
 
-static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
-			   bool clean_user_cache)
+/* Maximum number of dirty pages saved together */
+#define PAGER_WRITEBACK_BATCH	4
+/* Number of pages from the head of the list searched for dirty pages */
+#define PAGER_WRITEBACK_SCAN	(4 * PAGER_WRITEBACK_BATCH)
+
+/*
+ * Saves the dirty @victim together with other hidden and dirty pages
+ * close to the head of tee_pager_pmem_head, those are likely to be
+ * evicted soon too. Only pages with the IV in the same page as the IV of
+ * @victim are included so one call to make_iv_available() covers the
+ * whole batch. The other pages remain resident but clean, a following
+ * write to one of them is caught as usual when it's unhidden read-only.
+ *
+ * make_iv_available() has the same requirements on pager_spare_pmem here
+ * as when called directly.
+ */
+static void pager_writeback(struct tee_pager_pmem *victim)
+{
+	struct tee_pager_pmem *pmems[PAGER_WRITEBACK_BATCH] = { };
+	unsigned int pgidx[PAGER_WRITEBACK_BATCH] = { };
+	struct fobj *fobjs[PAGER_WRITEBACK_BATCH] = { };
+	const void *va[PAGER_WRITEBACK_BATCH] = { };
+	uint64_t begin = writeback_begin();
+	struct tee_pager_pmem *pmem = NULL;
+	vaddr_t iv_va = 0;
+	size_t scanned = 0;
+	size_t num = 0;
+	size_t n = 0;
+
+	make_iv_available(victim->fobj, victim->fobj_pgidx,
+			  true /*writable*/);
+
+	iv_va = fobj_get_iv_vaddr(victim->fobj, victim->fobj_pgidx) &
+		~SMALL_PAGE_MASK;
+	pmems[num++] = victim;
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		if (num == PAGER_WRITEBACK_BATCH ||
+		    scanned++ == PAGER_WRITEBACK_SCAN)
+			break;
+		if (pmem == victim || !pmem->fobj || !pmem_is_hidden(pmem) ||
+		    !pmem_is_dirty(pmem))
+			continue;
+		if ((fobj_get_iv_vaddr(pmem->fobj, pmem->fobj_pgidx) &
+		     ~SMALL_PAGE_MASK) != iv_va)
+			continue;
+		pmems[num++] = pmem;
+	}
+
+	for (n = 0; n < num; n++) {
+		fobjs[n] = pmems[n]->fobj;
+		pgidx[n] = pmems[n]->fobj_pgidx;
+		va[n] = pmems[n]->va_alias;
+		asan_tag_access(va[n], (uint8_t *)va[n] + SMALL_PAGE_SIZE);
+	}
+	if (fobj_save_pages(fobjs, pgidx, va, num))
+		panic("fobj_save_pages");
+	for (n = 0; n < num; n++)
+		asan_tag_no_access(va[n], (uint8_t *)va[n] + SMALL_PAGE_SIZE);
+
+	/* The victim is cleared by the caller */
+	for (n = 1; n < num; n++)
+		pmems[n]->flags &= ~PMEM_FLAG_DIRTY;
+
+	writeback_end(begin, num - 1);
+}
+
+/*
+ * Returns a pmem assigned to @page_va in @reg to load code and data into,
+ * also makes sure the corresponding IV page is available. The pmem isn't
+ * in any list until it's deployed with pager_deploy_page().
+ *
+ * Returns NULL if the page was mapped as a side effect of making an IV
+ * available.
+ */
+static struct tee_pager_pmem *pager_acquire_pmem(struct vm_paged_region *reg,
+						 struct abort_info *ai,
+						 vaddr_t page_va)
 {
-	vaddr_t page_va = ai->va & ~SMALL_PAGE_MASK;
 	struct tblidx tblidx = region_va2tblidx(reg, page_va);
 	struct tee_pager_pmem *pmem = NULL;
-	bool writable = false;
 	uint32_t attr = 0;
 
-	/*
-	 * Get a pmem to load code and data into, also make sure
-	 * the corresponding IV page is available.
-	 */
 	while (true) {
-		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		pmem = pager_select_victim();
 		if (!pmem) {
 			EMSG("No pmem entries");
 			abort_print(ai);
@@ -1567,18 +1870,11 @@ static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
 		}
 
 		if (pmem->fobj) {
+			note_eviction(pmem->fobj, pmem->fobj_pgidx,
+				      pmem_is_dirty(pmem));
 			pmem_unmap(pmem, NULL);
 			if (pmem_is_dirty(pmem)) {
-				uint8_t *va = pmem->va_alias;
-
-				make_iv_available(pmem->fobj, pmem->fobj_pgidx,
-						  true /*writable*/);
-				asan_tag_access(va, va + SMALL_PAGE_SIZE);
-				if (fobj_save_page(pmem->fobj, pmem->fobj_pgidx,
-						   pmem->va_alias))
-					panic("fobj_save_page");
-				asan_tag_no_access(va, va + SMALL_PAGE_SIZE);
-
+				pager_writeback(pmem);
 				pmem_clear(pmem);
 
 				/*
@@ -1604,7 +1900,7 @@ static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
 				 */
 				tblidx_get_entry(tblidx, NULL, &attr);
 				if (attr & TEE_MATTR_VALID_BLOCK)
-					return;
+					return NULL;
 
 				/*
 				 * The freed pmem was used to replace the
@@ -1636,6 +1932,20 @@ static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
 		pager_spare_pmem = pmem;
 	}
 
+	return pmem;
+}
+
+static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
+			   vaddr_t page_va, bool write_fault,
+			   bool clean_user_cache)
+{
+	struct tee_pager_pmem *pmem = NULL;
+	bool writable = false;
+
+	pmem = pager_acquire_pmem(reg, ai, page_va);
+	if (!pmem)
+		return;
+
 	/*
 	 * PAGED_REGION_TYPE_LOCK are always writable while PAGED_REGION_TYPE_RO
 	 * are never writable.
@@ -1645,12 +1955,128 @@ static void pager_get_page(struct vm_paged_region *reg, struct abort_info *ai,
 	 * as dirty.
 	 */
 	if (reg->type == PAGED_REGION_TYPE_LOCK ||
-	    (reg->type == PAGED_REGION_TYPE_RW && abort_is_write_fault(ai)))
+	    (reg->type == PAGED_REGION_TYPE_RW && write_fault))
 		writable = true;
 	else
 		writable = false;
 
-	pager_deploy_page(pmem, reg, page_va, clean_user_cache, writable);
+	note_load(pmem->fobj, pmem->fobj_pgidx);
+	pager_deploy_page(pmem, reg, page_va, clean_user_cache, writable,
+			  false /*!loaded*/);
+}
+
+/* Maximum number of pages passed to fobj_load_pages() at a time */
+#define PAGER_LOAD_BATCH	4
+
+/*
+ * Loads the @num consecutive pages starting at @page_va in @reg with one
+ * call to fobj_load_pages() to let the fobj verify the pages in parallel.
+ * The pages are mapped read-only.
+ *
+ * Only used for fobjs without IVs since an IV page could be evicted
+ * while acquiring the following pmems.
+ */
+static void pager_load_pages(struct vm_paged_region *reg,
+			     struct abort_info *ai, vaddr_t page_va,
+			     size_t num, bool clean_user_cache)
+{
+	struct tee_pager_pmem *pmems[PAGER_LOAD_BATCH] = { };
+	void *va_alias[PAGER_LOAD_BATCH] = { };
+	struct tee_pager_pmem *pmem = NULL;
+	unsigned int idx_alias = 0;
+	uint32_t attr_alias = 0;
+	paddr_t pa_alias = 0;
+	uint8_t *va = NULL;
+	size_t n = 0;
+
+	assert(num <= PAGER_LOAD_BATCH);
+
+	for (n = 0; n < num; n++) {
+		pmem = pager_acquire_pmem(reg, ai,
+					  page_va + n * SMALL_PAGE_SIZE);
+		if (!pmem)
+			break;
+		pmem_alias_make_writable(pmem, &idx_alias, &pa_alias,
+					 &attr_alias);
+		va = pmem->va_alias;
+		asan_tag_access(va, va + SMALL_PAGE_SIZE);
+		pmems[n] = pmem;
+		va_alias[n] = va;
+	}
+	num = n;
+	if (!num)
+		return;
+
+	if (fobj_load_pages(reg->fobj, pmems[0]->fobj_pgidx, num, va_alias)) {
+		EMSG("PH 0x%" PRIxVA " (%zu pages) failed", page_va, num);
+		panic();
+	}
+
+	for (n = 0; n < num; n++) {
+		note_load(pmems[n]->fobj, pmems[n]->fobj_pgidx);
+		pager_deploy_page(pmems[n], reg, page_va + n * SMALL_PAGE_SIZE,
+				  clean_user_cache, false /*!writable*/,
+				  true /*loaded*/);
+	}
+}
+
+/*
+ * If @page_va follows right after the previous fault in @reg, load up to
+ * CFG_CORE_PAGER_FAULT_AROUND of the following pages too so a sequential
+ * scan of the region doesn't take one abort per page. The pages are
+ * mapped read-only, just as if they were faulted in by a read access.
+ * If the fobj supports it the pages are loaded and verified in batches.
+ */
+static void pager_fault_around(struct vm_paged_region *reg,
+			       struct abort_info *ai, vaddr_t page_va,
+			       bool clean_user_cache)
+{
+	size_t max_pages = MIN(CFG_CORE_PAGER_FAULT_AROUND,
+			       tee_pager_npages / 4);
+	vaddr_t end_va = reg->base + reg->size;
+	vaddr_t va = page_va + SMALL_PAGE_SIZE;
+	bool sequential = page_va == reg->fault_next_va;
+	vaddr_t batch_va = 0;
+	size_t num = 0;
+	size_t n = 0;
+
+	reg->fault_next_va = va;
+
+	/* Locked pages are never released, don't use up any extra */
+	if (!sequential || reg->type == PAGED_REGION_TYPE_LOCK)
+		return;
+
+	for (n = 0; n < max_pages && va < end_va; n++) {
+		size_t fobj_pgidx = (va - reg->base) / SMALL_PAGE_SIZE +
+				    reg->fobj_pgoffs;
+
+		/* Stop at pages already present or without a table */
+		if (reg->fobj->pmems[fobj_pgidx] ||
+		    !region_va2tblidx(reg, va).pgt)
+			break;
+
+		if (reg->fobj->ops->load_pages) {
+			/* Collect pages to be loaded and verified together */
+			if (!num)
+				batch_va = va;
+			num++;
+			if (num == PAGER_LOAD_BATCH) {
+				pager_load_pages(reg, ai, batch_va, num,
+						 clean_user_cache);
+				num = 0;
+			}
+		} else {
+			pager_get_page(reg, ai, va, false /*!write_fault*/,
+				       clean_user_cache);
+		}
+		incr_prefetched();
+		va += SMALL_PAGE_SIZE;
+	}
+
+	if (num)
+		pager_load_pages(reg, ai, batch_va, num, clean_user_cache);
+
+	reg->fault_next_va = va;
 }
 
 static bool pager_update_permissions(struct vm_paged_region *reg,
@@ -1813,10 +2239,14 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 		goto out;
 	}
 
-	pager_get_page(reg, ai, clean_user_cache);
+	pager_get_page(reg, ai, page_va, abort_is_write_fault(ai),
+		       clean_user_cache);
+	if (CFG_CORE_PAGER_FAULT_AROUND)
+		pager_fault_around(reg, ai, page_va, clean_user_cache);
 
 out_success:
-	tee_pager_hide_pages();
+	if (!IS_ENABLED(CFG_CORE_PAGER_CLOCK))
+		tee_pager_hide_pages();
 	ret = true;
 out:
 	pager_unlock(exceptions);
@@ -1930,36 +2360,45 @@ void tee_pager_assign_um_tables(struct user_mode_ctx *uctx)
 	}
 }
 
-void tee_pager_pgt_save_and_release_entries(struct pgt *pgt)
+/* Unmaps all pages of @reg which are mapped using @pgt */
+static void unmap_pgt_pages(struct vm_paged_region *reg, struct pgt *pgt)
 {
+	vaddr_t b = MAX(reg->base, pgt->vabase);
+	vaddr_t e = MIN(reg->base + reg->size,
+			pgt->vabase + CORE_MMU_PGDIR_SIZE);
 	struct tee_pager_pmem *pmem = NULL;
+	vaddr_t va = 0;
+
+	for (va = b; va < e; va += SMALL_PAGE_SIZE) {
+		pmem = reg->fobj->pmems[(va - reg->base) / SMALL_PAGE_SIZE +
+					reg->fobj_pgoffs];
+		if (pmem)
+			pmem_unmap(pmem, pgt);
+	}
+}
+
+void tee_pager_pgt_save_and_release_entries(struct pgt *pgt)
+{
 	struct vm_paged_region *reg = NULL;
 	struct vm_paged_region_head *regions = NULL;
 	uint32_t exceptions = pager_lock_check_stack(SMALL_PAGE_SIZE);
 	size_t n = 0;
 
-	if (!pgt->num_used_entries)
-		goto out;
-
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		if (pmem->fobj)
-			pmem_unmap(pmem, pgt);
-	}
-	assert(!pgt->num_used_entries);
-
-out:
 	regions = to_user_mode_ctx(pgt->ctx)->regions;
 	if (regions) {
 		TAILQ_FOREACH(reg, regions, link) {
 			for (n = 0; n < get_pgt_count(reg->base, reg->size);
 			     n++) {
 				if (reg->pgt_array[n] == pgt) {
+					if (pgt->num_used_entries)
+						unmap_pgt_pages(reg, pgt);
 					reg->pgt_array[n] = NULL;
 					break;
 				}
 			}
 		}
 	}
+	assert(!pgt->num_used_entries);
 
 	pager_unlock(exceptions);
 }
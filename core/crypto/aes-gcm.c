@@ -66,21 +66,16 @@ static void ghash_update_lengths(struct internal_aes_gcm_state *state,
 	internal_aes_gcm_ghash_update(state, (uint8_t *)len_fields, NULL, 0);
 }
 
-static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
-			     const struct internal_aes_gcm_key *ek,
-			     TEE_OperationMode mode, const void *nonce,
-			     size_t nonce_len, size_t tag_len)
+/*
+ * Initializes the counter and the pre-encrypted blocks of @state for a
+ * new message, @state is expected to be cleared except for the GHASH key
+ * and the tag length.
+ */
+static TEE_Result __gcm_init_nonce(struct internal_aes_gcm_state *state,
+				   const struct internal_aes_gcm_key *ek,
+				   TEE_OperationMode mode, const void *nonce,
+				   size_t nonce_len)
 {
-	COMPILE_TIME_ASSERT(sizeof(state->ctr) == TEE_AES_BLOCK_SIZE);
-
-	if (tag_len > sizeof(state->buf_tag))
-		return TEE_ERROR_BAD_PARAMETERS;
-
-	memset(state, 0, sizeof(*state));
-
-	state->tag_len = tag_len;
-	internal_aes_gcm_set_key(state, ek);
-
 	if (nonce_len == (96 / 8)) {
 		memcpy(state->ctr, nonce, nonce_len);
 		internal_aes_gcm_inc_ctr(state);
@@ -121,6 +116,24 @@ static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
 	return TEE_SUCCESS;
 }
 
+static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
+			     const struct internal_aes_gcm_key *ek,
+			     TEE_OperationMode mode, const void *nonce,
+			     size_t nonce_len, size_t tag_len)
+{
+	COMPILE_TIME_ASSERT(sizeof(state->ctr) == TEE_AES_BLOCK_SIZE);
+
+	if (tag_len > sizeof(state->buf_tag))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	memset(state, 0, sizeof(*state));
+
+	state->tag_len = tag_len;
+	internal_aes_gcm_set_key(state, ek);
+
+	return __gcm_init_nonce(state, ek, mode, nonce, nonce_len);
+}
+
 TEE_Result internal_aes_gcm_init(struct internal_aes_gcm_ctx *ctx,
 				 TEE_OperationMode mode, const void *key,
 				 size_t key_len, const void *nonce,
@@ -413,6 +426,54 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 	return __gcm_dec_final(&state, enc_key, src, len, dst, tag, tag_len);
 }
 
+/* Clears @state for a new message, keeping the GHASH key */
+static void __gcm_reset(struct internal_aes_gcm_state *state, size_t tag_len)
+{
+	memset(state->ctr, 0, sizeof(state->ctr));
+	memset(state->hash_state, 0, sizeof(state->hash_state));
+	memset(state->buf_tag, 0, sizeof(state->buf_tag));
+	memset(state->buf_hash, 0, sizeof(state->buf_hash));
+	memset(state->buf_cryp, 0, sizeof(state->buf_cryp));
+	state->tag_len = tag_len;
+	state->aad_bytes = 0;
+	state->payload_bytes = 0;
+	state->buf_pos = 0;
+}
+
+TEE_Result
+internal_aes_gcm_enc_multi(const struct internal_aes_gcm_key *enc_key,
+			   const struct internal_aes_gcm_buf *bufs, size_t num,
+			   size_t nonce_len, size_t len, size_t tag_len)
+{
+	struct internal_aes_gcm_state state = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t tl = 0;
+	size_t n = 0;
+
+	for (n = 0; n < num; n++) {
+		if (!n) {
+			res = __gcm_init(&state, enc_key, TEE_MODE_ENCRYPT,
+					 bufs[n].nonce, nonce_len, tag_len);
+		} else {
+			/* The GHASH key only depends on the AES key */
+			__gcm_reset(&state, tag_len);
+			res = __gcm_init_nonce(&state, enc_key,
+					       TEE_MODE_ENCRYPT, bufs[n].nonce,
+					       nonce_len);
+		}
+		if (res)
+			return res;
+
+		tl = tag_len;
+		res = __gcm_enc_final(&state, enc_key, bufs[n].src, len,
+				      bufs[n].dst, bufs[n].tag, &tl);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 
 #ifndef CFG_CRYPTO_AES_GCM_FROM_CRYPTOLIB
 #include <stdlib.h>
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2024, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <crypto/crypto_accel.h>
+#include <io.h>
+#include <string.h>
+#include <string_ext.h>
+#include <tee_api_defines.h>
+#include <utee_defines.h>
+
+#ifdef CFG_CORE_CRYPTO_SHA256_ACCEL
+#define SHA256_BLOCK_SIZE	64
+#define SHA256_STATE_WORDS	8
+
+static const uint32_t sha256_iv[SHA256_STATE_WORDS] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/*
+ * Copies the trailing partial block of the @size bytes at @data into
+ * @blocks and appends the SHA-256 padding. Returns the number of blocks,
+ * one or two, to compress.
+ */
+static unsigned int sha256_pad(uint8_t blocks[2 * SHA256_BLOCK_SIZE],
+			       const uint8_t *data, size_t size)
+{
+	size_t tail = size % SHA256_BLOCK_SIZE;
+	unsigned int count = 1;
+
+	if (tail >= SHA256_BLOCK_SIZE - sizeof(uint64_t))
+		count = 2;
+
+	memset(blocks, 0, count * SHA256_BLOCK_SIZE);
+	memcpy(blocks, data + size - tail, tail);
+	blocks[tail] = 0x80;
+	put_be64(blocks + count * SHA256_BLOCK_SIZE - sizeof(uint64_t),
+		 (uint64_t)size * 8);
+
+	return count;
+}
+
+static bool sha256_state_matches(const uint32_t state[SHA256_STATE_WORDS],
+				 const uint8_t *hash)
+{
+	uint8_t digest[TEE_SHA256_HASH_SIZE] = { };
+	size_t n = 0;
+
+	for (n = 0; n < SHA256_STATE_WORDS; n++)
+		put_be32(digest + n * sizeof(uint32_t), state[n]);
+
+	return !consttime_memcmp(digest, hash, sizeof(digest));
+}
+
+TEE_Result hash_sha256_check_multi(const uint8_t * const *hashes,
+				   const uint8_t * const *data,
+				   size_t data_size, size_t num)
+{
+	unsigned int nblocks = data_size / SHA256_BLOCK_SIZE;
+	uint32_t state_a[SHA256_STATE_WORDS] = { };
+	uint32_t state_b[SHA256_STATE_WORDS] = { };
+	uint8_t pad_a[2 * SHA256_BLOCK_SIZE] = { };
+	uint8_t pad_b[2 * SHA256_BLOCK_SIZE] = { };
+	unsigned int npad = 0;
+	bool ok = true;
+	size_t n = 0;
+
+	/* Two buffers at a time to keep both SHA-256 pipelines busy */
+	for (n = 0; n + 1 < num; n += 2) {
+		memcpy(state_a, sha256_iv, sizeof(state_a));
+		memcpy(state_b, sha256_iv, sizeof(state_b));
+		if (nblocks)
+			crypto_accel_sha256_compress_x2(state_a, state_b,
+							data[n], data[n + 1],
+							nblocks);
+		npad = sha256_pad(pad_a, data[n], data_size);
+		sha256_pad(pad_b, data[n + 1], data_size);
+		crypto_accel_sha256_compress_x2(state_a, state_b, pad_a, pad_b,
+						npad);
+		ok &= sha256_state_matches(state_a, hashes[n]);
+		ok &= sha256_state_matches(state_b, hashes[n + 1]);
+	}
+
+	if (n < num) {
+		memcpy(state_a, sha256_iv, sizeof(state_a));
+		if (nblocks)
+			crypto_accel_sha256_compress(state_a, data[n], nblocks);
+		npad = sha256_pad(pad_a, data[n], data_size);
+		crypto_accel_sha256_compress(state_a, pad_a, npad);
+		ok &= sha256_state_matches(state_a, hashes[n]);
+	}
+
+	if (!ok)
+		return TEE_ERROR_SECURITY;
+	return TEE_SUCCESS;
+}
+#else
+TEE_Result hash_sha256_check_multi(const uint8_t * const *hashes,
+				   const uint8_t * const *data,
+				   size_t data_size, size_t num)
+{
+	TEE_Result ret = TEE_SUCCESS;
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	for (n = 0; n < num; n++) {
+		res = hash_sha256_check(hashes[n], data[n], data_size);
+		if (res == TEE_ERROR_SECURITY)
+			ret = res;
+		else if (res)
+			return res;
+	}
+
+	return ret;
+}
+#endif
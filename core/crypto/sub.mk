@@ -1,4 +1,5 @@
 srcs-y += crypto.c
+srcs-$(CFG_CRYPTO_SHA256) += sha256-multi.c
 
 ifeq (y-y,$(CFG_CRYPTO_AES)-$(CFG_CRYPTO_GCM))
 srcs-y += aes-gcm.c
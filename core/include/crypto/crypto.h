@@ -283,6 +283,19 @@ TEE_Result crypto_acipher_sm2_kep_derive(struct ecc_keypair *my_key,
 TEE_Result hash_sha256_check(const uint8_t *hash, const uint8_t *data,
 		size_t data_size);
 
+/*
+ * Verifies @num SHA-256 hashes at once, @hashes[n] is the expected digest
+ * of the @data_size bytes at @data[n]. Has the same properties as
+ * hash_sha256_check() but lets an accelerated implementation hash several
+ * buffers in parallel.
+ *
+ * Returns TEE_ERROR_SECURITY if any of the hashes doesn't match, the
+ * caller has to check the buffers one by one to tell which.
+ */
+TEE_Result hash_sha256_check_multi(const uint8_t * const *hashes,
+				   const uint8_t * const *data,
+				   size_t data_size, size_t num);
+
 /*
  * Computes a SHA-512/256 hash, vetted conditioner as per NIST.SP.800-90B.
  * It doesn't require crypto_init() to be called in advance and has as few
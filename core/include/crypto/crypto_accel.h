@@ -44,4 +44,13 @@ void crypto_accel_sha1_compress(uint32_t state[5], const void *src,
 				unsigned int block_count);
 void crypto_accel_sha256_compress(uint32_t state[8], const void *src,
 				  unsigned int block_count);
+/*
+ * Compresses @block_count blocks of @src_a into @state_a and of @src_b
+ * into @state_b. The two independent streams are interleaved where the
+ * architecture allows it.
+ */
+void crypto_accel_sha256_compress_x2(uint32_t state_a[8],
+				     uint32_t state_b[8],
+				     const void *src_a, const void *src_b,
+				     unsigned int block_count);
 #endif /*__CRYPTO_CRYPTO_ACCEL_H*/
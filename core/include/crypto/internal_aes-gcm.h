@@ -84,6 +84,22 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 				const void *src, size_t len, void *dst,
 				const void *tag, size_t tag_len);
 
+struct internal_aes_gcm_buf {
+	const void *nonce;
+	const void *src;
+	void *dst;
+	void *tag;
+};
+
+/*
+ * Encrypts @num independent messages of @len bytes without AAD using the
+ * same key. The GHASH key is only derived once for the whole batch.
+ */
+TEE_Result
+internal_aes_gcm_enc_multi(const struct internal_aes_gcm_key *enc_key,
+			   const struct internal_aes_gcm_buf *bufs, size_t num,
+			   size_t nonce_len, size_t len, size_t tag_len);
+
 void internal_aes_gcm_gfmul(const uint64_t X[2], const uint64_t Y[2],
 			    uint64_t product[2]);
 
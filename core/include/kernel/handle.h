@@ -7,14 +7,32 @@
 #define KERNEL_HANDLE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/*
+ * A handle is made of a slot index in the low HANDLE_DB_INDEX_BITS bits
+ * and a generation counter of the slot in the bits above. The generation
+ * is increased each time the slot is released so a stale handle isn't
+ * accepted once its slot is reused.
+ */
+#define HANDLE_DB_INDEX_BITS	20
+#define HANDLE_DB_GEN_BITS	11
+
+struct handle_db_slot {
+	void *ptr;
+	uint32_t gen;
+	uint32_t next_free;	/* Index + 1 of next free slot, 0 at end */
+};
+
 struct handle_db {
-	void **ptrs;
+	struct handle_db_slot *slots;
 	size_t max_ptrs;
+	size_t num_ptrs;
+	uint32_t first_free;	/* Index + 1 of first free slot, 0 if none */
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, 0, 0, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -73,11 +73,19 @@ struct tee_ta_ctx {
 	uint32_t panic_code;	/* Code supplied for panic */
 	uint32_t ref_count;	/* Reference counter for multi session TA */
 	bool busy;		/* Context is busy and cannot be entered */
+	struct mutex busy_mutex; /* Protects @busy */
 	struct condvar busy_cv;	/* CV used when context is busy */
 };
 
+/*
+ * The fields @ref_count, @lock_thread and @unlink are protected by the
+ * mutex of the session hash bucket the session is linked in, not by
+ * tee_ta_mutex.
+ */
 struct tee_ta_session {
 	TAILQ_ENTRY(tee_ta_session) link;
+	SLIST_ENTRY(tee_ta_session) hash_link; /* Link in session hash bucket */
+	struct tee_ta_session_head *open_sessions; /* List holding session */
 	struct ts_session ts_sess;
 	uint32_t id;		/* Session handle (0 is invalid) */
 	TEE_Identity clnt_id;	/* Identify of client */
@@ -13,6 +13,7 @@
 #include <mm/file.h>
 #include <mm/tee_mm.h>
 #include <scattered_array.h>
+#include <tee/tee_handle_table.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
 #include <util.h>
@@ -28,6 +29,8 @@ SLIST_HEAD(load_seg_head, load_seg);
  * @cryp_states:	List of cryp states created by this TA
  * @objects:		List of storage objects opened by this TA
  * @storage_enums:	List of storage enumerators opened by this TA
+ * @handles:		Handle table of the cryp states, objects and storage
+ *			enumerators above
  * @ta_time_offs:	Time reference used by the TA
  * @uctx:		Generic user mode context
  * @ctx:		Generic TA context
@@ -37,6 +40,7 @@ struct user_ta_ctx {
 	struct tee_cryp_state_head cryp_states;
 	struct tee_obj_head objects;
 	struct tee_storage_enum_head storage_enums;
+	struct tee_handle_table handles;
 	void *ta_time_offs;
 	struct user_mode_ctx uctx;
 	struct tee_ta_ctx ta_ctx;
@@ -13,11 +13,16 @@
 #include <tee_api_types.h>
 #include <types_ext.h>
 
+struct tee_pager_pmem;
+
 /*
  * struct fobj - file object storage abstraction
  * @ops:	Operations pointer
  * @num_pages:	Number of pages covered
  * @refc:	Reference counter
+ * @regions:	Paged regions mapping this fobj
+ * @pmems:	Physical page holding each page of the fobj, or NULL,
+ *		indexed by page number and owned by the pager
  */
 struct fobj {
 	const struct fobj_ops *ops;
@@ -25,6 +30,7 @@ struct fobj {
 	struct refcount refc;
 #ifdef CFG_WITH_PAGER
 	struct vm_paged_region_head regions;
+	struct tee_pager_pmem **pmems;
 #endif
 };
 
@@ -32,6 +38,8 @@ struct fobj {
  * struct fobj_ops - operations struct for struct fobj
  * @free:	  Frees the @fobj
  * @load_page:	  Loads page with index @page_idx at address @va
+ * @load_pages:	  Optional, loads @num_pages consecutive pages starting
+ *		  with index @page_idx at the addresses in @va
  * @save_page:	  Saves page with index @page_idx from address @va
  * @get_iv_vaddr: Returns virtual address of tag and IV for the page at
  *		  @page_idx if tag and IV are paged for this fobj
@@ -42,6 +50,8 @@ struct fobj_ops {
 #ifdef CFG_WITH_PAGER
 	TEE_Result (*load_page)(struct fobj *fobj, unsigned int page_idx,
 				void *va);
+	TEE_Result (*load_pages)(struct fobj *fobj, unsigned int page_idx,
+				 unsigned int num_pages, void * const *va);
 	TEE_Result (*save_page)(struct fobj *fobj, unsigned int page_idx,
 				const void *va);
 	vaddr_t (*get_iv_vaddr)(struct fobj *fobj, unsigned int page_idx);
@@ -125,6 +135,39 @@ static inline TEE_Result fobj_load_page(struct fobj *fobj,
 	return TEE_ERROR_GENERIC;
 }
 
+/*
+ * fobj_load_pages() - Load a range of pages into memory
+ * @fobj:	Fobj pointer
+ * @page_index:	Index of first page in @fobj
+ * @num_pages:	Number of consecutive pages to load
+ * @va:		Array of @num_pages addresses where content should be
+ *		stored and verified
+ *
+ * Lets the fobj verify several pages in one go if supported, else the
+ * pages are loaded one by one.
+ *
+ * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ */
+static inline TEE_Result fobj_load_pages(struct fobj *fobj,
+					 unsigned int page_idx,
+					 unsigned int num_pages,
+					 void * const *va)
+{
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int n = 0;
+
+	if (!fobj)
+		return TEE_ERROR_GENERIC;
+
+	if (fobj->ops->load_pages)
+		return fobj->ops->load_pages(fobj, page_idx, num_pages, va);
+
+	for (n = 0; n < num_pages && !res; n++)
+		res = fobj->ops->load_page(fobj, page_idx + n, va[n]);
+
+	return res;
+}
+
 /*
  * fobj_save_page() - Save a page into storage
  * @fobj:	Fobj pointer
@@ -142,6 +185,22 @@ static inline TEE_Result fobj_save_page(struct fobj *fobj,
 	return TEE_ERROR_GENERIC;
 }
 
+/*
+ * fobj_save_pages() - Save several pages into storage
+ * @fobj:	Array of @num fobj pointers
+ * @page_idx:	Array of @num page indexes, one for each fobj
+ * @va:		Array of @num addresses of the pages to save
+ * @num:	Number of pages
+ *
+ * Pages of read/write paged fobjs are encrypted in batches, other pages
+ * are saved one by one with fobj_save_page().
+ *
+ * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ */
+TEE_Result fobj_save_pages(struct fobj * const *fobj,
+			   const unsigned int *page_idx,
+			   const void * const *va, size_t num);
+
 static inline vaddr_t fobj_get_iv_vaddr(struct fobj *fobj,
 					unsigned int page_idx)
 {
@@ -226,6 +226,56 @@ static inline bool mobj_check_offset_and_len(struct mobj *mobj, size_t offset,
 	       end_offs < mobj->size;
 }
 
+/*
+ * Returns the bucket of @cookie in a hash table of BIT(@shift) buckets,
+ * used by the registries of shared memory looked up by cookie. Cookies
+ * may be addresses of normal world objects, the upper bits are folded
+ * in before hashing.
+ */
+static inline size_t mobj_cookie_hash(uint64_t cookie, unsigned int shift)
+{
+	uint32_t h = (uint32_t)cookie ^ (uint32_t)(cookie >> 32);
+
+	return (h * 0x9e3779b1U) >> (32 - shift);
+}
+
+/*
+ * struct mobj_shm_lock_stats - statistics on the lock protecting the
+ * tables of shared memory looked up by cookie
+ * @count:	number of times the lock has been taken
+ * @max_ns:	longest time the lock has been held
+ * @total_ns:	accumulated time the lock has been held
+ */
+struct mobj_shm_lock_stats {
+	uint64_t count;
+	uint64_t max_ns;
+	uint64_t total_ns;
+};
+
+/*
+ * Return the hold time statistics of the lock protecting the FF-A
+ * (CFG_CORE_FFA) and the registered (CFG_CORE_DYN_SHM) shared memory
+ * tables respectively, the counters are never reset.
+ */
+#if defined(CFG_WITH_STATS) && defined(CFG_CORE_FFA)
+void mobj_ffa_get_lock_stats(struct mobj_shm_lock_stats *stats);
+#else
+static inline void mobj_ffa_get_lock_stats(struct mobj_shm_lock_stats *stats)
+{
+	*stats = (struct mobj_shm_lock_stats){ };
+}
+#endif
+
+#if defined(CFG_WITH_STATS) && defined(CFG_CORE_DYN_SHM)
+void mobj_reg_shm_get_lock_stats(struct mobj_shm_lock_stats *stats);
+#else
+static inline void
+mobj_reg_shm_get_lock_stats(struct mobj_shm_lock_stats *stats)
+{
+	*stats = (struct mobj_shm_lock_stats){ };
+}
+#endif
+
 struct mobj *mobj_mm_alloc(struct mobj *mobj_parent, size_t size,
 			   tee_mm_pool_t *pool);
 
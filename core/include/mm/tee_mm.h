@@ -16,22 +16,37 @@
 /* Flag to indicate that pool should use nex_malloc instead of malloc */
 #define TEE_MM_POOL_NEX_MALLOC             (1u << 1)
 
+/*
+ * Allocated entries are kept in a treap ordered by allocation direction,
+ * that is by increasing offset or by decreasing offset with
+ * TEE_MM_POOL_HI_ALLOC. Each entry records the free gap in front of it and
+ * the largest such gap in its subtree, which gives O(log n) allocation and
+ * lookup.
+ */
 struct _tee_mm_entry_t {
 	struct _tee_mm_pool_t *pool;
-	struct _tee_mm_entry_t *next;
+	struct _tee_mm_entry_t *parent;
+	struct _tee_mm_entry_t *left;
+	struct _tee_mm_entry_t *right;
 	uint32_t offset;	/* offset in pages/sections */
 	uint32_t size;		/* size in pages/sections */
+	uint32_t gap;		/* free pages/sections in front of entry */
+	uint32_t max_gap;	/* largest gap in this subtree */
+	uint32_t prio;		/* treap priority */
 };
 typedef struct _tee_mm_entry_t tee_mm_entry_t;
 
 struct _tee_mm_pool_t {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *root;	/* treap of allocated entries */
 	paddr_t lo;		/* low boundary of the pool */
 	paddr_size_t size;	/* pool size */
 	uint32_t flags;		/* Config flags for the pool */
+	uint32_t prio_seed;	/* state for treap priorities */
 	uint8_t shift;		/* size shift */
+	bool initialized;
 	unsigned int lock;
 #ifdef CFG_WITH_STATS
+	size_t allocated;	/* pages/sections currently allocated */
 	size_t max_allocated;
 #endif
 };
@@ -99,6 +99,7 @@ struct vm_paged_region {
 	uint32_t flags;
 	vaddr_t base;
 	size_t size;
+	vaddr_t fault_next_va;
 	struct pgt **pgt_array;
 	TAILQ_ENTRY(vm_paged_region) link;
 	TAILQ_ENTRY(vm_paged_region) fobj_link;
@@ -107,8 +108,20 @@ struct vm_paged_region {
 TAILQ_HEAD(vm_paged_region_head, vm_paged_region);
 TAILQ_HEAD(vm_region_head, vm_region);
 
+/*
+ * struct vm_info - virtual memory map of a user mode context
+ * @regions:		Regions sorted on va
+ * @region_index:	Same regions as in @regions and in the same order,
+ *			used for binary search on va
+ * @num_regions:	Number of entries in @region_index
+ * @max_regions:	Number of entries @region_index has room for
+ * @asid:		ASID assigned to the context
+ */
 struct vm_info {
 	struct vm_region_head regions;
+	struct vm_region **region_index;
+	size_t num_regions;
+	size_t max_regions;
 	unsigned int asid;
 };
 
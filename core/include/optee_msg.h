@@ -235,6 +235,39 @@ struct optee_msg_arg {
 	((OPTEE_MSG_NONCONTIG_PAGE_SIZE - sizeof(struct optee_msg_arg)) / \
 	 sizeof(struct optee_msg_param))
 
+/**
+ * struct optee_msg_ring - header of an invoke ring
+ * @num_slots:	 Number of slots following the header, a power of two
+ * @slot_size:	 Size in bytes of each slot, a multiple of 8
+ * @prod:	 Number of requests queued, written by normal world
+ * @cons:	 Number of requests completed, written by secure world
+ * @flags:	 OPTEE_MSG_RING_FLAG_*, written by secure world
+ * @notif_value: Asynchronous notification value sent by secure world
+ *		 when requests have been completed
+ *
+ * Request number n is a struct optee_msg_arg at offset
+ * sizeof(struct optee_msg_ring) + (n % @num_slots) * @slot_size, with
+ * @cmd OPTEE_MSG_CMD_INVOKE_COMMAND and as many parameters as fit in
+ * @slot_size. Requests are completed in order, @ret and @ret_origin of a
+ * request are valid once @cons has passed it.
+ *
+ * Normal world queues requests by filling in slots and then updating
+ * @prod. If OPTEE_MSG_RING_FLAG_DRAINING isn't set after @prod is
+ * updated it must issue OPTEE_MSG_CMD_DRAIN_INVOKE_RING, else the
+ * queued requests will be served by the call already draining the ring.
+ */
+struct optee_msg_ring {
+	uint32_t num_slots;
+	uint32_t slot_size;
+	uint32_t prod;
+	uint32_t cons;
+	uint32_t flags;
+	uint32_t notif_value;
+};
+
+/* Secure world is serving requests in the ring */
+#define OPTEE_MSG_RING_FLAG_DRAINING	BIT(0)
+
 #endif /*__ASSEMBLER__*/
 
 /*****************************************************************************
@@ -331,6 +364,19 @@ struct optee_msg_arg {
  * OPTEE_MSG_CMD_STOP_ASYNC_NOTIF informs secure world that from now is
  * normal world unable to process asynchronous notifications. Typically
  * used when the driver is shut down.
+ *
+ * OPTEE_MSG_CMD_REGISTER_INVOKE_RING registers a struct optee_msg_ring
+ * with @num_slots and @slot_size initialized and @prod 0. Only one ring
+ * can be registered at a time. The information is passed as:
+ * [in] param[0].attr			OPTEE_MSG_ATTR_TYPE_[RTF]MEM_INOUT
+ * [in] param[0].u.[rtf]mem		memory reference of the ring
+ *
+ * OPTEE_MSG_CMD_DRAIN_INVOKE_RING serves the requests queued in the
+ * registered ring, including those queued while the call is executing.
+ * Takes no parameters.
+ *
+ * OPTEE_MSG_CMD_UNREGISTER_INVOKE_RING unregisters the ring registered
+ * with OPTEE_MSG_CMD_REGISTER_INVOKE_RING. Takes no parameters.
  */
 #define OPTEE_MSG_CMD_OPEN_SESSION	U(0)
 #define OPTEE_MSG_CMD_INVOKE_COMMAND	U(1)
@@ -340,6 +386,9 @@ struct optee_msg_arg {
 #define OPTEE_MSG_CMD_UNREGISTER_SHM	U(5)
 #define OPTEE_MSG_CMD_DO_BOTTOM_HALF	U(6)
 #define OPTEE_MSG_CMD_STOP_ASYNC_NOTIF	U(7)
+#define OPTEE_MSG_CMD_REGISTER_INVOKE_RING	U(8)
+#define OPTEE_MSG_CMD_DRAIN_INVOKE_RING		U(9)
+#define OPTEE_MSG_CMD_UNREGISTER_INVOKE_RING	U(10)
 #define OPTEE_MSG_FUNCID_CALL_WITH_ARG	U(0x0004)
 
 #endif /* _OPTEE_MSG_H */
@@ -282,6 +282,32 @@
  */
 #define OPTEE_RPC_FS_READDIR		U(10)
 
+/*
+ * Read from a file at several offsets
+ *
+ * [in]     value[0].a	    OPTEE_RPC_FS_READV
+ * [in]     value[0].b	    File descriptor of open file
+ * [in]     value[0].c	    Number of extents in memref[2]
+ * [out]    memref[1]	    Buffer to hold returned data, the data of the
+ *			    extents is stored back to back in order
+ * [in]     memref[2]	    Array of extents, each extent is two 64-bit
+ *			    values: offset into file and length
+ */
+#define OPTEE_RPC_FS_READV		U(11)
+
+/*
+ * Write to a file at several offsets
+ *
+ * [in]     value[0].a	    OPTEE_RPC_FS_WRITEV
+ * [in]     value[0].b	    File descriptor of open file
+ * [in]     value[0].c	    Number of extents in memref[2]
+ * [in]     memref[1]	    Buffer holding data to be written, the data of
+ *			    the extents is stored back to back in order
+ * [in]     memref[2]	    Array of extents, each extent is two 64-bit
+ *			    values: offset into file and length
+ */
+#define OPTEE_RPC_FS_WRITEV		U(12)
+
 /* End of definition of protocol for command OPTEE_RPC_CMD_FS */
 
 /*
@@ -69,6 +69,12 @@ enum tee_fs_htree_type {
 	TEE_FS_HTREE_TYPE_BLOCK,
 };
 
+/*
+ * Maximum number of data blocks transferred with a single vectored RPC
+ * read or write
+ */
+#define TEE_FS_HTREE_MAX_RPC_BLOCKS	16
+
 struct tee_fs_rpc_operation;
 
 /**
@@ -79,10 +85,20 @@ struct tee_fs_rpc_operation;
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_readv_init:	optional, initialize a struct tee_fs_rpc_operation for
+ *			an RPC read of @num data blocks starting at @idx,
+ *			completed with @rpc_read_final
+ * @rpc_writev_init:	optional, initialize a struct tee_fs_rpc_operation for
+ *			an RPC write of @num data blocks starting at @idx,
+ *			completed with @rpc_write_final
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
- * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
- * memory where the encrypted data is stored.
+ * 0 or 1, for the vectored functions @vers is an array with one element per
+ * block. The @data arguments is a pointer to a buffer in non-secure shared
+ * memory where the encrypted data is stored, for the vectored functions
+ * the blocks are stored back to back. The vectored functions return
+ * TEE_ERROR_NOT_SUPPORTED if the request has to be done one block at a
+ * time instead.
  */
 struct tee_fs_htree_storage {
 	size_t block_size;
@@ -95,10 +111,27 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	TEE_Result (*rpc_readv_init)(void *aux, struct tee_fs_rpc_operation *op,
+				     size_t idx, size_t num,
+				     const uint8_t *vers, void **data);
+	TEE_Result (*rpc_writev_init)(void *aux,
+				      struct tee_fs_rpc_operation *op,
+				      size_t idx, size_t num,
+				      const uint8_t *vers, void **data);
 };
 
 struct tee_fs_htree;
 
+/**
+ * struct tee_fs_htree_stats - statistics of all hash trees
+ * @cache_hits:		data block reads served from the block cache
+ * @cache_misses:	data block reads which needed storage access
+ */
+struct tee_fs_htree_stats {
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+};
+
 /**
  * tee_fs_htree_open() - opens/creates a hash tree
  * @create:	true if a new hash tree is to be created, else the hash tree
@@ -171,4 +204,43 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht, size_t block_num,
 TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht, size_t block_num,
 				   void *block);
 
+/**
+ * tee_fs_htree_write_blocks() - encrypt and write consecutive data blocks
+ * to storage
+ * @ht:		hash tree
+ * @block_num:	number of first block
+ * @num_blocks:	number of blocks
+ * @blocks:	pointer to @num_blocks blocks of stor->block_size size
+ *
+ * Up to TEE_FS_HTREE_MAX_RPC_BLOCKS blocks are written with each RPC if
+ * supported by the storage.
+ *
+ * Frees the hash tree and sets *ht to NULL on failure and returns an error code
+ */
+TEE_Result tee_fs_htree_write_blocks(struct tee_fs_htree **ht,
+				     size_t block_num, size_t num_blocks,
+				     const void *blocks);
+/**
+ * tee_fs_htree_read_blocks() - read and decrypt consecutive data blocks
+ * from storage
+ * @ht:		hash tree
+ * @block_num:	number of first block
+ * @num_blocks:	number of blocks
+ * @blocks:	pointer to @num_blocks blocks of stor->block_size size
+ *
+ * Up to TEE_FS_HTREE_MAX_RPC_BLOCKS blocks are read with each RPC if
+ * supported by the storage.
+ *
+ * Frees the hash tree and sets *ht to NULL on failure and returns an error code
+ */
+TEE_Result tee_fs_htree_read_blocks(struct tee_fs_htree **ht,
+				    size_t block_num, size_t num_blocks,
+				    void *blocks);
+
+/**
+ * tee_fs_htree_get_stats() - get and reset statistics
+ * @stats:	returned statistics
+ */
+void tee_fs_htree_get_stats(struct tee_fs_htree_stats *stats);
+
 #endif /*__TEE_FS_HTREE_H*/
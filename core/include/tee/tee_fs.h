@@ -45,6 +45,10 @@ struct tee_file_operations {
 			     bool overwrite);
 	TEE_Result (*remove)(struct tee_pobj *po);
 	TEE_Result (*truncate)(struct tee_file_handle *fh, size_t size);
+	/* Optional, commits writes deferred by TEE_DATA_FLAG_DEFER_COMMIT */
+	TEE_Result (*sync)(struct tee_file_handle *fh);
+	/* Optional, drops writes deferred by TEE_DATA_FLAG_DEFER_COMMIT */
+	void (*discard)(struct tee_file_handle *fh);
 
 	TEE_Result (*opendir)(const TEE_UUID *uuid, struct tee_fs_dir **d);
 	TEE_Result (*readdir)(struct tee_fs_dir *d, struct tee_fs_dirent **ent);
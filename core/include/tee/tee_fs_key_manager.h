@@ -23,6 +23,26 @@ TEE_Result tee_fs_crypt_block(const TEE_UUID *uuid, uint8_t *out,
 			      uint16_t blk_idx, const uint8_t *encrypted_fek,
 			      TEE_OperationMode mode);
 
+/*
+ * Unwrapped FEK of a RPMB FS file held as the expanded AES key schedules
+ * used by tee_fs_crypt_block(), so that several blocks of the same file
+ * can be processed with a single key setup.
+ */
+struct tee_fs_fek_ctx {
+	void *essiv_ctx;
+	void *fek_ctx;
+	TEE_OperationMode mode;
+};
+
+TEE_Result tee_fs_fek_ctx_init(struct tee_fs_fek_ctx *ctx,
+			       const TEE_UUID *uuid,
+			       const uint8_t *encrypted_fek,
+			       TEE_OperationMode mode);
+TEE_Result tee_fs_fek_ctx_crypt_block(struct tee_fs_fek_ctx *ctx,
+				      uint8_t *out, const uint8_t *in,
+				      size_t size, uint16_t blk_idx);
+void tee_fs_fek_ctx_final(struct tee_fs_fek_ctx *ctx);
+
 TEE_Result tee_fs_fek_crypt(const TEE_UUID *uuid, TEE_OperationMode mode,
 			    const uint8_t *in_key, size_t size,
 			    uint8_t *out_key);
@@ -22,6 +22,12 @@ struct tee_fs_rpc_operation {
 	size_t num_params;
 };
 
+/* An extent of a vectored read or write, see OPTEE_RPC_FS_READV */
+struct tee_fs_rpc_extent {
+	uint64_t offs;
+	uint64_t len;
+};
+
 struct tee_fs_dirfile_fileh;
 
 TEE_Result tee_fs_rpc_open_dfh(uint32_t id,
@@ -42,6 +48,25 @@ TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op,
 				 size_t data_len, void **data);
 TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op);
 
+/*
+ * Vectored versions of tee_fs_rpc_read_init() and tee_fs_rpc_write_init(),
+ * @data is a buffer holding the data of all the @num_ext extents in
+ * @ext back to back. Completed with tee_fs_rpc_read_final() and
+ * tee_fs_rpc_write_final() respectively.
+ *
+ * Returns TEE_ERROR_NOT_SUPPORTED, also from the final functions, if
+ * tee-supplicant doesn't support vectored requests. The caller is
+ * expected to fall back to one request per extent in that case.
+ */
+TEE_Result tee_fs_rpc_readv_init(struct tee_fs_rpc_operation *op,
+				 uint32_t id, int fd,
+				 const struct tee_fs_rpc_extent *ext,
+				 size_t num_ext, void **out_data);
+TEE_Result tee_fs_rpc_writev_init(struct tee_fs_rpc_operation *op,
+				  uint32_t id, int fd,
+				  const struct tee_fs_rpc_extent *ext,
+				  size_t num_ext, void **data);
+
 
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len);
 TEE_Result tee_fs_rpc_remove_dfh(uint32_t id,
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+#ifndef __TEE_TEE_HANDLE_TABLE_H
+#define __TEE_TEE_HANDLE_TABLE_H
+
+#include <sys/queue.h>
+#include <types_ext.h>
+#include <util.h>
+
+/*
+ * Objects, cryp states and storage enumerators of a user TA are identified
+ * towards the TA by their kernel address. The handle table is a hash table
+ * indexed on that address so that handles passed in system calls are
+ * validated and looked up in constant time instead of by walking the
+ * lists in struct user_ta_ctx.
+ */
+
+enum tee_handle_type {
+	TEE_HANDLE_TYPE_OBJ,
+	TEE_HANDLE_TYPE_CRYP_STATE,
+	TEE_HANDLE_TYPE_STORAGE_ENUM,
+};
+
+/*
+ * struct tee_handle_node - embedded in each object in a handle table
+ * @link:	Link in the hash bucket
+ * @id:		Handle value, the kernel address of the containing object
+ * @type:	Type of the containing object
+ */
+struct tee_handle_node {
+	SLIST_ENTRY(tee_handle_node) link;
+	vaddr_t id;
+	enum tee_handle_type type;
+};
+
+SLIST_HEAD(tee_handle_bucket, tee_handle_node);
+
+#define TEE_HANDLE_TABLE_MIN_SHIFT	4
+
+/*
+ * struct tee_handle_table - hash table of handles
+ * @buckets:		Array of 1 << @shift buckets
+ * @shift:		Log2 of number of buckets
+ * @num_nodes:		Number of handles in the table
+ * @min_buckets:	Initial buckets, used until the table has grown
+ */
+struct tee_handle_table {
+	struct tee_handle_bucket *buckets;
+	unsigned int shift;
+	size_t num_nodes;
+	struct tee_handle_bucket min_buckets[BIT(TEE_HANDLE_TABLE_MIN_SHIFT)];
+};
+
+void tee_handle_table_init(struct tee_handle_table *table);
+void tee_handle_table_final(struct tee_handle_table *table);
+
+/*
+ * Adds @node identified by @id. This never fails, if growing the table
+ * fails the buckets will just be longer than needed.
+ */
+void tee_handle_table_add(struct tee_handle_table *table,
+			  struct tee_handle_node *node, vaddr_t id,
+			  enum tee_handle_type type);
+void tee_handle_table_remove(struct tee_handle_table *table,
+			     struct tee_handle_node *node);
+/* Returns the node matching both @id and @type or NULL */
+struct tee_handle_node *tee_handle_table_find(struct tee_handle_table *table,
+					      vaddr_t id,
+					      enum tee_handle_type type);
+
+#endif /*__TEE_TEE_HANDLE_TABLE_H*/
@@ -8,6 +8,7 @@
 
 #include <kernel/tee_ta_manager.h>
 #include <sys/queue.h>
+#include <tee/tee_handle_table.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
 
@@ -15,6 +16,7 @@
 
 struct tee_obj {
 	TAILQ_ENTRY(tee_obj) link;
+	struct tee_handle_node handle;
 	TEE_ObjectInfo info;
 	bool busy;		/* true if used by an operation */
 	uint32_t have_attrs;	/* bitfield identifying set properties */
@@ -53,6 +53,8 @@ TEE_Result syscall_storage_obj_write(unsigned long obj, void *data,
 
 TEE_Result syscall_storage_obj_trunc(unsigned long obj, size_t len);
 
+TEE_Result syscall_storage_obj_sync(unsigned long obj);
+
 TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 				    unsigned long whence);
 
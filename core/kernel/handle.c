@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
+#include <util.h>
 
 /*
  * Define the initial capacity of the database. It should be a low number
@@ -15,6 +16,9 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+#define HANDLE_DB_MAX_PTRS		BIT(HANDLE_DB_INDEX_BITS)
+#define HANDLE_DB_GEN_MASK		(BIT(HANDLE_DB_GEN_BITS) - 1)
+
 void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 {
 	if (db) {
@@ -22,79 +26,117 @@ void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 			size_t n = 0;
 
 			for (n = 0; n < db->max_ptrs; n++)
-				if (db->ptrs[n])
-					ptr_destructor(db->ptrs[n]);
+				if (db->slots[n].ptr)
+					ptr_destructor(db->slots[n].ptr);
 		}
-		free(db->ptrs);
-		db->ptrs = NULL;
+		free(db->slots);
+		db->slots = NULL;
 		db->max_ptrs = 0;
+		db->num_ptrs = 0;
+		db->first_free = 0;
 	}
 }
 
 bool handle_db_is_empty(struct handle_db *db)
 {
+	return !db || !db->num_ptrs;
+}
+
+static bool grow_db(struct handle_db *db)
+{
+	size_t new_max_ptrs = 0;
+	void *p = NULL;
 	size_t n = 0;
 
-	if (db) {
-		for (n = 0; n < db->max_ptrs; n++) {
-			if (db->ptrs[n])
-				return false;
-		}
+	if (db->max_ptrs)
+		new_max_ptrs = db->max_ptrs * 2;
+	else
+		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max_ptrs > HANDLE_DB_MAX_PTRS)
+		return false;
+
+	p = realloc(db->slots, new_max_ptrs * sizeof(*db->slots));
+	if (!p)
+		return false;
+	db->slots = p;
+	memset(db->slots + db->max_ptrs, 0,
+	       (new_max_ptrs - db->max_ptrs) * sizeof(*db->slots));
+
+	/* Chain the new slots so the lowest index is used first */
+	for (n = new_max_ptrs; n > db->max_ptrs; n--) {
+		db->slots[n - 1].next_free = db->first_free;
+		db->first_free = n;
 	}
+	db->max_ptrs = new_max_ptrs;
+
 	return true;
 }
 
+static struct handle_db_slot *find_slot(struct handle_db *db, int handle)
+{
+	struct handle_db_slot *slot = NULL;
+	size_t idx = 0;
+
+	if (!db || handle < 0)
+		return NULL;
+
+	idx = handle & (HANDLE_DB_MAX_PTRS - 1);
+	if (idx >= db->max_ptrs)
+		return NULL;
+
+	slot = db->slots + idx;
+	if (!slot->ptr ||
+	    slot->gen != ((uint32_t)handle >> HANDLE_DB_INDEX_BITS))
+		return NULL;
+
+	return slot;
+}
+
 int handle_get(struct handle_db *db, void *ptr)
 {
-	size_t n;
-	void *p;
-	size_t new_max_ptrs;
+	struct handle_db_slot *slot = NULL;
+	size_t idx = 0;
 
 	if (!db || !ptr)
 		return -1;
 
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
-
-	/* No location available, grow the ptrs array */
-	if (db->max_ptrs)
-		new_max_ptrs = db->max_ptrs * 2;
-	else
-		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
+	if (!db->first_free && !grow_db(db))
 		return -1;
-	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
-	db->max_ptrs = new_max_ptrs;
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
-	db->ptrs[n] = ptr;
-	return n;
+	idx = db->first_free - 1;
+	slot = db->slots + idx;
+	db->first_free = slot->next_free;
+	slot->next_free = 0;
+	slot->ptr = ptr;
+	db->num_ptrs++;
+
+	return (slot->gen << HANDLE_DB_INDEX_BITS) | idx;
 }
 
 void *handle_put(struct handle_db *db, int handle)
 {
-	void *p;
+	struct handle_db_slot *slot = find_slot(db, handle);
+	void *p = NULL;
 
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!slot)
 		return NULL;
 
-	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	p = slot->ptr;
+	slot->ptr = NULL;
+	slot->gen = (slot->gen + 1) & HANDLE_DB_GEN_MASK;
+	slot->next_free = db->first_free;
+	db->first_free = slot - db->slots + 1;
+	db->num_ptrs--;
+
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, int handle)
 {
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	struct handle_db_slot *slot = find_slot(db, handle);
+
+	if (!slot)
 		return NULL;
 
-	return db->ptrs[handle];
+	return slot->ptr;
 }
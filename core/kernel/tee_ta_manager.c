@@ -41,6 +41,24 @@ struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
 struct condvar tee_ta_init_cv = CONDVAR_INITIALIZER;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+/*
+ * All open sessions are, in addition to their open_sessions list, linked
+ * in a hash table on the session id and list. Session lookups at each
+ * invoke are done in the hash table under the mutex of the bucket only,
+ * which also protects the ref_count, lock_thread and unlink fields of the
+ * sessions in the bucket. The lists are still protected by tee_ta_mutex.
+ *
+ * Lock order: tee_ta_mutex before a bucket mutex.
+ */
+struct sess_bucket {
+	struct mutex mu;
+	SLIST_HEAD(, tee_ta_session) sessions;
+};
+
+static struct sess_bucket sess_buckets[CFG_TA_SESSION_HASH_BUCKETS] = {
+	[0 ... CFG_TA_SESSION_HASH_BUCKETS - 1] = { .mu = MUTEX_INITIALIZER },
+};
+
 #ifndef CFG_CONCURRENT_SINGLE_INSTANCE_TA
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static short int tee_ta_single_instance_thread = THREAD_ID_INVALID;
@@ -63,7 +81,8 @@ static bool has_single_instance_lock(void)
 #else
 static void lock_single_instance(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	mutex_lock(&tee_ta_mutex);
+
 	if (tee_ta_single_instance_thread != thread_get_id()) {
 		/* Wait until the single-instance lock is available. */
 		while (tee_ta_single_instance_thread != THREAD_ID_INVALID)
@@ -74,11 +93,14 @@ static void lock_single_instance(void)
 	}
 
 	tee_ta_single_instance_count++;
+
+	mutex_unlock(&tee_ta_mutex);
 }
 
 static void unlock_single_instance(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	mutex_lock(&tee_ta_mutex);
+
 	assert(tee_ta_single_instance_thread == thread_get_id());
 	assert(tee_ta_single_instance_count > 0);
 
@@ -87,11 +109,17 @@ static void unlock_single_instance(void)
 		tee_ta_single_instance_thread = THREAD_ID_INVALID;
 		condvar_signal(&tee_ta_cv);
 	}
+
+	mutex_unlock(&tee_ta_mutex);
 }
 
 static bool has_single_instance_lock(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	/*
+	 * Only the current thread sets or clears its own id in
+	 * tee_ta_single_instance_thread so the result is stable without
+	 * holding tee_ta_mutex.
+	 */
 	return tee_ta_single_instance_thread == thread_get_id();
 }
 #endif
@@ -120,35 +148,37 @@ static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx)
 	if (ctx->flags & TA_FLAG_CONCURRENT)
 		return true;
 
-	mutex_lock(&tee_ta_mutex);
-
 	if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
 		lock_single_instance();
 
+	mutex_lock(&ctx->busy_mutex);
+
 	if (has_single_instance_lock()) {
-		if (ctx->busy) {
-			/*
-			 * We're holding the single-instance lock and the
-			 * TA is busy, as waiting now would only cause a
-			 * dead-lock, we release the lock and return false.
-			 */
+		/*
+		 * We're holding the single-instance lock, if the TA is
+		 * busy waiting now would only cause a dead-lock so we
+		 * return false instead.
+		 */
+		if (ctx->busy)
 			rc = false;
-			if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
-				unlock_single_instance();
-		}
 	} else {
 		/*
 		 * We're not holding the single-instance lock, we're free to
 		 * wait for the TA to become available.
 		 */
 		while (ctx->busy)
-			condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
+			condvar_wait(&ctx->busy_cv, &ctx->busy_mutex);
 	}
 
 	/* Either it's already true or we should set it to true */
 	ctx->busy = true;
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&ctx->busy_mutex);
+
+	/* Release the single-instance lock if we didn't get the TA */
+	if (!rc && (ctx->flags & TA_FLAG_SINGLE_INSTANCE))
+		unlock_single_instance();
+
 	return rc;
 }
 
@@ -163,18 +193,60 @@ static void tee_ta_clear_busy(struct tee_ta_ctx *ctx)
 	if (ctx->flags & TA_FLAG_CONCURRENT)
 		return;
 
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&ctx->busy_mutex);
 
 	assert(ctx->busy);
 	ctx->busy = false;
 	condvar_signal(&ctx->busy_cv);
 
+	mutex_unlock(&ctx->busy_mutex);
+
 	if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
 		unlock_single_instance();
+}
 
-	mutex_unlock(&tee_ta_mutex);
+static struct sess_bucket *
+sess_bucket_of(uint32_t id, struct tee_ta_session_head *open_sessions)
+{
+	/*
+	 * Session ids are allocated sequentially in each list, the
+	 * address of the list offsets the ids of different lists.
+	 */
+	vaddr_t h = id + ((vaddr_t)open_sessions >> 4);
+
+	return sess_buckets + h % CFG_TA_SESSION_HASH_BUCKETS;
+}
+
+/* Requires the mutex of @b to be held */
+static struct tee_ta_session *
+sess_bucket_find(struct sess_bucket *b, uint32_t id,
+		 struct tee_ta_session_head *open_sessions)
+{
+	struct tee_ta_session *s = NULL;
+
+	SLIST_FOREACH(s, &b->sessions, hash_link)
+		if (s->id == id && s->open_sessions == open_sessions)
+			return s;
+
+	return NULL;
 }
 
+static void sess_bucket_add(struct tee_ta_session *s)
+{
+	struct sess_bucket *b = sess_bucket_of(s->id, s->open_sessions);
+
+	mutex_lock(&b->mu);
+	SLIST_INSERT_HEAD(&b->sessions, s, hash_link);
+	mutex_unlock(&b->mu);
+}
+
+/* Requires the mutex of @b to be held */
+static void sess_bucket_remove(struct sess_bucket *b, struct tee_ta_session *s)
+{
+	SLIST_REMOVE(&b->sessions, s, tee_ta_session, hash_link);
+}
+
+/* Requires the mutex of the bucket of @s to be held */
 static void dec_session_ref_count(struct tee_ta_session *s)
 {
 	assert(s->ref_count > 0);
@@ -185,7 +257,9 @@ static void dec_session_ref_count(struct tee_ta_session *s)
 
 void tee_ta_put_session(struct tee_ta_session *s)
 {
-	mutex_lock(&tee_ta_mutex);
+	struct sess_bucket *b = sess_bucket_of(s->id, s->open_sessions);
+
+	mutex_lock(&b->mu);
 
 	if (s->lock_thread == thread_get_id()) {
 		s->lock_thread = THREAD_ID_INVALID;
@@ -193,35 +267,33 @@ void tee_ta_put_session(struct tee_ta_session *s)
 	}
 	dec_session_ref_count(s);
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&b->mu);
 }
 
-static struct tee_ta_session *tee_ta_find_session_nolock(uint32_t id,
-			struct tee_ta_session_head *open_sessions)
+static bool session_id_is_used(uint32_t id,
+			       struct tee_ta_session_head *open_sessions)
 {
-	struct tee_ta_session *s = NULL;
-	struct tee_ta_session *found = NULL;
+	struct sess_bucket *b = sess_bucket_of(id, open_sessions);
+	bool used = false;
 
-	TAILQ_FOREACH(s, open_sessions, link) {
-		if (s->id == id) {
-			found = s;
-			break;
-		}
-	}
+	mutex_lock(&b->mu);
+	used = sess_bucket_find(b, id, open_sessions);
+	mutex_unlock(&b->mu);
 
-	return found;
+	return used;
 }
 
 struct tee_ta_session *tee_ta_find_session(uint32_t id,
 			struct tee_ta_session_head *open_sessions)
 {
+	struct sess_bucket *b = sess_bucket_of(id, open_sessions);
 	struct tee_ta_session *s = NULL;
 
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&b->mu);
 
-	s = tee_ta_find_session_nolock(id, open_sessions);
+	s = sess_bucket_find(b, id, open_sessions);
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&b->mu);
 
 	return s;
 }
@@ -229,12 +301,13 @@ struct tee_ta_session *tee_ta_find_session(uint32_t id,
 struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 			struct tee_ta_session_head *open_sessions)
 {
-	struct tee_ta_session *s;
+	struct sess_bucket *b = sess_bucket_of(id, open_sessions);
+	struct tee_ta_session *s = NULL;
 
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&b->mu);
 
 	while (true) {
-		s = tee_ta_find_session_nolock(id, open_sessions);
+		s = sess_bucket_find(b, id, open_sessions);
 		if (!s)
 			break;
 		if (s->unlink) {
@@ -248,7 +321,7 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 		assert(s->lock_thread != thread_get_id());
 
 		while (s->lock_thread != THREAD_ID_INVALID && !s->unlink)
-			condvar_wait(&s->lock_cv, &tee_ta_mutex);
+			condvar_wait(&s->lock_cv, &b->mu);
 
 		if (s->unlink) {
 			dec_session_ref_count(s);
@@ -260,14 +333,18 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 		break;
 	}
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&b->mu);
 	return s;
 }
 
 static void tee_ta_unlink_session(struct tee_ta_session *s,
 			struct tee_ta_session_head *open_sessions)
 {
-	mutex_lock(&tee_ta_mutex);
+	struct sess_bucket *b = sess_bucket_of(s->id, open_sessions);
+
+	assert(s->open_sessions == open_sessions);
+
+	mutex_lock(&b->mu);
 
 	assert(s->ref_count >= 1);
 	assert(s->lock_thread == thread_get_id());
@@ -277,10 +354,14 @@ static void tee_ta_unlink_session(struct tee_ta_session *s,
 	condvar_broadcast(&s->lock_cv);
 
 	while (s->ref_count != 1)
-		condvar_wait(&s->refc_cv, &tee_ta_mutex);
+		condvar_wait(&s->refc_cv, &b->mu);
 
-	TAILQ_REMOVE(open_sessions, s, link);
+	sess_bucket_remove(b, s);
 
+	mutex_unlock(&b->mu);
+
+	mutex_lock(&tee_ta_mutex);
+	TAILQ_REMOVE(open_sessions, s, link);
 	mutex_unlock(&tee_ta_mutex);
 }
 
@@ -308,6 +389,7 @@ static void destroy_context(struct tee_ta_ctx *ctx)
 	DMSG("Destroy TA ctx (0x%" PRIxVA ")",  (vaddr_t)ctx);
 
 	condvar_destroy(&ctx->busy_cv);
+	mutex_destroy(&ctx->busy_mutex);
 	pgt_flush_ctx(&ctx->ts_ctx);
 	ctx->ts_ctx.ops->destroy(&ctx->ts_ctx);
 }
@@ -628,7 +710,7 @@ static uint32_t new_session_id(struct tee_ta_session_head *open_sessions)
 
 	saved = id;
 	do {
-		if (!tee_ta_find_session_nolock(id, open_sessions))
+		if (!session_id_is_used(id, open_sessions))
 			return id;
 		id++;
 		if (!id)
@@ -645,6 +727,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 {
 	TEE_Result res;
 	struct tee_ta_session *s = calloc(1, sizeof(struct tee_ta_session));
+	struct sess_bucket *b = NULL;
 
 	*err = TEE_ORIGIN_TEE;
 	if (!s)
@@ -655,6 +738,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 	condvar_init(&s->lock_cv);
 	s->lock_thread = THREAD_ID_INVALID;
 	s->ref_count = 1;
+	s->open_sessions = open_sessions;
 
 	mutex_lock(&tee_ta_mutex);
 	s->id = new_session_id(open_sessions);
@@ -664,6 +748,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 	}
 
 	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	sess_bucket_add(s);
 
 	/* Look for already loaded TA */
 	res = tee_ta_init_session_with_context(s, uuid);
@@ -690,6 +775,11 @@ out:
 		return TEE_SUCCESS;
 	}
 
+	b = sess_bucket_of(s->id, open_sessions);
+	mutex_lock(&b->mu);
+	sess_bucket_remove(b, s);
+	mutex_unlock(&b->mu);
+
 	mutex_lock(&tee_ta_mutex);
 	TAILQ_REMOVE(open_sessions, s, link);
 err_mutex_unlock:
@@ -357,6 +357,7 @@ static void free_utc(struct user_ta_ctx *utc)
 	tee_obj_close_all(utc);
 	/* Free emums created by this TA */
 	tee_svc_storage_close_all_enum(utc);
+	tee_handle_table_final(&utc->handles);
 	free(utc);
 }
 
@@ -426,6 +427,8 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 	TAILQ_INIT(&utc->cryp_states);
 	TAILQ_INIT(&utc->objects);
 	TAILQ_INIT(&utc->storage_enums);
+	tee_handle_table_init(&utc->handles);
+	mutex_init(&utc->ta_ctx.busy_mutex);
 	condvar_init(&utc->ta_ctx.busy_cv);
 	utc->ta_ctx.ref_count = 1;
 
@@ -482,6 +485,7 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 out:
 	if (res) {
 		condvar_destroy(&utc->ta_ctx.busy_cv);
+		mutex_destroy(&utc->ta_ctx.busy_mutex);
 		pgt_flush_ctx(&utc->ta_ctx.ts_ctx);
 		free_utc(utc);
 	}
@@ -70,6 +70,7 @@ static void fobj_init(struct fobj *fobj, const struct fobj_ops *ops,
 	fobj->num_pages = num_pages;
 	refcount_set(&fobj->refc, 1);
 	TAILQ_INIT(&fobj->regions);
+	fobj->pmems = NULL;
 }
 
 static void fobj_uninit(struct fobj *fobj)
@@ -100,12 +101,8 @@ static TEE_Result rwp_load_page(void *va, struct rwp_state *state,
 				    state->tag, sizeof(state->tag));
 }
 
-static TEE_Result rwp_save_page(const void *va, struct rwp_state *state,
-				uint8_t *dst)
+static void rwp_next_iv(struct rwp_state *state, struct rwp_aes_gcm_iv *iv)
 {
-	size_t tag_len = sizeof(state->tag);
-	struct rwp_aes_gcm_iv iv = { };
-
 	assert(state->iv + 1 > state->iv);
 
 	state->iv++;
@@ -116,9 +113,18 @@ static TEE_Result rwp_save_page(const void *va, struct rwp_state *state,
 	 * Operation: Galois/Counter Mode (GCM) and GMAC",
 	 * http://csrc.nist.gov/publications/nistpubs/800-38D/SP-800-38D.pdf
 	 */
-	iv.iv[0] = (vaddr_t)state;
-	iv.iv[1] = state->iv >> 32;
-	iv.iv[2] = state->iv;
+	iv->iv[0] = (vaddr_t)state;
+	iv->iv[1] = state->iv >> 32;
+	iv->iv[2] = state->iv;
+}
+
+static TEE_Result rwp_save_page(const void *va, struct rwp_state *state,
+				uint8_t *dst)
+{
+	size_t tag_len = sizeof(state->tag);
+	struct rwp_aes_gcm_iv iv = { };
+
+	rwp_next_iv(state, &iv);
 
 	return internal_aes_gcm_enc(&rwp_ae_key, &iv, sizeof(iv),
 				    NULL, 0, va, SMALL_PAGE_SIZE, dst,
@@ -353,6 +359,92 @@ __weak __rodata_unpaged("ops_rwp_unpaged_iv") = {
 	.save_page = rwp_unpaged_iv_save_page,
 };
 
+/* Number of pages encrypted with one internal_aes_gcm_enc_multi() call */
+#define RWP_SAVE_BATCH	4
+
+/*
+ * Returns the state and storage of page @page_idx in the read/write paged
+ * @fobj. Returns false if @fobj is being torn down and the page doesn't
+ * need to be saved.
+ */
+static bool rwp_get_page_state(struct fobj *fobj, unsigned int page_idx,
+			       struct rwp_state **state, uint8_t **dst)
+{
+	struct fobj_rwp_unpaged_iv *rwpu = NULL;
+	struct fobj_rwp_paged_iv *rwp = NULL;
+
+	assert(page_idx < fobj->num_pages);
+
+	if (!refcount_val(&fobj->refc)) {
+		/* See rwp_paged_iv_save_page() */
+		assert(TAILQ_EMPTY(&fobj->regions));
+		return false;
+	}
+
+	if (fobj->ops == &ops_rwp_paged_iv) {
+		rwp = to_rwp_paged_iv(fobj);
+		*state = &idx_to_state_padded(rwp->idx + page_idx)->state;
+		*dst = idx_to_store(rwp->idx) + page_idx * SMALL_PAGE_SIZE;
+	} else {
+		rwpu = to_rwp_unpaged_iv(fobj);
+		*state = rwpu->state + page_idx;
+		*dst = rwpu->store + page_idx * SMALL_PAGE_SIZE;
+	}
+
+	return true;
+}
+
+static TEE_Result rwp_save_batch(const struct internal_aes_gcm_buf *bufs,
+				 size_t num)
+{
+	return internal_aes_gcm_enc_multi(&rwp_ae_key, bufs, num,
+					  sizeof(struct rwp_aes_gcm_iv),
+					  SMALL_PAGE_SIZE, RWP_AES_GCM_TAG_LEN);
+}
+
+TEE_Result fobj_save_pages(struct fobj * const *fobj,
+			   const unsigned int *page_idx,
+			   const void * const *va, size_t num)
+{
+	struct internal_aes_gcm_buf bufs[RWP_SAVE_BATCH] = { };
+	struct rwp_aes_gcm_iv ivs[RWP_SAVE_BATCH] = { };
+	struct rwp_state *state = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *dst = NULL;
+	size_t m = 0;
+	size_t n = 0;
+
+	for (n = 0; n < num; n++) {
+		if (fobj[n]->ops != &ops_rwp_paged_iv &&
+		    fobj[n]->ops != &ops_rwp_unpaged_iv) {
+			res = fobj_save_page(fobj[n], page_idx[n], va[n]);
+			if (res)
+				return res;
+			continue;
+		}
+
+		if (!rwp_get_page_state(fobj[n], page_idx[n], &state, &dst))
+			continue;
+
+		rwp_next_iv(state, ivs + m);
+		bufs[m].nonce = ivs + m;
+		bufs[m].src = va[n];
+		bufs[m].dst = dst;
+		bufs[m].tag = state->tag;
+		m++;
+
+		if (m == RWP_SAVE_BATCH) {
+			res = rwp_save_batch(bufs, m);
+			if (res)
+				return res;
+			m = 0;
+		}
+	}
+
+	return rwp_save_batch(bufs, m);
+}
+DECLARE_KEEP_PAGER(fobj_save_pages);
+
 static TEE_Result rwp_init(void)
 {
 	uint8_t key[RWP_AE_KEY_BITS / 8] = { 0 };
@@ -475,6 +567,45 @@ static TEE_Result rop_load_page_helper(struct fobj_rop *rop,
 	return hash_sha256_check(hash, va, SMALL_PAGE_SIZE);
 }
 
+/* Number of pages verified with a single hash_sha256_check_multi() call */
+#define ROP_LOAD_BATCH	8
+
+static TEE_Result rop_load_pages_helper(struct fobj_rop *rop,
+					unsigned int page_idx,
+					unsigned int num_pages,
+					void * const *va)
+{
+	const uint8_t *hashes[ROP_LOAD_BATCH] = { };
+	const uint8_t *data[ROP_LOAD_BATCH] = { };
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int idx = 0;
+	unsigned int num = 0;
+	unsigned int n = 0;
+
+	assert(refcount_val(&rop->fobj.refc));
+	assert(page_idx + num_pages <= rop->fobj.num_pages);
+
+	while (n < num_pages) {
+		num = MIN(num_pages - n, (unsigned int)ROP_LOAD_BATCH);
+		for (idx = 0; idx < num; idx++) {
+			memcpy(va[n + idx],
+			       rop->store + (page_idx + n + idx) *
+					    SMALL_PAGE_SIZE,
+			       SMALL_PAGE_SIZE);
+			hashes[idx] = rop->hashes + (page_idx + n + idx) *
+						    TEE_SHA256_HASH_SIZE;
+			data[idx] = va[n + idx];
+		}
+		res = hash_sha256_check_multi(hashes, data, SMALL_PAGE_SIZE,
+					      num);
+		if (res)
+			return res;
+		n += num;
+	}
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result rop_load_page(struct fobj *fobj, unsigned int page_idx,
 				void *va)
 {
@@ -482,6 +613,13 @@ static TEE_Result rop_load_page(struct fobj *fobj, unsigned int page_idx,
 }
 DECLARE_KEEP_PAGER(rop_load_page);
 
+static TEE_Result rop_load_pages(struct fobj *fobj, unsigned int page_idx,
+				 unsigned int num_pages, void * const *va)
+{
+	return rop_load_pages_helper(to_rop(fobj), page_idx, num_pages, va);
+}
+DECLARE_KEEP_PAGER(rop_load_pages);
+
 static TEE_Result rop_save_page(struct fobj *fobj __unused,
 				unsigned int page_idx __unused,
 				const void *va __unused)
@@ -497,6 +635,7 @@ DECLARE_KEEP_PAGER(rop_save_page);
 const struct fobj_ops ops_ro_paged __weak __rodata_unpaged("ops_ro_paged") = {
 	.free = rop_free,
 	.load_page = rop_load_page,
+	.load_pages = rop_load_pages,
 	.save_page = rop_save_page,
 };
 
@@ -636,21 +775,15 @@ static void rrp_free(struct fobj *fobj)
 	free(rrp);
 }
 
-static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
-				void *va)
+static void rrp_apply_relocs(struct fobj_ro_reloc_paged *rrp,
+			     unsigned int page_idx, void *va)
 {
-	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
 	unsigned int end_rel = rrp->num_relocs;
-	TEE_Result res = TEE_SUCCESS;
 	unsigned long *where = NULL;
 	unsigned int n = 0;
 
-	res = rop_load_page_helper(&rrp->rop, page_idx, va);
-	if (res)
-		return res;
-
 	/* Find the reloc index of the next page to tell when we're done */
-	for (n = page_idx + 1; n < fobj->num_pages; n++) {
+	for (n = page_idx + 1; n < rrp->rop.fobj.num_pages; n++) {
 		if (rrp->page_reloc_idx[n] != UINT16_MAX) {
 			end_rel = rrp->page_reloc_idx[n];
 			break;
@@ -661,11 +794,43 @@ static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
 		where = (void *)((vaddr_t)va + rrp->relocs[n]);
 		*where += boot_mmu_config.load_offset;
 	}
+}
+
+static TEE_Result rrp_load_page(struct fobj *fobj, unsigned int page_idx,
+				void *va)
+{
+	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
+	TEE_Result res = TEE_SUCCESS;
+
+	res = rop_load_page_helper(&rrp->rop, page_idx, va);
+	if (res)
+		return res;
+
+	rrp_apply_relocs(rrp, page_idx, va);
 
 	return TEE_SUCCESS;
 }
 DECLARE_KEEP_PAGER(rrp_load_page);
 
+static TEE_Result rrp_load_pages(struct fobj *fobj, unsigned int page_idx,
+				 unsigned int num_pages, void * const *va)
+{
+	struct fobj_ro_reloc_paged *rrp = to_rrp(fobj);
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int n = 0;
+
+	/* Relocations must be applied after the hashes are verified */
+	res = rop_load_pages_helper(&rrp->rop, page_idx, num_pages, va);
+	if (res)
+		return res;
+
+	for (n = 0; n < num_pages; n++)
+		rrp_apply_relocs(rrp, page_idx + n, va[n]);
+
+	return TEE_SUCCESS;
+}
+DECLARE_KEEP_PAGER(rrp_load_pages);
+
 /*
  * Note: this variable is weak just to ease breaking its dependency chain
  * when added to the unpaged area.
@@ -674,6 +839,7 @@ const struct fobj_ops ops_ro_reloc_paged
 __weak __rodata_unpaged("ops_ro_reloc_paged") = {
 	.free = rrp_free,
 	.load_page = rrp_load_page,
+	.load_pages = rrp_load_pages,
 	.save_page = rop_save_page, /* Direct reuse */
 };
 #endif /*CFG_CORE_ASLR*/
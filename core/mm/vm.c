@@ -163,6 +163,100 @@ static TEE_Result alloc_pgt(struct user_mode_ctx *uctx)
 	return TEE_SUCCESS;
 }
 
+/*
+ * Makes sure that @vmi->region_index has room for at least @count more
+ * regions. The index is never shrunk until vm_info_final() so regions
+ * removed and added back again, as done by vm_remap(), can't fail here.
+ */
+static TEE_Result reserve_region_index(struct vm_info *vmi, size_t count)
+{
+	struct vm_region **idx = NULL;
+	size_t n = 0;
+
+	if (ADD_OVERFLOW(vmi->num_regions, count, &n))
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (n <= vmi->max_regions)
+		return TEE_SUCCESS;
+
+	n = MAX(n, MAX(vmi->max_regions * 2, (size_t)8));
+	idx = realloc(vmi->region_index, n * sizeof(*idx));
+	if (!idx)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	vmi->region_index = idx;
+	vmi->max_regions = n;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Returns the position in @vmi->region_index of the first region ending
+ * above @va. Regions don't overlap so the end addresses are sorted too.
+ */
+static size_t region_index_pos(const struct vm_info *vmi, vaddr_t va)
+{
+	size_t lo = 0;
+	size_t hi = vmi->num_regions;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct vm_region *r = vmi->region_index[mid];
+
+		if (r->va + r->size <= va)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Adds @r to @vmi, @next is the region following @r or NULL if @r is to
+ * be the last region. reserve_region_index() must have succeeded before.
+ */
+static void link_region(struct vm_info *vmi, struct vm_region *r,
+			struct vm_region *next)
+{
+	size_t pos = region_index_pos(vmi, r->va);
+
+	assert(vmi->num_regions < vmi->max_regions);
+	assert(pos == vmi->num_regions || vmi->region_index[pos] == next);
+
+	memmove(vmi->region_index + pos + 1, vmi->region_index + pos,
+		(vmi->num_regions - pos) * sizeof(*vmi->region_index));
+	vmi->region_index[pos] = r;
+	vmi->num_regions++;
+
+	if (next)
+		TAILQ_INSERT_BEFORE(next, r, link);
+	else
+		TAILQ_INSERT_TAIL(&vmi->regions, r, link);
+}
+
+static void unlink_region(struct vm_info *vmi, struct vm_region *r)
+{
+	size_t pos = region_index_pos(vmi, r->va);
+
+	assert(pos < vmi->num_regions && vmi->region_index[pos] == r);
+
+	vmi->num_regions--;
+	memmove(vmi->region_index + pos, vmi->region_index + pos + 1,
+		(vmi->num_regions - pos) * sizeof(*vmi->region_index));
+
+	TAILQ_REMOVE(&vmi->regions, r, link);
+}
+
+static struct vm_region *find_vm_region(const struct vm_info *vmi, vaddr_t va)
+{
+	size_t pos = region_index_pos(vmi, va);
+
+	if (pos < vmi->num_regions && vmi->region_index[pos]->va <= va)
+		return vmi->region_index[pos];
+
+	return NULL;
+}
+
 static void rem_um_region(struct user_mode_ctx *uctx, struct vm_region *r)
 {
 	struct thread_specific_data *tsd = thread_get_tsd();
@@ -207,8 +301,10 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg,
 	struct vm_region dummy_last_reg = { };
 	struct vm_region *r = NULL;
 	struct vm_region *prev_r = NULL;
+	TEE_Result res = TEE_SUCCESS;
 	vaddr_t va_range_base = 0;
 	size_t va_range_size = 0;
+	size_t pos = 0;
 	size_t granul;
 	vaddr_t va = 0;
 	size_t offs_plus_size = 0;
@@ -231,13 +327,42 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg,
 	if (!IS_POWER_OF_TWO(granul))
 		return TEE_ERROR_BAD_PARAMETERS;
 
+	res = reserve_region_index(vmi, 1);
+	if (res)
+		return res;
+
+	if (reg->va) {
+		/*
+		 * A fixed address can only fit in the gap just before the
+		 * first region ending above it.
+		 */
+		pos = region_index_pos(vmi, reg->va);
+		if (pos)
+			prev_r = vmi->region_index[pos - 1];
+		else
+			prev_r = &dummy_first_reg;
+		if (pos < vmi->num_regions)
+			r = vmi->region_index[pos];
+		else
+			r = &dummy_last_reg;
+
+		va = select_va_in_range(prev_r, r, reg, pad_begin, pad_end,
+					granul);
+		if (!va)
+			return TEE_ERROR_ACCESS_CONFLICT;
+		if (r == &dummy_last_reg)
+			r = NULL;
+		link_region(vmi, reg, r);
+		return TEE_SUCCESS;
+	}
+
 	prev_r = &dummy_first_reg;
 	TAILQ_FOREACH(r, &vmi->regions, link) {
 		va = select_va_in_range(prev_r, r, reg, pad_begin, pad_end,
 					granul);
 		if (va) {
 			reg->va = va;
-			TAILQ_INSERT_BEFORE(r, reg, link);
+			link_region(vmi, reg, r);
 			return TEE_SUCCESS;
 		}
 		prev_r = r;
@@ -250,7 +375,7 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg,
 				granul);
 	if (va) {
 		reg->va = va;
-		TAILQ_INSERT_TAIL(&vmi->regions, reg, link);
+		link_region(vmi, reg, NULL);
 		return TEE_SUCCESS;
 	}
 
@@ -326,7 +451,7 @@ TEE_Result vm_map_pad(struct user_mode_ctx *uctx, vaddr_t *va, size_t len,
 	return TEE_SUCCESS;
 
 err_rem_reg:
-	TAILQ_REMOVE(&uctx->vm_info.regions, reg, link);
+	unlink_region(&uctx->vm_info, reg);
 err_put_mobj:
 	mobj_put(reg->mobj);
 err_free_reg:
@@ -334,17 +459,6 @@ err_free_reg:
 	return res;
 }
 
-static struct vm_region *find_vm_region(struct vm_info *vm_info, vaddr_t va)
-{
-	struct vm_region *r = NULL;
-
-	TAILQ_FOREACH(r, &vm_info->regions, link)
-		if (va >= r->va && va < r->va + r->size)
-			return r;
-
-	return NULL;
-}
-
 static bool va_range_is_contiguous(struct vm_region *r0, vaddr_t va,
 				   size_t len,
 				   bool (*cmp_regs)(const struct vm_region *r0,
@@ -376,18 +490,22 @@ static bool va_range_is_contiguous(struct vm_region *r0, vaddr_t va,
 static TEE_Result split_vm_region(struct user_mode_ctx *uctx,
 				  struct vm_region *r, vaddr_t va)
 {
+	TEE_Result res = TEE_SUCCESS;
 	struct vm_region *r2 = NULL;
 	size_t diff = va - r->va;
 
 	assert(diff && diff < r->size);
 
+	res = reserve_region_index(&uctx->vm_info, 1);
+	if (res)
+		return res;
+
 	r2 = calloc(1, sizeof(*r2));
 	if (!r2)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	if (mobj_is_paged(r->mobj)) {
-		TEE_Result res = tee_pager_split_um_region(uctx, va);
-
+		res = tee_pager_split_um_region(uctx, va);
 		if (res) {
 			free(r2);
 			return res;
@@ -403,7 +521,7 @@ static TEE_Result split_vm_region(struct user_mode_ctx *uctx,
 
 	r->size = diff;
 
-	TAILQ_INSERT_AFTER(&uctx->vm_info.regions, r, r2, link);
+	link_region(&uctx->vm_info, r2, TAILQ_NEXT(r, link));
 
 	return TEE_SUCCESS;
 }
@@ -459,16 +577,24 @@ static TEE_Result split_vm_range(struct user_mode_ctx *uctx, vaddr_t va,
 
 static void merge_vm_range(struct user_mode_ctx *uctx, vaddr_t va, size_t len)
 {
+	struct vm_info *vmi = &uctx->vm_info;
 	struct vm_region *r_next = NULL;
 	struct vm_region *r = NULL;
 	vaddr_t end_va = 0;
+	size_t pos = 0;
 
 	if (ADD_OVERFLOW(va, len, &end_va))
 		return;
 
 	tee_pager_merge_um_region(uctx, va, len);
 
-	for (r = TAILQ_FIRST(&uctx->vm_info.regions);; r = r_next) {
+	/* Start with the region ending at or just after va */
+	if (va)
+		pos = region_index_pos(vmi, va - 1);
+	if (pos >= vmi->num_regions)
+		return;
+
+	for (r = vmi->region_index[pos];; r = r_next) {
 		r_next = TAILQ_NEXT(r, link);
 		if (!r_next)
 			return;
@@ -494,7 +620,7 @@ static void merge_vm_range(struct user_mode_ctx *uctx, vaddr_t va, size_t len)
 		if (r->offset + r->size != r_next->offset)
 			continue;
 
-		TAILQ_REMOVE(&uctx->vm_info.regions, r_next, link);
+		unlink_region(vmi, r_next);
 		r->size += r_next->size;
 		mobj_put(r_next->mobj);
 		free(r_next);
@@ -550,7 +676,7 @@ TEE_Result vm_remap(struct user_mode_ctx *uctx, vaddr_t *new_va, vaddr_t old_va,
 			break;
 		r_next = TAILQ_NEXT(r, link);
 		rem_um_region(uctx, r);
-		TAILQ_REMOVE(&uctx->vm_info.regions, r, link);
+		unlink_region(&uctx->vm_info, r);
 		TAILQ_INSERT_TAIL(&regs, r, link);
 	}
 
@@ -597,7 +723,7 @@ TEE_Result vm_remap(struct user_mode_ctx *uctx, vaddr_t *new_va, vaddr_t old_va,
 			}
 			for (r = r_first; r_last && r != r_last; r = r_next) {
 				r_next = TAILQ_NEXT(r, link);
-				TAILQ_REMOVE(&uctx->vm_info.regions, r, link);
+				unlink_region(&uctx->vm_info, r);
 				if (r_tmp)
 					TAILQ_INSERT_AFTER(&regs, r_tmp, r,
 							   link);
@@ -751,7 +877,7 @@ TEE_Result vm_set_prot(struct user_mode_ctx *uctx, vaddr_t va, size_t len,
 
 static void umap_remove_region(struct vm_info *vmi, struct vm_region *reg)
 {
-	TAILQ_REMOVE(&vmi->regions, reg, link);
+	unlink_region(vmi, reg);
 	mobj_put(reg->mobj);
 	free(reg);
 }
@@ -1077,6 +1203,7 @@ void vm_info_final(struct user_mode_ctx *uctx)
 	while (!TAILQ_EMPTY(&uctx->vm_info.regions))
 		umap_remove_region(&uctx->vm_info,
 				   TAILQ_FIRST(&uctx->vm_info.regions));
+	free(uctx->vm_info.region_index);
 	memset(&uctx->vm_info, 0, sizeof(uctx->vm_info));
 }
 
@@ -1084,25 +1211,32 @@ void vm_info_final(struct user_mode_ctx *uctx)
 bool vm_buf_is_inside_um_private(const struct user_mode_ctx *uctx,
 				 const void *va, size_t size)
 {
-	struct vm_region *r = NULL;
+	struct vm_region *r = find_vm_region(&uctx->vm_info, (vaddr_t)va);
 
-	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
-		if (r->flags & VM_FLAGS_NONPRIV)
-			continue;
-		if (core_is_buffer_inside((vaddr_t)va, size, r->va, r->size))
-			return true;
-	}
+	/* Regions don't overlap so only the region holding va can match */
+	if (!r || (r->flags & VM_FLAGS_NONPRIV))
+		return false;
 
-	return false;
+	return core_is_buffer_inside((vaddr_t)va, size, r->va, r->size);
 }
 
 /* return true only if buffer intersects TA private memory */
 bool vm_buf_intersects_um_private(const struct user_mode_ctx *uctx,
 				  const void *va, size_t size)
 {
+	const struct vm_info *vmi = &uctx->vm_info;
 	struct vm_region *r = NULL;
+	vaddr_t end_va = 0;
+	size_t pos = 0;
 
-	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
+	if (!size || ADD_OVERFLOW((vaddr_t)va, size, &end_va))
+		return false;
+
+	for (pos = region_index_pos(vmi, (vaddr_t)va);
+	     pos < vmi->num_regions; pos++) {
+		r = vmi->region_index[pos];
+		if (r->va >= end_va)
+			break;
 		if (r->attr & VM_FLAGS_NONPRIV)
 			continue;
 		if (core_is_buffer_intersect((vaddr_t)va, size, r->va, r->size))
@@ -1116,69 +1250,59 @@ TEE_Result vm_buf_to_mboj_offs(const struct user_mode_ctx *uctx,
 			       const void *va, size_t size,
 			       struct mobj **mobj, size_t *offs)
 {
-	struct vm_region *r = NULL;
+	struct vm_region *r = find_vm_region(&uctx->vm_info, (vaddr_t)va);
+	size_t poffs = 0;
 
-	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
-		if (!r->mobj)
-			continue;
-		if (core_is_buffer_inside((vaddr_t)va, size, r->va, r->size)) {
-			size_t poffs;
+	if (!r || !r->mobj ||
+	    !core_is_buffer_inside((vaddr_t)va, size, r->va, r->size))
+		return TEE_ERROR_BAD_PARAMETERS;
 
-			poffs = mobj_get_phys_offs(r->mobj,
-						   CORE_MMU_USER_PARAM_SIZE);
-			*mobj = r->mobj;
-			*offs = (vaddr_t)va - r->va + r->offset - poffs;
-			return TEE_SUCCESS;
-		}
-	}
+	poffs = mobj_get_phys_offs(r->mobj, CORE_MMU_USER_PARAM_SIZE);
+	*mobj = r->mobj;
+	*offs = (vaddr_t)va - r->va + r->offset - poffs;
 
-	return TEE_ERROR_BAD_PARAMETERS;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result tee_mmu_user_va2pa_attr(const struct user_mode_ctx *uctx,
 					  void *ua, paddr_t *pa, uint32_t *attr)
 {
-	struct vm_region *region = NULL;
-
-	TAILQ_FOREACH(region, &uctx->vm_info.regions, link) {
-		if (!core_is_buffer_inside((vaddr_t)ua, 1, region->va,
-					   region->size))
-			continue;
+	struct vm_region *region = find_vm_region(&uctx->vm_info, (vaddr_t)ua);
 
-		if (pa) {
-			TEE_Result res;
-			paddr_t p;
-			size_t offset;
-			size_t granule;
+	if (!region)
+		return TEE_ERROR_ACCESS_DENIED;
 
-			/*
-			 * mobj and input user address may each include
-			 * a specific offset-in-granule position.
-			 * Drop both to get target physical page base
-			 * address then apply only user address
-			 * offset-in-granule.
-			 * Mapping lowest granule is the small page.
-			 */
-			granule = MAX(region->mobj->phys_granule,
-				      (size_t)SMALL_PAGE_SIZE);
-			assert(!granule || IS_POWER_OF_TWO(granule));
+	if (pa) {
+		TEE_Result res;
+		paddr_t p;
+		size_t offset;
+		size_t granule;
 
-			offset = region->offset +
-				 ROUNDDOWN((vaddr_t)ua - region->va, granule);
+		/*
+		 * mobj and input user address may each include
+		 * a specific offset-in-granule position.
+		 * Drop both to get target physical page base
+		 * address then apply only user address
+		 * offset-in-granule.
+		 * Mapping lowest granule is the small page.
+		 */
+		granule = MAX(region->mobj->phys_granule,
+			      (size_t)SMALL_PAGE_SIZE);
+		assert(!granule || IS_POWER_OF_TWO(granule));
 
-			res = mobj_get_pa(region->mobj, offset, granule, &p);
-			if (res != TEE_SUCCESS)
-				return res;
+		offset = region->offset +
+			 ROUNDDOWN((vaddr_t)ua - region->va, granule);
 
-			*pa = p | ((vaddr_t)ua & (granule - 1));
-		}
-		if (attr)
-			*attr = region->attr;
+		res = mobj_get_pa(region->mobj, offset, granule, &p);
+		if (res != TEE_SUCCESS)
+			return res;
 
-		return TEE_SUCCESS;
+		*pa = p | ((vaddr_t)ua & (granule - 1));
 	}
+	if (attr)
+		*attr = region->attr;
 
-	return TEE_ERROR_ACCESS_DENIED;
+	return TEE_SUCCESS;
 }
 
 TEE_Result vm_va2pa(const struct user_mode_ctx *uctx, void *ua, paddr_t *pa)
@@ -1256,13 +1380,20 @@ TEE_Result vm_check_access_rights(const struct user_mode_ctx *uctx,
 	   !vm_buf_is_inside_um_private(uctx, (void *)uaddr, len))
 		return TEE_ERROR_ACCESS_DENIED;
 
-	for (a = ROUNDDOWN(uaddr, addr_incr); a < end_addr; a += addr_incr) {
-		uint32_t attr;
-		TEE_Result res;
+	a = ROUNDDOWN(uaddr, addr_incr);
+	while (a < end_addr) {
+		struct vm_region *r = find_vm_region(&uctx->vm_info, a);
+		uint32_t attr = 0;
 
-		res = tee_mmu_user_va2pa_attr(uctx, (void *)a, NULL, &attr);
-		if (res != TEE_SUCCESS)
-			return res;
+		if (!r)
+			return TEE_ERROR_ACCESS_DENIED;
+
+		/*
+		 * All remaining addresses in this region share the same
+		 * attributes, continue with the first one past it.
+		 */
+		attr = r->attr;
+		a = ROUNDUP(r->va + r->size, addr_incr);
 
 		if ((flags & TEE_MEMORY_ACCESS_NONSECURE) &&
 		    (attr & TEE_MATTR_SECURE))
@@ -3,14 +3,18 @@
  * Copyright (c) 2015, Linaro Limited
  */
 #include <compiler.h>
+#include <config.h>
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/thread.h>
+#include <mm/mobj.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
 #include <string.h>
 #include <string_ext.h>
 #include <malloc.h>
+#include <tee/fs_htree.h>
 
 #define TA_NAME		"stats.ta"
 
@@ -21,6 +25,11 @@
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
 #define STATS_CMD_MEMLEAK_STATS		2
+#define STATS_CMD_PAGER_REPLACEMENT_STATS	3
+#define STATS_CMD_FS_HTREE_STATS	4
+#define STATS_CMD_THREAD_ALLOC_STATS	5
+#define STATS_CMD_SHM_LOCK_STATS	6
+#define STATS_CMD_RPC_SHM_STATS		7
 
 #define STATS_NB_POOLS			4
 
@@ -104,12 +113,22 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
 	struct tee_pager_stats stats;
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t exp_pt_ext = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT);
 
-	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_NONE) != type) {
-		EMSG("expect 3 output values as argument");
+	/*
+	 * p[3] is optional, when supplied it receives the number of
+	 * physical page lookups and the time spent on them in nanoseconds.
+	 * The time is only measured with CFG_CORE_PAGER_LOOKUP_TIMING=y.
+	 */
+	if (type != exp_pt && type != exp_pt_ext) {
+		EMSG("expect 3 or 4 output values as argument");
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
@@ -120,6 +139,56 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	p[1].value.b = stats.rw_hits;
 	p[2].value.a = stats.hidden_hits;
 	p[2].value.b = stats.zi_released;
+	if (type == exp_pt_ext) {
+		p[3].value.a = stats.pmem_lookups;
+		p[3].value.b = stats.pmem_lookup_ns;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_pager_replacement_stats(uint32_t type,
+					      TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_stats stats = { };
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t exp_pt_ext = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT,
+					      TEE_PARAM_TYPE_VALUE_OUTPUT);
+
+	/*
+	 * p[0].value.a = evicted clean pages
+	 * p[0].value.b = evicted dirty pages
+	 * p[1].value.a = pages loaded again shortly after being evicted
+	 * p[1].value.b = estimated working set in pages
+	 * p[2].value.a = pages loaded in advance by fault-around
+	 * p[2].value.b = dirty pages saved ahead of their eviction
+	 * p[3].value.a = batches of dirty pages saved (optional)
+	 * p[3].value.b = time spent saving dirty pages in ns (optional)
+	 *
+	 * Note that this resets all counters returned by
+	 * STATS_CMD_PAGER_STATS too.
+	 */
+	if (type != exp_pt && type != exp_pt_ext) {
+		EMSG("expect 3 or 4 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_pager_get_stats(&stats);
+	p[0].value.a = stats.clean_evictions;
+	p[0].value.b = stats.dirty_evictions;
+	p[1].value.a = stats.refaults;
+	p[1].value.b = stats.ws_pages;
+	p[2].value.a = stats.prefetched;
+	p[2].value.b = stats.writeback_ahead;
+	if (type == exp_pt_ext) {
+		p[3].value.a = stats.writebacks;
+		p[3].value.b = stats.writeback_ns;
+	}
 
 	return TEE_SUCCESS;
 }
@@ -137,6 +206,122 @@ static TEE_Result get_memleak_stats(uint32_t type,
 	return TEE_SUCCESS;
 }
 
+static TEE_Result get_fs_htree_stats(uint32_t type,
+				     TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_fs_htree_stats stats = { };
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 1 output value as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (!IS_ENABLED(CFG_REE_FS))
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	/*
+	 * p[0].value.a = data block reads served by the block cache
+	 * p[0].value.b = data block reads which needed storage access
+	 *
+	 * The counters are reset by each read.
+	 */
+	tee_fs_htree_get_stats(&stats);
+	p[0].value.a = stats.cache_hits;
+	p[0].value.b = stats.cache_misses;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_thread_alloc_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct thread_alloc_stats *stats = NULL;
+	size_t size = CFG_TEE_CORE_NB_CORE * sizeof(*stats);
+	size_t n = 0;
+
+	/*
+	 * p[0].memref.buffer = output buffer to one struct
+	 *			thread_alloc_stats per core
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (p[0].memref.size < size) {
+		p[0].memref.size = size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	p[0].memref.size = size;
+	stats = p[0].memref.buffer;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
+		thread_get_alloc_stats(n, stats + n);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_shm_lock_stats(uint32_t type,
+				     TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct mobj_shm_lock_stats stats[2] = { };
+	size_t size = sizeof(stats);
+
+	/*
+	 * p[0].memref.buffer = output buffer to two struct
+	 *			mobj_shm_lock_stats, the first for
+	 *			registered shared memory and the second for
+	 *			FF-A shared memory
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (!IS_ENABLED(CFG_CORE_DYN_SHM) && !IS_ENABLED(CFG_CORE_FFA))
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	if (p[0].memref.size < size) {
+		p[0].memref.size = size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	p[0].memref.size = size;
+
+	mobj_reg_shm_get_lock_stats(stats);
+	mobj_ffa_get_lock_stats(stats + 1);
+	memcpy(p[0].memref.buffer, stats, size);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_rpc_shm_stats(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct thread_rpc_shm_stats stats = { };
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	/*
+	 * p[0].value.a = shared memory allocation RPCs
+	 * p[0].value.b = shared memory free RPCs
+	 * p[1].value.a = payload allocations served from a thread pool
+	 * p[1].value.b = 0 (reserved)
+	 *
+	 * The counters are never reset.
+	 */
+	thread_get_rpc_shm_stats(&stats);
+	p[0].value.a = stats.alloc_rpcs;
+	p[0].value.b = stats.free_rpcs;
+	p[1].value.a = stats.pool_hits;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
 /*
  * Trusted Application Entry Points
  */
@@ -152,6 +337,16 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_alloc_stats(ptypes, params);
 	case STATS_CMD_MEMLEAK_STATS:
 		return get_memleak_stats(ptypes, params);
+	case STATS_CMD_PAGER_REPLACEMENT_STATS:
+		return get_pager_replacement_stats(ptypes, params);
+	case STATS_CMD_FS_HTREE_STATS:
+		return get_fs_htree_stats(ptypes, params);
+	case STATS_CMD_THREAD_ALLOC_STATS:
+		return get_thread_alloc_stats(ptypes, params);
+	case STATS_CMD_SHM_LOCK_STATS:
+		return get_shm_lock_stats(ptypes, params);
+	case STATS_CMD_RPC_SHM_STATS:
+		return get_rpc_shm_stats(ptypes, params);
 	default:
 		break;
 	}
@@ -3,6 +3,7 @@
  * Copyright (c) 2017, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <kernel/ts_manager.h>
 #include <string.h>
@@ -14,6 +15,9 @@
 
 #include "misc.h"
 
+/* Largest object used by the open/verify performance test */
+#define TEST_PERF_MAX_BLOCKS	4096
+
 /*
  * The smallest blocks size that can hold two struct
  * tee_fs_htree_node_image or two struct tee_fs_htree_image.
@@ -621,3 +625,74 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 
 	return test_corrupt(5);
 }
+
+/*
+ * Writes an object of @num_blocks blocks and measures the time needed to
+ * open it, which reads and verifies the entire hash-tree, @count times.
+ */
+static TEE_Result open_perf(size_t num_blocks, size_t count,
+			    uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	struct ts_session *sess = ts_get_current_session();
+	const TEE_UUID *uuid = &sess->ctx->uuid;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE] = { 0 };
+	struct tee_fs_htree *ht = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	struct test_aux *aux = NULL;
+	uint64_t t = 0;
+	size_t n = 0;
+
+	aux = aux_alloc(num_blocks);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+
+	t = barrier_read_counter_timer();
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	times_us[1] = perf_elapsed_us(t);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < count; n++) {
+		res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops,
+					aux, &ht);
+		CHECK_RES(res, goto out);
+		tee_fs_htree_close(&ht);
+	}
+	times_us[0] = perf_elapsed_us(t);
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
+/* An object of @num_blocks blocks opened @count times */
+static TEE_Result open_perf_run(uint32_t num_blocks, uint32_t count,
+				uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	if (!num_blocks || num_blocks > TEST_PERF_MAX_BLOCKS || !count)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	return open_perf(num_blocks, count, times_us);
+}
+
+static const struct perf_test open_perf_test = {
+	.name = "htree",
+	.labels = { "open", "sync" },
+	.run = open_perf_run,
+};
+
+TEE_Result core_fs_htree_perf_tests(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS])
+{
+	return core_perf_test(&open_perf_test, param_types, params);
+}
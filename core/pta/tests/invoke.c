@@ -425,6 +425,8 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 #if defined(CFG_REE_FS) && defined(CFG_WITH_USER_TA)
 	case PTA_INVOKE_TESTS_CMD_FS_HTREE:
 		return core_fs_htree_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_FS_HTREE_PERF:
+		return core_fs_htree_perf_tests(nParamTypes, pParams);
 #endif
 	case PTA_INVOKE_TESTS_CMD_MUTEX:
 		return core_mutex_tests(nParamTypes, pParams);
@@ -432,6 +434,12 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 		return core_lockdep_tests(nParamTypes, pParams);
 	case PTA_INVOKE_TEST_CMD_AES_PERF:
 		return core_aes_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MM_PERF:
+		return core_mm_perf_tests(nParamTypes, pParams);
+#ifdef CFG_RPMB_FS
+	case PTA_INVOKE_TESTS_CMD_RPMB_PERF:
+		return core_rpmb_perf_tests(nParamTypes, pParams);
+#endif
 	default:
 		break;
 	}
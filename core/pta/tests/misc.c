@@ -2,10 +2,14 @@
 /*
  * Copyright (c) 2014, STMicroelectronics International N.V.
  */
+#include <arm.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <malloc.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <trace.h>
+#include <kernel/delay.h>
 #include <kernel/panic.h>
 #include <util.h>
 
@@ -548,6 +552,56 @@ static int self_test_nex_malloc(void)
 	return 0;
 }
 #endif
+uint32_t perf_elapsed_us(uint64_t start)
+{
+	return arm_cnt_cnt2ns(barrier_read_counter_timer() - start) / 1000;
+}
+
+TEE_Result core_perf_test(const struct perf_test *test, uint32_t param_types,
+			  TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t times_us[PERF_TEST_MAX_TIMES] = { };
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	char summary[128] = { };
+	size_t num = 0;
+	size_t len = 0;
+	size_t n = 0;
+
+	while (num < PERF_TEST_MAX_TIMES && test->labels[num])
+		num++;
+	if (num > 2)
+		exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					 TEE_PARAM_TYPE_VALUE_OUTPUT,
+					 TEE_PARAM_TYPE_VALUE_OUTPUT,
+					 TEE_PARAM_TYPE_NONE);
+	if (param_types != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = test->run(params[0].value.a, params[0].value.b, times_us);
+	if (res)
+		return res;
+
+	for (n = 0; n < num; n++) {
+		if (n % 2)
+			params[1 + n / 2].value.b = times_us[n];
+		else
+			params[1 + n / 2].value.a = times_us[n];
+		if (len < sizeof(summary))
+			len += snprintf(summary + len, sizeof(summary) - len,
+					"%s %s %"PRIu32" us", n ? "," : "",
+					test->labels[n], times_us[n]);
+	}
+
+	IMSG("%s %"PRIu32" %"PRIu32":%s", test->name, params[0].value.a,
+	     params[0].value.b, summary);
+
+	return TEE_SUCCESS;
+}
+
 /* exported entry points for some basic test */
 TEE_Result core_self_tests(uint32_t nParamTypes __unused,
 		TEE_Param pParams[TEE_NUM_PARAMS] __unused)
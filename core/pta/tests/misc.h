@@ -9,6 +9,36 @@
 #include <tee_api_types.h>
 #include <tee_api_defines.h>
 
+/* Maximum number of times measured by a struct perf_test */
+#define PERF_TEST_MAX_TIMES	4
+
+/*
+ * struct perf_test - benchmark run by core_perf_test()
+ * @name:	first word of the summary printed after a run
+ * @labels:	names of the measured times, fewer than PERF_TEST_MAX_TIMES
+ *		are terminated by a NULL
+ * @run:	runs the benchmark with the two input values and stores the
+ *		measured times, in microseconds, in @times_us. Returns
+ *		TEE_ERROR_BAD_PARAMETERS if the input is out of range.
+ */
+struct perf_test {
+	const char *name;
+	const char *labels[PERF_TEST_MAX_TIMES];
+	TEE_Result (*run)(uint32_t a, uint32_t b,
+			  uint32_t times_us[PERF_TEST_MAX_TIMES]);
+};
+
+/* Returns the microseconds since @start, a barrier_read_counter_timer() */
+uint32_t perf_elapsed_us(uint64_t start);
+
+/*
+ * Runs @test with the input from params[0].value. The measured times are
+ * returned in params[1].value.a, params[1].value.b, params[2].value.a and
+ * so on, params[2] is only expected if more than two times are measured.
+ */
+TEE_Result core_perf_test(const struct perf_test *test, uint32_t param_types,
+			  TEE_Param params[TEE_NUM_PARAMS]);
+
 /* basic run-time tests */
 TEE_Result core_self_tests(uint32_t nParamTypes,
 			   TEE_Param pParams[TEE_NUM_PARAMS]);
@@ -16,6 +46,9 @@ TEE_Result core_self_tests(uint32_t nParamTypes,
 TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 			       TEE_Param pParams[TEE_NUM_PARAMS]);
 
+TEE_Result core_fs_htree_perf_tests(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS]);
+
 TEE_Result core_mutex_tests(uint32_t nParamTypes,
 			    TEE_Param pParams[TEE_NUM_PARAMS]);
 
@@ -34,4 +67,10 @@ static inline TEE_Result core_lockdep_tests(
 TEE_Result core_aes_perf_tests(uint32_t param_types,
 			       TEE_Param params[TEE_NUM_PARAMS]);
 
+TEE_Result core_mm_perf_tests(uint32_t param_types,
+			      TEE_Param params[TEE_NUM_PARAMS]);
+
+TEE_Result core_rpmb_perf_tests(uint32_t param_types,
+				TEE_Param params[TEE_NUM_PARAMS]);
+
 #endif /*CORE_PTA_TESTS_MISC_H*/
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2024, Linaro Limited
+ */
+
+#include <arm.h>
+#include <kernel/ts_manager.h>
+#include <malloc.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_pobj.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+/* Largest object used by the test, the RPMB partition is usually small */
+#define TEST_MAX_SIZE		(64 * 1024)
+
+static const char test_obj_id[] = "rpmb_perf";
+
+/*
+ * Creates an object of @size bytes in RPMB storage, measures writing and
+ * reading the entire object @count times and removes the object again.
+ */
+static TEE_Result rpmb_perf(size_t size, size_t count,
+			    uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct tee_file_handle *fh = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_pobj *po = NULL;
+	uint8_t *buf = NULL;
+	uint64_t t = 0;
+	size_t len = 0;
+	size_t n = 0;
+
+	buf = malloc(size);
+	if (!buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memset(buf, 0x5a, size);
+
+	res = tee_pobj_get(&sess->ctx->uuid, (void *)test_obj_id,
+			   sizeof(test_obj_id), TEE_DATA_FLAG_ACCESS_READ |
+			   TEE_DATA_FLAG_ACCESS_WRITE, TEE_POBJ_USAGE_CREATE,
+			   &rpmb_fs_ops, &po);
+	if (res)
+		goto out_free;
+
+	res = rpmb_fs_ops.create(po, true, NULL, 0, NULL, 0, buf, size, &fh);
+	if (res)
+		goto out_release;
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < count; n++) {
+		buf[0] = n;
+		res = rpmb_fs_ops.write(fh, 0, buf, size);
+		if (res)
+			goto out_close;
+	}
+	times_us[0] = perf_elapsed_us(t);
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < count; n++) {
+		len = size;
+		res = rpmb_fs_ops.read(fh, 0, buf, &len);
+		if (res)
+			goto out_close;
+		if (len != size) {
+			res = TEE_ERROR_CORRUPT_OBJECT;
+			goto out_close;
+		}
+	}
+	times_us[1] = perf_elapsed_us(t);
+
+out_close:
+	rpmb_fs_ops.close(&fh);
+	rpmb_fs_ops.remove(po);
+out_release:
+	tee_pobj_release(po);
+out_free:
+	free(buf);
+	return res;
+}
+
+/* An object of @size bytes written and read @count times */
+static TEE_Result rpmb_perf_run(uint32_t size, uint32_t count,
+				uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	if (!size || size > TEST_MAX_SIZE || !count)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	return rpmb_perf(size, count, times_us);
+}
+
+static const struct perf_test rpmb_perf_test = {
+	.name = "rpmb",
+	.labels = { "write", "read" },
+	.run = rpmb_perf_run,
+};
+
+TEE_Result core_rpmb_perf_tests(uint32_t param_types,
+				TEE_Param params[TEE_NUM_PARAMS])
+{
+	return core_perf_test(&rpmb_perf_test, param_types, params);
+}
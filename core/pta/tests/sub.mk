@@ -5,3 +5,5 @@ srcs-y += misc.c
 cflags-misc.c-y += -fno-builtin
 srcs-y += mutex.c
 srcs-y += aes_perf.c
+srcs-y += tee_mm_perf.c
+srcs-$(CFG_RPMB_FS) += rpmb_perf.c
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <arm.h>
+#include <malloc.h>
+#include <mm/core_mmu.h>
+#include <mm/tee_mm.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+/*
+ * The pool only manages addresses, nothing is ever mapped at this base so
+ * any page aligned value will do.
+ */
+#define TEST_POOL_BASE		0x40000000
+
+/*
+ * Fills a pool with @num single page entries, frees every second entry to
+ * leave @num / 2 one page holes and then measures allocating two page
+ * entries which don't fit in any of the holes, looking up every page and
+ * freeing everything.
+ */
+static TEE_Result mm_perf(uint32_t flags, size_t num,
+			  uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	TEE_Result res = TEE_ERROR_OUT_OF_MEMORY;
+	tee_mm_entry_t **mm = NULL;
+	tee_mm_pool_t pool = { };
+	size_t num_big = num / 2;
+	uint64_t t = 0;
+	size_t n = 0;
+
+	mm = calloc(num + num_big, sizeof(*mm));
+	if (!mm)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	if (!tee_mm_init(&pool, TEST_POOL_BASE,
+			 (num + num_big * 2) * SMALL_PAGE_SIZE,
+			 SMALL_PAGE_SHIFT, flags))
+		goto out;
+
+	for (n = 0; n < num; n++) {
+		mm[n] = tee_mm_alloc(&pool, SMALL_PAGE_SIZE);
+		if (!mm[n])
+			goto out;
+	}
+	for (n = 0; n < num; n += 2) {
+		tee_mm_free(mm[n]);
+		mm[n] = NULL;
+	}
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < num_big; n++) {
+		mm[num + n] = tee_mm_alloc(&pool, 2 * SMALL_PAGE_SIZE);
+		if (!mm[num + n])
+			goto out;
+	}
+	times_us[0] = perf_elapsed_us(t);
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < pool.size; n += SMALL_PAGE_SIZE)
+		tee_mm_find(&pool, pool.lo + n);
+	times_us[1] = perf_elapsed_us(t);
+
+	t = barrier_read_counter_timer();
+	for (n = 0; n < num + num_big; n++) {
+		tee_mm_free(mm[n]);
+		mm[n] = NULL;
+	}
+	times_us[2] = perf_elapsed_us(t);
+
+	res = TEE_SUCCESS;
+out:
+	for (n = 0; n < num + num_big; n++)
+		tee_mm_free(mm[n]);
+	tee_mm_final(&pool);
+	free(mm);
+	return res;
+}
+
+/* @num entries, allocated from the top of the pool if @hi_alloc is set */
+static TEE_Result mm_perf_run(uint32_t num, uint32_t hi_alloc,
+			      uint32_t times_us[PERF_TEST_MAX_TIMES])
+{
+	uint32_t flags = 0;
+
+	if (hi_alloc)
+		flags = TEE_MM_POOL_HI_ALLOC;
+
+	if (num < 2 || num > UINT16_MAX)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	return mm_perf(flags, num, times_us);
+}
+
+static const struct perf_test mm_perf_test = {
+	.name = "tee_mm",
+	.labels = { "alloc", "find", "free" },
+	.run = mm_perf_run,
+};
+
+TEE_Result core_mm_perf_tests(uint32_t param_types,
+			      TEE_Param params[TEE_NUM_PARAMS])
+{
+	return core_perf_test(&mm_perf_test, param_types, params);
+}
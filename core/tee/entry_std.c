@@ -4,6 +4,7 @@
  * Copyright (c) 2014, STMicroelectronics International N.V.
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <bench.h>
 #include <compiler.h>
@@ -520,6 +521,226 @@ static void unregister_shm(struct optee_msg_arg *arg, uint32_t num_params)
 #endif /*CFG_CORE_DYN_SHM*/
 #endif
 
+#ifdef CFG_CORE_INVOKE_RING
+/*
+ * The registered invoke ring, see struct optee_msg_ring. The geometry
+ * and the consumer index are kept in secure memory so that normal world
+ * can't change them under our feet. @invoke_ring_mu serializes
+ * registration and the threads draining the ring.
+ */
+static struct mutex invoke_ring_mu = MUTEX_INITIALIZER;
+static struct mobj *invoke_ring_mobj;
+static struct optee_msg_ring *invoke_ring;
+static uint32_t invoke_ring_num_slots;
+static uint32_t invoke_ring_slot_size;
+static uint32_t invoke_ring_cons;
+static uint32_t invoke_ring_notif_value;
+
+static TEE_Result map_invoke_ring(struct param_mem *mem)
+{
+	struct optee_msg_ring *ring = NULL;
+	uint32_t num_slots = 0;
+	uint32_t slot_size = 0;
+	size_t sz = 0;
+
+	if (mem->size < sizeof(*ring))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (mobj_inc_map(mem->mobj))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	ring = mobj_get_va(mem->mobj, mem->offs, mem->size);
+	if (!ring || !IS_ALIGNED_WITH_TYPE(ring, uint64_t))
+		goto err;
+
+	num_slots = READ_ONCE(ring->num_slots);
+	slot_size = READ_ONCE(ring->slot_size);
+	if (!IS_POWER_OF_TWO(num_slots) || slot_size % sizeof(uint64_t) ||
+	    slot_size < OPTEE_MSG_GET_ARG_SIZE(0) ||
+	    MUL_OVERFLOW(num_slots, slot_size, &sz) ||
+	    ADD_OVERFLOW(sz, sizeof(*ring), &sz) || sz > mem->size)
+		goto err;
+
+	invoke_ring = ring;
+	invoke_ring_num_slots = num_slots;
+	invoke_ring_slot_size = slot_size;
+	invoke_ring_cons = 0;
+
+	return TEE_SUCCESS;
+err:
+	mobj_dec_map(mem->mobj);
+	return TEE_ERROR_BAD_PARAMETERS;
+}
+
+static void register_invoke_ring(struct optee_msg_arg *arg,
+				 uint32_t num_params)
+{
+	TEE_Result res = TEE_ERROR_BAD_PARAMETERS;
+	uint64_t saved_attr[TEE_NUM_PARAMS] = { 0 };
+	struct tee_ta_param param = { 0 };
+
+	if (num_params != 1)
+		goto out;
+
+	res = copy_in_params(arg->params, num_params, &param, saved_attr);
+	if (res)
+		goto out;
+
+	if (TEE_PARAM_TYPE_GET(param.types, 0) !=
+	    TEE_PARAM_TYPE_MEMREF_INOUT || !param.u[0].mem.mobj) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+
+	mutex_lock(&invoke_ring_mu);
+
+	if (invoke_ring) {
+		res = TEE_ERROR_BAD_STATE;
+		goto out_unlock;
+	}
+
+	res = notif_alloc_async_value(&invoke_ring_notif_value);
+	if (res)
+		goto out_unlock;
+
+	res = map_invoke_ring(&param.u[0].mem);
+	if (res) {
+		notif_free_async_value(invoke_ring_notif_value);
+		goto out_unlock;
+	}
+
+	/* The reference from copy_in_params() is kept by the ring */
+	invoke_ring_mobj = param.u[0].mem.mobj;
+	param.u[0].mem.mobj = NULL;
+
+	WRITE_ONCE(invoke_ring->cons, 0);
+	WRITE_ONCE(invoke_ring->flags, 0);
+	WRITE_ONCE(invoke_ring->notif_value, invoke_ring_notif_value);
+
+out_unlock:
+	mutex_unlock(&invoke_ring_mu);
+out:
+	cleanup_shm_refs(saved_attr, &param, num_params);
+	arg->ret = res;
+	arg->ret_origin = TEE_ORIGIN_TEE;
+}
+
+static void unregister_invoke_ring(struct optee_msg_arg *arg,
+				   uint32_t num_params)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (num_params) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+
+	mutex_lock(&invoke_ring_mu);
+
+	if (invoke_ring) {
+		mobj_dec_map(invoke_ring_mobj);
+		mobj_put(invoke_ring_mobj);
+		notif_free_async_value(invoke_ring_notif_value);
+		invoke_ring_mobj = NULL;
+		invoke_ring = NULL;
+	} else {
+		res = TEE_ERROR_BAD_STATE;
+	}
+
+	mutex_unlock(&invoke_ring_mu);
+out:
+	arg->ret = res;
+	arg->ret_origin = TEE_ORIGIN_TEE;
+}
+
+static void invoke_ring_serve(uint32_t idx)
+{
+	vaddr_t slots = (vaddr_t)(invoke_ring + 1);
+	struct optee_msg_arg *arg = NULL;
+	uint32_t num_params = 0;
+
+	arg = (void *)(slots + (idx & (invoke_ring_num_slots - 1)) *
+			       invoke_ring_slot_size);
+	num_params = READ_ONCE(arg->num_params);
+	if (READ_ONCE(arg->cmd) != OPTEE_MSG_CMD_INVOKE_COMMAND ||
+	    num_params > OPTEE_MSG_MAX_NUM_PARAMS ||
+	    OPTEE_MSG_GET_ARG_SIZE(num_params) > invoke_ring_slot_size) {
+		arg->ret = TEE_ERROR_BAD_PARAMETERS;
+		arg->ret_origin = TEE_ORIGIN_TEE;
+		return;
+	}
+
+	entry_invoke_command(arg, num_params);
+}
+
+/*
+ * Serves queued requests until the ring is empty. Clearing
+ * OPTEE_MSG_RING_FLAG_DRAINING and reading @prod again pairs with normal
+ * world updating @prod and then reading the flag, a request is either
+ * seen here or normal world sees the flag cleared and issues another
+ * drain call.
+ */
+static void drain_invoke_ring(struct optee_msg_arg *arg, uint32_t num_params)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t prod = 0;
+
+	if (num_params) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+
+	mutex_lock(&invoke_ring_mu);
+
+	if (!invoke_ring) {
+		res = TEE_ERROR_BAD_STATE;
+		goto out_unlock;
+	}
+
+	WRITE_ONCE(invoke_ring->flags, OPTEE_MSG_RING_FLAG_DRAINING);
+	while (true) {
+		dsb_ish();
+		prod = READ_ONCE(invoke_ring->prod);
+		if (prod == invoke_ring_cons) {
+			WRITE_ONCE(invoke_ring->flags, 0);
+			dsb_ish();
+			if (READ_ONCE(invoke_ring->prod) == invoke_ring_cons)
+				break;
+			WRITE_ONCE(invoke_ring->flags,
+				   OPTEE_MSG_RING_FLAG_DRAINING);
+			continue;
+		}
+
+		if (prod - invoke_ring_cons > invoke_ring_num_slots) {
+			EMSG("Bad invoke ring prod %"PRIu32" cons %"PRIu32,
+			     prod, invoke_ring_cons);
+			WRITE_ONCE(invoke_ring->flags, 0);
+			res = TEE_ERROR_BAD_STATE;
+			break;
+		}
+
+		/* Read the requests only after @prod */
+		dsb_ish();
+		while (invoke_ring_cons != prod) {
+			invoke_ring_serve(invoke_ring_cons);
+			invoke_ring_cons++;
+			/* Results must be visible before @cons */
+			dsb_ish();
+			WRITE_ONCE(invoke_ring->cons, invoke_ring_cons);
+		}
+
+		if (notif_async_is_started())
+			notif_send_async(invoke_ring_notif_value);
+	}
+
+out_unlock:
+	mutex_unlock(&invoke_ring_mu);
+out:
+	arg->ret = res;
+	arg->ret_origin = TEE_ORIGIN_TEE;
+}
+#endif /*CFG_CORE_INVOKE_RING*/
+
 void nsec_sessions_list_head(struct tee_ta_session_head **open_sessions)
 {
 	*open_sessions = &tee_open_sessions;
@@ -577,6 +798,17 @@ uint32_t __tee_entry_std(struct optee_msg_arg *arg, uint32_t num_params)
 		else
 			goto err;
 		break;
+#ifdef CFG_CORE_INVOKE_RING
+	case OPTEE_MSG_CMD_REGISTER_INVOKE_RING:
+		register_invoke_ring(arg, num_params);
+		break;
+	case OPTEE_MSG_CMD_DRAIN_INVOKE_RING:
+		drain_invoke_ring(arg, num_params);
+		break;
+	case OPTEE_MSG_CMD_UNREGISTER_INVOKE_RING:
+		unregister_invoke_ring(arg, num_params);
+		break;
+#endif
 
 	default:
 err:
@@ -10,13 +10,47 @@
 #include <string.h>
 #include <tee/fs_dirfile.h>
 #include <types_ext.h>
+#include <util.h>
+
+#define DIRFILE_INDEX_MIN_ENTRIES	16
+
+/*
+ * In-memory index of the dirfile entries, rebuilt each time the dirfile
+ * is opened and updated with each entry written.
+ *
+ * Used entries are hashed on UUID and object ID into @buckets where
+ * entries with the same bucket are chained using @next. A match in the
+ * index is confirmed by reading the entry, so normally only one entry
+ * is read and decrypted per lookup.
+ *
+ * @key_hash:	key hash of each entry, valid if the entry is set in @used
+ * @next:	next entry in the same bucket, or -1
+ * @used:	bitmap of used entries
+ * @cap:	number of entries allocated in the arrays above
+ * @buckets:	first entry of each bucket, or -1
+ * @nbuckets:	number of buckets, a power of 2
+ * @count:	number of used entries
+ * @free_hint:	all entries below this index are used
+ */
+struct dirfile_index {
+	uint32_t *key_hash;
+	int *next;
+	bitstr_t *used;
+	int cap;
+	int *buckets;
+	int nbuckets;
+	int count;
+	int free_hint;
+};
 
 struct tee_fs_dirfile_dirh {
 	const struct tee_fs_dirfile_operations *fops;
 	struct tee_file_handle *fh;
 	int nbits;
 	bitstr_t *files;
+	int files_free_hint;
 	size_t ndents;
+	struct dirfile_index index;
 };
 
 struct dirfile_entry {
@@ -37,6 +71,151 @@ struct dirfile_entry {
  * where n the index is disconnected from file_number in struct dirfile_entry
  */
 
+/* Returns the first clear bit from @start or @nbits if there is none */
+static int find_clear_bit(bitstr_t *b, int start, int nbits)
+{
+	int i = start;
+
+	while (i < nbits) {
+		if (!(i & 7) && b[_bit_byte(i)] == 0xff) {
+			i += 8;
+			continue;
+		}
+		if (!bit_test(b, i))
+			return i;
+		i++;
+	}
+
+	return nbits;
+}
+
+static uint32_t dent_key_hash(const TEE_UUID *uuid, const void *oid,
+			      size_t oidlen)
+{
+	const uint8_t *p = (const uint8_t *)uuid;
+	uint32_t h = 2166136261;	/* FNV-1a */
+	size_t n = 0;
+
+	for (n = 0; n < sizeof(*uuid); n++)
+		h = (h ^ p[n]) * 16777619;
+	p = oid;
+	for (n = 0; n < oidlen; n++)
+		h = (h ^ p[n]) * 16777619;
+
+	return h;
+}
+
+static void index_free(struct dirfile_index *ix)
+{
+	free(ix->key_hash);
+	free(ix->next);
+	free(ix->used);
+	free(ix->buckets);
+}
+
+static void index_insert(struct dirfile_index *ix, int n)
+{
+	int b = ix->key_hash[n] & (ix->nbuckets - 1);
+
+	ix->next[n] = ix->buckets[b];
+	ix->buckets[b] = n;
+}
+
+static void index_rehash(struct dirfile_index *ix, int nbuckets)
+{
+	int *buckets = malloc(nbuckets * sizeof(*buckets));
+	int n = 0;
+
+	/* Keep the current buckets, it's only slower */
+	if (!buckets)
+		return;
+
+	free(ix->buckets);
+	ix->buckets = buckets;
+	ix->nbuckets = nbuckets;
+	for (n = 0; n < nbuckets; n++)
+		ix->buckets[n] = -1;
+
+	for (n = 0; n < ix->cap; n++)
+		if (bit_test(ix->used, n))
+			index_insert(ix, n);
+}
+
+/*
+ * Makes sure that entry @n can be added to the index without allocating
+ * memory, done before the entry is written to keep the index coherent
+ * with the dirfile.
+ */
+static TEE_Result index_reserve(struct dirfile_index *ix, int n)
+{
+	int cap = MAX(ix->cap * 2, DIRFILE_INDEX_MIN_ENTRIES);
+	void *p = NULL;
+
+	if (!ix->nbuckets) {
+		index_rehash(ix, DIRFILE_INDEX_MIN_ENTRIES);
+		if (!ix->nbuckets)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (n < ix->cap)
+		return TEE_SUCCESS;
+
+	cap = MAX(cap, n + 1);
+
+	p = realloc(ix->key_hash, cap * sizeof(*ix->key_hash));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->key_hash = p;
+
+	p = realloc(ix->next, cap * sizeof(*ix->next));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->next = p;
+
+	p = realloc(ix->used, bitstr_size(cap));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->used = p;
+
+	bit_nclear(ix->used, ix->cap, cap - 1);
+	ix->cap = cap;
+
+	return TEE_SUCCESS;
+}
+
+static void index_add(struct dirfile_index *ix, int n,
+		      const struct dirfile_entry *dent)
+{
+	assert(n < ix->cap && !bit_test(ix->used, n));
+
+	ix->key_hash[n] = dent_key_hash(&dent->uuid, dent->oid, dent->oidlen);
+	bit_set(ix->used, n);
+	ix->count++;
+	index_insert(ix, n);
+
+	if (ix->count > ix->nbuckets)
+		index_rehash(ix, ix->nbuckets * 2);
+}
+
+static void index_remove(struct dirfile_index *ix, int n)
+{
+	int *p = NULL;
+
+	if (n >= ix->cap || !bit_test(ix->used, n))
+		return;
+
+	p = ix->buckets + (ix->key_hash[n] & (ix->nbuckets - 1));
+	while (*p != n) {
+		assert(*p >= 0);
+		p = ix->next + *p;
+	}
+	*p = ix->next[n];
+
+	bit_clear(ix->used, n);
+	ix->count--;
+	ix->free_hint = MIN(ix->free_hint, n);
+}
+
 static TEE_Result maybe_grow_files(struct tee_fs_dirfile_dirh *dirh, int idx)
 {
 	void *p;
@@ -67,8 +246,10 @@ static TEE_Result set_file(struct tee_fs_dirfile_dirh *dirh, int idx)
 
 static void clear_file(struct tee_fs_dirfile_dirh *dirh, int idx)
 {
-	if (idx < dirh->nbits)
+	if (idx < dirh->nbits) {
 		bit_clear(dirh->files, idx);
+		dirh->files_free_hint = MIN(dirh->files_free_hint, idx);
+	}
 }
 
 static bool test_file(struct tee_fs_dirfile_dirh *dirh, int idx)
@@ -99,12 +280,23 @@ static TEE_Result write_dent(struct tee_fs_dirfile_dirh *dirh, size_t n,
 {
 	TEE_Result res;
 
+	res = index_reserve(&dirh->index, n);
+	if (res)
+		return res;
+
 	res = dirh->fops->write(dirh->fh, sizeof(*dent) * n,
 				dent, sizeof(*dent));
-	if (!res && n >= dirh->ndents)
+	if (res)
+		return res;
+
+	if (n >= dirh->ndents)
 		dirh->ndents = n + 1;
 
-	return res;
+	index_remove(&dirh->index, n);
+	if (dent->oidlen)
+		index_add(&dirh->index, n, dent);
+
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
@@ -133,6 +325,10 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 			goto out;
 		}
 
+		res = index_reserve(&dirh->index, n);
+		if (res)
+			goto out;
+
 		if (!dent.oidlen)
 			continue;
 
@@ -149,6 +345,8 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 		res = set_file(dirh, dent.file_number);
 		if (res != TEE_SUCCESS)
 			goto out;
+
+		index_add(&dirh->index, n, &dent);
 	}
 out:
 	if (!res) {
@@ -165,6 +363,7 @@ void tee_fs_dirfile_close(struct tee_fs_dirfile_dirh *dirh)
 	if (dirh) {
 		dirh->fops->close(dirh->fh);
 		free(dirh->files);
+		index_free(&dirh->index);
 		free(dirh);
 	}
 }
@@ -181,11 +380,8 @@ TEE_Result tee_fs_dirfile_get_tmp(struct tee_fs_dirfile_dirh *dirh,
 	TEE_Result res;
 	int i = 0;
 
-	if (dirh->nbits) {
-		bit_ffc(dirh->files, dirh->nbits, &i);
-		if (i == -1)
-			i = dirh->nbits;
-	}
+	i = find_clear_bit(dirh->files, dirh->files_free_hint, dirh->nbits);
+	dirh->files_free_hint = i;
 
 	res = set_file(dirh, i);
 	if (!res)
@@ -198,37 +394,44 @@ TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 			       const TEE_UUID *uuid, const void *oid,
 			       size_t oidlen, struct tee_fs_dirfile_fileh *dfh)
 {
+	struct dirfile_index *ix = &dirh->index;
+	struct dirfile_entry dent = { };
+	uint32_t key_hash = 0;
 	TEE_Result res;
-	struct dirfile_entry dent;
-	int n;
-	int first_free = -1;
+	int n = 0;
 
-	for (n = 0;; n++) {
-		res = read_dent(dirh, n, &dent);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND && !oidlen) {
-			memset(&dent, 0, sizeof(dent));
-			if (first_free != -1)
-				n = first_free;
-			break;
-		}
-		if (res)
-			return res;
+	if (!oidlen) {
+		/* Find a free entry, or append one */
+		n = find_clear_bit(ix->used, ix->free_hint,
+				   MIN(ix->cap, (int)dirh->ndents));
+		ix->free_hint = n;
+		goto out;
+	}
 
-		/* TODO check this loop when oidlen == 0 */
+	if (!ix->nbuckets)
+		return TEE_ERROR_ITEM_NOT_FOUND;
 
-		if (!dent.oidlen && first_free == -1)
-			first_free = n;
-		if (dent.oidlen != oidlen)
+	key_hash = dent_key_hash(uuid, oid, oidlen);
+	for (n = ix->buckets[key_hash & (ix->nbuckets - 1)]; n >= 0;
+	     n = ix->next[n]) {
+		if (ix->key_hash[n] != key_hash)
 			continue;
 
-		assert(!oidlen || !dent.oidlen ||
-		       test_file(dirh, dent.file_number));
+		res = read_dent(dirh, n, &dent);
+		if (res)
+			return res;
 
-		if (!memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
+		assert(dent.oidlen && test_file(dirh, dent.file_number));
+
+		if (dent.oidlen == oidlen &&
+		    !memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
 		    !memcmp(&dent.oid, oid, oidlen))
-			break;
+			goto out;
 	}
 
+	return TEE_ERROR_ITEM_NOT_FOUND;
+
+out:
 	if (dfh) {
 		dfh->idx = n;
 		dfh->file_number = dent.file_number;
@@ -348,6 +551,11 @@ TEE_Result tee_fs_dirfile_get_next(struct tee_fs_dirfile_dirh *dirh,
 		i = 0;
 
 	for (;; i++) {
+		if (i >= (int)dirh->ndents)
+			return TEE_ERROR_ITEM_NOT_FOUND;
+		/* Skip free entries without reading them */
+		if (i < dirh->index.cap && !bit_test(dirh->index.used, i))
+			continue;
 		res = read_dent(dirh, i, &dent);
 		if (res)
 			return res;
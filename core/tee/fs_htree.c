@@ -4,10 +4,13 @@
  */
 
 #include <assert.h>
+#include <atomic.h>
 #include <crypto/crypto.h>
+#include <crypto/internal_aes-gcm.h>
 #include <initcall.h>
 #include <kernel/tee_common_otp.h>
 #include <stdlib.h>
+#include <stdlib_ext.h>
 #include <string_ext.h>
 #include <string.h>
 #include <tee/fs_htree.h>
@@ -85,17 +88,34 @@ struct htree_node {
 	struct htree_node *child[2];
 };
 
+/*
+ * A decrypted and authenticated data block. The cache is write-through
+ * so a cached block always matches the block in storage.
+ */
+struct htree_cache_block {
+	size_t block_num;
+	unsigned int stamp;
+	bool valid;
+	uint8_t *data;
+};
+
 struct tee_fs_htree {
 	struct htree_node root;
 	struct tee_fs_htree_image head;
-	uint8_t fek[TEE_FS_HTREE_FEK_SIZE];
+	struct internal_aes_gcm_key fek_key;
 	struct tee_fs_htree_imeta imeta;
 	bool dirty;
 	const TEE_UUID *uuid;
 	const struct tee_fs_htree_storage *stor;
 	void *stor_aux;
+	struct htree_cache_block *cache;
+	size_t cache_blocks;
+	unsigned int cache_stamp;
 };
 
+static uint32_t cache_hits;
+static uint32_t cache_misses;
+
 struct traverse_arg;
 typedef TEE_Result (*traverse_cb_t)(struct traverse_arg *targ,
 				    struct htree_node *node);
@@ -105,6 +125,119 @@ struct traverse_arg {
 	void *arg;
 };
 
+static struct htree_cache_block *cache_find(struct tee_fs_htree *ht,
+					    size_t block_num)
+{
+	size_t n = 0;
+
+	if (!ht->cache)
+		return NULL;
+
+	for (n = 0; n < ht->cache_blocks; n++)
+		if (ht->cache[n].valid && ht->cache[n].block_num == block_num)
+			return ht->cache + n;
+
+	return NULL;
+}
+
+static bool cache_read(struct tee_fs_htree *ht, size_t block_num, void *block)
+{
+	struct htree_cache_block *cb = NULL;
+
+	if (!CFG_REE_FS_HTREE_CACHE_BLOCKS)
+		return false;
+
+	cb = cache_find(ht, block_num);
+	if (!cb) {
+		atomic_inc32(&cache_misses);
+		return false;
+	}
+
+	cb->stamp = ++ht->cache_stamp;
+	memcpy(block, cb->data, ht->stor->block_size);
+	atomic_inc32(&cache_hits);
+
+	return true;
+}
+
+/* Caches a block, replacing the least recently used block if needed */
+static void cache_store(struct tee_fs_htree *ht, size_t block_num,
+			const void *block)
+{
+	struct htree_cache_block *cb = NULL;
+	size_t n = 0;
+
+	if (!CFG_REE_FS_HTREE_CACHE_BLOCKS)
+		return;
+
+	if (!ht->cache) {
+		ht->cache = calloc(CFG_REE_FS_HTREE_CACHE_BLOCKS,
+				   sizeof(*ht->cache));
+		if (!ht->cache)
+			return;
+		ht->cache_blocks = CFG_REE_FS_HTREE_CACHE_BLOCKS;
+	}
+
+	cb = cache_find(ht, block_num);
+	if (!cb) {
+		cb = ht->cache;
+		for (n = 1; n < ht->cache_blocks; n++) {
+			if (!cb->valid)
+				break;
+			if (!ht->cache[n].valid ||
+			    ht->cache[n].stamp < cb->stamp)
+				cb = ht->cache + n;
+		}
+	}
+
+	if (!cb->data) {
+		cb->data = malloc(ht->stor->block_size);
+		if (!cb->data)
+			return;
+	}
+
+	memcpy(cb->data, block, ht->stor->block_size);
+	cb->block_num = block_num;
+	cb->stamp = ++ht->cache_stamp;
+	cb->valid = true;
+}
+
+/* Invalidates the cached blocks from @block_num up to @block_num + @num */
+static void cache_invalidate(struct tee_fs_htree *ht, size_t block_num,
+			     size_t num)
+{
+	size_t n = 0;
+
+	if (!ht->cache)
+		return;
+
+	for (n = 0; n < ht->cache_blocks; n++)
+		if (ht->cache[n].block_num >= block_num &&
+		    ht->cache[n].block_num - block_num < num)
+			ht->cache[n].valid = false;
+}
+
+static void cache_free(struct tee_fs_htree *ht)
+{
+	size_t n = 0;
+
+	if (!ht->cache)
+		return;
+
+	for (n = 0; n < ht->cache_blocks; n++)
+		free_wipe(ht->cache[n].data);
+	free(ht->cache);
+	ht->cache = NULL;
+}
+
+void tee_fs_htree_get_stats(struct tee_fs_htree_stats *stats)
+{
+	stats->cache_hits = atomic_load_u32(&cache_hits);
+	stats->cache_misses = atomic_load_u32(&cache_misses);
+	atomic_store_u32(&cache_hits, 0);
+	atomic_store_u32(&cache_misses, 0);
+}
+
 static TEE_Result rpc_read(struct tee_fs_htree *ht, enum tee_fs_htree_type type,
 			   size_t idx, size_t vers, void *data, size_t dlen)
 {
@@ -435,163 +568,248 @@ static TEE_Result calc_node_hash(struct htree_node *node,
 	return crypto_hash_final(ctx, digest, TEE_FS_HTREE_HASH_SIZE);
 }
 
-static TEE_Result authenc_init(void **ctx_ret, TEE_OperationMode mode,
-			       struct tee_fs_htree *ht,
-			       struct tee_fs_htree_node_image *ni,
-			       size_t payload_len)
-{
-	TEE_Result res = TEE_SUCCESS;
-	const uint32_t alg = TEE_FS_HTREE_AUTH_ENC_ALG;
-	void *ctx;
-	size_t aad_len = TEE_FS_HTREE_FEK_SIZE + TEE_FS_HTREE_IV_SIZE;
-	uint8_t *iv;
-
-	if (ni) {
-		iv = ni->iv;
-	} else {
-		iv = ht->head.iv;
-		aad_len += TEE_FS_HTREE_HASH_SIZE + sizeof(ht->head.counter);
-	}
+/*
+ * The AAD of the root is the first TEE_FS_HTREE_FEK_SIZE bytes of the root
+ * hash and the counter, followed by the encrypted FEK and the IV as for
+ * all other nodes.
+ */
+#define HTREE_AAD_MAX_SIZE	(TEE_FS_HTREE_FEK_SIZE + sizeof(uint32_t) + \
+				 TEE_FS_HTREE_FEK_SIZE + TEE_FS_HTREE_IV_SIZE)
 
-	if (mode == TEE_MODE_ENCRYPT) {
-		res = crypto_rng_read(iv, TEE_FS_HTREE_IV_SIZE);
-		if (res != TEE_SUCCESS)
-			return res;
-	}
+static uint8_t *authenc_iv(struct tee_fs_htree *ht,
+			   struct tee_fs_htree_node_image *ni)
+{
+	if (ni)
+		return ni->iv;
+	return ht->head.iv;
+}
 
-	res = crypto_authenc_alloc_ctx(&ctx, alg);
-	if (res != TEE_SUCCESS)
-		return res;
+static size_t authenc_aad(struct tee_fs_htree *ht,
+			  struct tee_fs_htree_node_image *ni,
+			  uint8_t aad[HTREE_AAD_MAX_SIZE])
+{
+	size_t aad_len = 0;
 
-	res = crypto_authenc_init(ctx, mode, ht->fek, TEE_FS_HTREE_FEK_SIZE, iv,
-				  TEE_FS_HTREE_IV_SIZE, TEE_FS_HTREE_TAG_SIZE,
-				  aad_len, payload_len);
-	if (res != TEE_SUCCESS)
-		goto err_free;
+	COMPILE_TIME_ASSERT(sizeof(ht->head.counter) == sizeof(uint32_t));
 
 	if (!ni) {
-		res = crypto_authenc_update_aad(ctx, mode, ht->root.node.hash,
-						TEE_FS_HTREE_FEK_SIZE);
-		if (res != TEE_SUCCESS)
-			goto err;
-
-		res = crypto_authenc_update_aad(ctx, mode,
-						(void *)&ht->head.counter,
-						sizeof(ht->head.counter));
-		if (res != TEE_SUCCESS)
-			goto err;
+		memcpy(aad, ht->root.node.hash, TEE_FS_HTREE_FEK_SIZE);
+		aad_len += TEE_FS_HTREE_FEK_SIZE;
+		memcpy(aad + aad_len, &ht->head.counter,
+		       sizeof(ht->head.counter));
+		aad_len += sizeof(ht->head.counter);
 	}
 
-	res = crypto_authenc_update_aad(ctx, mode, ht->head.enc_fek,
-					TEE_FS_HTREE_FEK_SIZE);
-	if (res != TEE_SUCCESS)
-		goto err;
+	memcpy(aad + aad_len, ht->head.enc_fek, TEE_FS_HTREE_FEK_SIZE);
+	aad_len += TEE_FS_HTREE_FEK_SIZE;
+	memcpy(aad + aad_len, authenc_iv(ht, ni), TEE_FS_HTREE_IV_SIZE);
+	aad_len += TEE_FS_HTREE_IV_SIZE;
+
+	return aad_len;
+}
 
-	res = crypto_authenc_update_aad(ctx, mode, iv, TEE_FS_HTREE_IV_SIZE);
+/*
+ * Authenticated encryption of a data block, or of the root meta data if
+ * @ni is NULL, with the key schedule of the FEK expanded when the FEK
+ * was made available.
+ */
+static TEE_Result authenc_encrypt(struct tee_fs_htree *ht,
+				  struct tee_fs_htree_node_image *ni,
+				  uint8_t *tag, const void *plain, size_t len,
+				  void *crypt)
+{
+	uint8_t aad[HTREE_AAD_MAX_SIZE] = { };
+	size_t tag_len = TEE_FS_HTREE_TAG_SIZE;
+	uint8_t *iv = authenc_iv(ht, ni);
+	TEE_Result res = TEE_SUCCESS;
+	size_t aad_len = 0;
+
+	res = crypto_rng_read(iv, TEE_FS_HTREE_IV_SIZE);
 	if (res != TEE_SUCCESS)
-		goto err;
+		return res;
 
-	*ctx_ret = ctx;
+	aad_len = authenc_aad(ht, ni, aad);
+	res = internal_aes_gcm_enc(&ht->fek_key, iv, TEE_FS_HTREE_IV_SIZE,
+				   aad, aad_len, plain, len, crypt, tag,
+				   &tag_len);
+	if (res == TEE_SUCCESS && tag_len != TEE_FS_HTREE_TAG_SIZE)
+		return TEE_ERROR_GENERIC;
 
-	return TEE_SUCCESS;
-err:
-	crypto_authenc_final(ctx);
-err_free:
-	crypto_authenc_free_ctx(ctx);
 	return res;
 }
 
-static TEE_Result authenc_decrypt_final(void *ctx, const uint8_t *tag,
-					const void *crypt, size_t len,
-					void *plain)
+static TEE_Result authenc_decrypt(struct tee_fs_htree *ht,
+				  struct tee_fs_htree_node_image *ni,
+				  const uint8_t *tag, const void *crypt,
+				  size_t len, void *plain)
 {
-	TEE_Result res;
-	size_t out_size = len;
-
-	res = crypto_authenc_dec_final(ctx, crypt, len, plain, &out_size, tag,
-				       TEE_FS_HTREE_TAG_SIZE);
-	crypto_authenc_final(ctx);
-	crypto_authenc_free_ctx(ctx);
+	uint8_t aad[HTREE_AAD_MAX_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t aad_len = 0;
 
-	if (res == TEE_SUCCESS && out_size != len)
-		return TEE_ERROR_GENERIC;
+	aad_len = authenc_aad(ht, ni, aad);
+	res = internal_aes_gcm_dec(&ht->fek_key, authenc_iv(ht, ni),
+				   TEE_FS_HTREE_IV_SIZE, aad, aad_len, crypt,
+				   len, plain, tag, TEE_FS_HTREE_TAG_SIZE);
 	if (res == TEE_ERROR_MAC_INVALID)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
 	return res;
 }
 
-static TEE_Result authenc_encrypt_final(void *ctx, uint8_t *tag,
-					const void *plain, size_t len,
-					void *crypt)
+/*
+ * Expands the key schedule used for all authenticated encryption of the
+ * file, the plain FEK itself isn't kept.
+ */
+static TEE_Result set_fek(struct tee_fs_htree *ht, const uint8_t *fek)
 {
-	TEE_Result res;
-	size_t out_size = len;
-	size_t out_tag_size = TEE_FS_HTREE_TAG_SIZE;
-
-	res = crypto_authenc_enc_final(ctx, plain, len, crypt, &out_size, tag,
-				       &out_tag_size);
-	crypto_authenc_final(ctx);
-	crypto_authenc_free_ctx(ctx);
-
-	if (res == TEE_SUCCESS &&
-	    (out_size != len || out_tag_size != TEE_FS_HTREE_TAG_SIZE))
-		return TEE_ERROR_GENERIC;
-
-	return res;
+	return crypto_aes_expand_enc_key(fek, TEE_FS_HTREE_FEK_SIZE,
+					 ht->fek_key.data,
+					 sizeof(ht->fek_key.data),
+					 &ht->fek_key.rounds);
 }
 
 static TEE_Result verify_root(struct tee_fs_htree *ht)
 {
-	TEE_Result res;
-	void *ctx;
+	uint8_t fek[TEE_FS_HTREE_FEK_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
 
 	res = tee_fs_fek_crypt(ht->uuid, TEE_MODE_DECRYPT, ht->head.enc_fek,
-			       sizeof(ht->fek), ht->fek);
+			       sizeof(fek), fek);
+	if (res == TEE_SUCCESS)
+		res = set_fek(ht, fek);
+	memzero_explicit(fek, sizeof(fek));
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, NULL, sizeof(ht->imeta));
-	if (res != TEE_SUCCESS)
-		return res;
+	return authenc_decrypt(ht, NULL, ht->head.tag, ht->head.imeta,
+			       sizeof(ht->imeta), &ht->imeta);
+}
+
+/* Number of nodes verified with a single hash_sha256_check_multi() call */
+#define HTREE_VERIFY_BATCH	8
+
+/* Node image except the hash followed by the hashes of up to two children */
+#define HTREE_NODE_HASH_DATA_MAX \
+	(sizeof(struct tee_fs_htree_node_image) + TEE_FS_HTREE_HASH_SIZE)
+
+/*
+ * Nodes below the root are queued by their number of children so that
+ * each queue holds equally sized buffers which can be hashed in parallel
+ * streams. The root node also covers the meta data and is verified
+ * separately.
+ */
+struct verify_batch {
+	size_t num[3];
+	const uint8_t *hashes[3][HTREE_VERIFY_BATCH];
+	const uint8_t *data[3][HTREE_VERIFY_BATCH];
+	uint8_t buf[3][HTREE_VERIFY_BATCH][HTREE_NODE_HASH_DATA_MAX];
+};
+
+static TEE_Result verify_batch_flush(struct verify_batch *vb, size_t nchild)
+{
+	size_t size = sizeof(struct tee_fs_htree_node_image) -
+		      TEE_FS_HTREE_HASH_SIZE +
+		      nchild * TEE_FS_HTREE_HASH_SIZE;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!vb->num[nchild])
+		return TEE_SUCCESS;
+
+	res = hash_sha256_check_multi(vb->hashes[nchild], vb->data[nchild],
+				      size, vb->num[nchild]);
+	vb->num[nchild] = 0;
+	if (res == TEE_ERROR_SECURITY)
+		return TEE_ERROR_CORRUPT_OBJECT;
 
-	return authenc_decrypt_final(ctx, ht->head.tag, ht->head.imeta,
-				     sizeof(ht->imeta), &ht->imeta);
+	return res;
 }
 
 static TEE_Result verify_node(struct traverse_arg *targ,
 			      struct htree_node *node)
 {
-	void *ctx = targ->arg;
-	TEE_Result res;
-	uint8_t digest[TEE_FS_HTREE_HASH_SIZE];
+	struct verify_batch *vb = targ->arg;
+	uint8_t *ndata = (uint8_t *)&node->node + sizeof(node->node.hash);
+	size_t nsize = sizeof(node->node) - sizeof(node->node.hash);
+	size_t nchild = 0;
+	uint8_t *buf = NULL;
+	size_t n = 0;
 
-	if (node->parent)
-		res = calc_node_hash(node, NULL, ctx, digest);
-	else
-		res = calc_node_hash(node, &targ->ht->imeta.meta, ctx, digest);
-	if (res == TEE_SUCCESS &&
-	    consttime_memcmp(digest, node->node.hash, sizeof(digest)))
-		return TEE_ERROR_CORRUPT_OBJECT;
+	if (!node->parent)
+		return TEE_SUCCESS;
 
-	return res;
+	/* Nodes are numbered consecutively, child[0] is used first */
+	if (node->child[1])
+		nchild = 2;
+	else if (node->child[0])
+		nchild = 1;
+
+	n = vb->num[nchild];
+	buf = vb->buf[nchild][n];
+	memcpy(buf, ndata, nsize);
+	if (nchild > 0)
+		memcpy(buf + nsize, node->child[0]->node.hash,
+		       TEE_FS_HTREE_HASH_SIZE);
+	if (nchild > 1)
+		memcpy(buf + nsize + TEE_FS_HTREE_HASH_SIZE,
+		       node->child[1]->node.hash, TEE_FS_HTREE_HASH_SIZE);
+	vb->hashes[nchild][n] = node->node.hash;
+	vb->data[nchild][n] = buf;
+	vb->num[nchild]++;
+
+	if (vb->num[nchild] == HTREE_VERIFY_BATCH)
+		return verify_batch_flush(vb, nchild);
+
+	return TEE_SUCCESS;
 }
 
-static TEE_Result verify_tree(struct tee_fs_htree *ht)
+static TEE_Result verify_root_node(struct tee_fs_htree *ht)
 {
-	TEE_Result res;
-	void *ctx;
+	uint8_t digest[TEE_FS_HTREE_HASH_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
+	void *ctx = NULL;
 
 	res = crypto_hash_alloc_ctx(&ctx, TEE_FS_HTREE_HASH_ALG);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = htree_traverse_post_order(ht, verify_node, ctx);
+	res = calc_node_hash(&ht->root, &ht->imeta.meta, ctx, digest);
 	crypto_hash_free_ctx(ctx);
+	if (res == TEE_SUCCESS &&
+	    consttime_memcmp(digest, ht->root.node.hash, sizeof(digest)))
+		return TEE_ERROR_CORRUPT_OBJECT;
 
 	return res;
 }
 
+/*
+ * Each node is verified against the hashes stored in its children and
+ * since the root hash is authenticated by the head all nodes can be
+ * verified independently of each other. This lets the nodes be hashed in
+ * batches instead of one at a time in post order.
+ */
+static TEE_Result verify_tree(struct tee_fs_htree *ht)
+{
+	struct verify_batch *vb = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	if (ht->root.child[0]) {
+		vb = calloc(1, sizeof(*vb));
+		if (!vb)
+			return TEE_ERROR_OUT_OF_MEMORY;
+
+		res = htree_traverse_post_order(ht, verify_node, vb);
+		for (n = 0; n < ARRAY_SIZE(vb->num) && !res; n++)
+			res = verify_batch_flush(vb, n);
+		free(vb);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return verify_root_node(ht);
+}
+
 static TEE_Result init_root_node(struct tee_fs_htree *ht)
 {
 	TEE_Result res;
@@ -627,13 +845,15 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 
 	if (create) {
 		const struct tee_fs_htree_image dummy_head = { .counter = 0 };
-
-		res = crypto_rng_read(ht->fek, sizeof(ht->fek));
-		if (res != TEE_SUCCESS)
-			goto out;
-
-		res = tee_fs_fek_crypt(ht->uuid, TEE_MODE_ENCRYPT, ht->fek,
-				       sizeof(ht->fek), ht->head.enc_fek);
+		uint8_t fek[TEE_FS_HTREE_FEK_SIZE] = { };
+
+		res = crypto_rng_read(fek, sizeof(fek));
+		if (res == TEE_SUCCESS)
+			res = tee_fs_fek_crypt(ht->uuid, TEE_MODE_ENCRYPT, fek,
+					       sizeof(fek), ht->head.enc_fek);
+		if (res == TEE_SUCCESS)
+			res = set_fek(ht, fek);
+		memzero_explicit(fek, sizeof(fek));
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -693,6 +913,8 @@ void tee_fs_htree_close(struct tee_fs_htree **ht)
 	if (!*ht)
 		return;
 	htree_traverse_post_order(*ht, free_node, NULL);
+	cache_free(*ht);
+	memzero_explicit(&(*ht)->fek_key, sizeof((*ht)->fek_key));
 	free(*ht);
 	*ht = NULL;
 }
@@ -741,17 +963,10 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 
 static TEE_Result update_root(struct tee_fs_htree *ht)
 {
-	TEE_Result res;
-	void *ctx;
-
 	ht->head.counter++;
 
-	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, NULL, sizeof(ht->imeta));
-	if (res != TEE_SUCCESS)
-		return res;
-
-	return authenc_encrypt_final(ctx, ht->head.tag, &ht->imeta,
-				     sizeof(ht->imeta), &ht->head.imeta);
+	return authenc_encrypt(ht, NULL, ht->head.tag, &ht->imeta,
+			       sizeof(ht->imeta), &ht->head.imeta);
 }
 
 TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
@@ -815,7 +1030,6 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 	struct tee_fs_rpc_operation op;
 	struct htree_node *node = NULL;
 	uint8_t block_vers;
-	void *ctx;
 	void *enc_block;
 
 	if (!ht)
@@ -835,12 +1049,8 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
-			   ht->stor->block_size);
-	if (res != TEE_SUCCESS)
-		goto out;
-	res = authenc_encrypt_final(ctx, node->node.tag, block,
-				    ht->stor->block_size, enc_block);
+	res = authenc_encrypt(ht, &node->node, node->node.tag, block,
+			      ht->stor->block_size, enc_block);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -851,6 +1061,7 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 	node->block_updated = true;
 	node->dirty = true;
 	ht->dirty = true;
+	cache_store(ht, block_num, block);
 out:
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
@@ -866,12 +1077,14 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 	struct htree_node *node;
 	uint8_t block_vers;
 	size_t len;
-	void *ctx;
 	void *enc_block;
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
+	if (cache_read(ht, block_num, block))
+		return TEE_SUCCESS;
+
 	res = get_block_node(ht, false, block_num, &node);
 	if (res != TEE_SUCCESS)
 		goto out;
@@ -891,19 +1104,200 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 		goto out;
 	}
 
-	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
-			   ht->stor->block_size);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	res = authenc_decrypt_final(ctx, node->node.tag, enc_block,
-				    ht->stor->block_size, block);
+	res = authenc_decrypt(ht, &node->node, node->node.tag, enc_block,
+			      ht->stor->block_size, block);
+	if (res == TEE_SUCCESS)
+		cache_store(ht, block_num, block);
 out:
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
 	return res;
 }
 
+/*
+ * Writes @num blocks with a single vectored RPC. Node state is only
+ * updated once the RPC has succeeded, so on TEE_ERROR_NOT_SUPPORTED the
+ * caller can redo the blocks one at a time without losing anything. The
+ * IVs and tags of the nodes are updated already, but those are replaced
+ * again by the per-block fallback.
+ */
+static TEE_Result write_blocks(struct tee_fs_htree *ht, size_t block_num,
+			       size_t num, const uint8_t *blocks)
+{
+	struct htree_node *node[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	uint8_t vers[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	size_t block_size = ht->stor->block_size;
+	struct tee_fs_rpc_operation op = { };
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *enc_blocks = NULL;
+	size_t n = 0;
+
+	assert(num <= TEE_FS_HTREE_MAX_RPC_BLOCKS);
+
+	for (n = 0; n < num; n++) {
+		res = get_block_node(ht, true, block_num + n, node + n);
+		if (res != TEE_SUCCESS)
+			return res;
+		vers[n] = !!(node[n]->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+		if (!node[n]->block_updated)
+			vers[n] = !vers[n];
+	}
+
+	res = ht->stor->rpc_writev_init(ht->stor_aux, &op, block_num, num,
+					vers, (void **)&enc_blocks);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num; n++) {
+		res = authenc_encrypt(ht, &node[n]->node, node[n]->node.tag,
+				      blocks + n * block_size, block_size,
+				      enc_blocks + n * block_size);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	res = ht->stor->rpc_write_final(&op);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num; n++) {
+		if (!node[n]->block_updated)
+			node[n]->node.flags ^= HTREE_NODE_COMMITTED_BLOCK;
+		node[n]->block_updated = true;
+		node[n]->dirty = true;
+	}
+	ht->dirty = true;
+	/* Large writes are not worth caching */
+	cache_invalidate(ht, block_num, num);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_htree_write_blocks(struct tee_fs_htree **ht_arg,
+				     size_t block_num, size_t num_blocks,
+				     const void *blocks)
+{
+	struct tee_fs_htree *ht = *ht_arg;
+	const uint8_t *b = blocks;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num = 0;
+	size_t n = 0;
+
+	if (!ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	while (num_blocks) {
+		num = MIN(num_blocks, (size_t)TEE_FS_HTREE_MAX_RPC_BLOCKS);
+
+		res = TEE_ERROR_NOT_SUPPORTED;
+		if (num > 1 && ht->stor->rpc_writev_init)
+			res = write_blocks(ht, block_num, num, b);
+
+		if (res == TEE_ERROR_NOT_SUPPORTED) {
+			for (n = 0; n < num; n++) {
+				res = tee_fs_htree_write_block(ht_arg,
+						block_num + n,
+						b + n * ht->stor->block_size);
+				if (res != TEE_SUCCESS)
+					return res;
+			}
+		} else if (res != TEE_SUCCESS) {
+			tee_fs_htree_close(ht_arg);
+			return res;
+		}
+
+		block_num += num;
+		num_blocks -= num;
+		b += num * ht->stor->block_size;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result read_blocks(struct tee_fs_htree *ht, size_t block_num,
+			      size_t num, uint8_t *blocks)
+{
+	struct htree_node *node[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	uint8_t vers[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	size_t block_size = ht->stor->block_size;
+	struct tee_fs_rpc_operation op = { };
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *enc_blocks = NULL;
+	size_t len = 0;
+	size_t n = 0;
+
+	assert(num <= TEE_FS_HTREE_MAX_RPC_BLOCKS);
+
+	for (n = 0; n < num; n++) {
+		res = get_block_node(ht, false, block_num + n, node + n);
+		if (res != TEE_SUCCESS)
+			return res;
+		vers[n] = !!(node[n]->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+	}
+
+	res = ht->stor->rpc_readv_init(ht->stor_aux, &op, block_num, num,
+				       vers, (void **)&enc_blocks);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = ht->stor->rpc_read_final(&op, &len);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (len != num * block_size)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	for (n = 0; n < num; n++) {
+		res = authenc_decrypt(ht, &node[n]->node, node[n]->node.tag,
+				      enc_blocks + n * block_size, block_size,
+				      blocks + n * block_size);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_htree_read_blocks(struct tee_fs_htree **ht_arg,
+				    size_t block_num, size_t num_blocks,
+				    void *blocks)
+{
+	struct tee_fs_htree *ht = *ht_arg;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *b = blocks;
+	size_t num = 0;
+	size_t n = 0;
+
+	if (!ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	while (num_blocks) {
+		num = MIN(num_blocks, (size_t)TEE_FS_HTREE_MAX_RPC_BLOCKS);
+
+		res = TEE_ERROR_NOT_SUPPORTED;
+		if (num > 1 && ht->stor->rpc_readv_init)
+			res = read_blocks(ht, block_num, num, b);
+
+		if (res == TEE_ERROR_NOT_SUPPORTED) {
+			for (n = 0; n < num; n++) {
+				res = tee_fs_htree_read_block(ht_arg,
+						block_num + n,
+						b + n * ht->stor->block_size);
+				if (res != TEE_SUCCESS)
+					return res;
+			}
+		} else if (res != TEE_SUCCESS) {
+			tee_fs_htree_close(ht_arg);
+			return res;
+		}
+
+		block_num += num;
+		num_blocks -= num;
+		b += num * ht->stor->block_size;
+	}
+
+	return TEE_SUCCESS;
+}
+
 TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 {
 	struct tee_fs_htree *ht = *ht_arg;
@@ -913,6 +1307,8 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
+	cache_invalidate(ht, block_num, SIZE_MAX);
+
 	while (node_id < ht->imeta.max_node_id) {
 		node = find_closest_node(ht, ht->imeta.max_node_id);
 		assert(node && node->id == ht->imeta.max_node_id);
@@ -174,103 +174,156 @@ static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
 				     out, out_size);
 }
 
-static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
-			  const uint8_t in[TEE_AES_BLOCK_SIZE],
-			  const uint8_t *key, size_t key_size)
+static TEE_Result aes_ecb_init(void **ctx, TEE_OperationMode mode,
+			       const uint8_t *key, size_t key_size)
 {
 	TEE_Result res;
-	void *ctx = NULL;
 
-	res = crypto_cipher_alloc_ctx(&ctx, TEE_ALG_AES_ECB_NOPAD);
+	res = crypto_cipher_alloc_ctx(ctx, TEE_ALG_AES_ECB_NOPAD);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = crypto_cipher_init(ctx, TEE_MODE_ENCRYPT, key,
-				 key_size, NULL, 0, NULL, 0);
+	res = crypto_cipher_init(*ctx, mode, key, key_size, NULL, 0, NULL, 0);
+	if (res != TEE_SUCCESS) {
+		crypto_cipher_free_ctx(*ctx);
+		*ctx = NULL;
+	}
+
+	return res;
+}
+
+TEE_Result tee_fs_fek_ctx_init(struct tee_fs_fek_ctx *ctx,
+			       const TEE_UUID *uuid,
+			       const uint8_t *encrypted_fek,
+			       TEE_OperationMode mode)
+{
+	uint8_t sha[TEE_SHA256_HASH_SIZE] = { };
+	uint8_t fek[TEE_FS_KM_FEK_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->mode = mode;
+
+	/* Decrypt FEK */
+	res = tee_fs_fek_crypt(uuid, TEE_MODE_DECRYPT, encrypted_fek,
+			       TEE_FS_KM_FEK_SIZE, fek);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = crypto_cipher_update(ctx, TEE_MODE_ENCRYPT, true, in,
-				   TEE_AES_BLOCK_SIZE, out);
+	/* ESSIV: the IVs are encrypted with the hash of the FEK as key */
+	res = sha256(sha, sizeof(sha), fek, TEE_FS_KM_FEK_SIZE);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	crypto_cipher_final(ctx);
-	res = TEE_SUCCESS;
+	res = aes_ecb_init(&ctx->essiv_ctx, TEE_MODE_ENCRYPT, sha, 16);
+	if (res != TEE_SUCCESS)
+		goto out;
 
+	res = aes_ecb_init(&ctx->fek_ctx, mode, fek, sizeof(fek));
 out:
-	crypto_cipher_free_ctx(ctx);
+	if (res != TEE_SUCCESS)
+		tee_fs_fek_ctx_final(ctx);
+	memzero_explicit(fek, sizeof(fek));
+	memzero_explicit(sha, sizeof(sha));
 	return res;
 }
 
-static TEE_Result essiv(uint8_t iv[TEE_AES_BLOCK_SIZE],
-			const uint8_t fek[TEE_FS_KM_FEK_SIZE],
-			uint16_t blk_idx)
+static void xor_block(uint8_t *dst, const uint8_t *a, const uint8_t *b)
+{
+	size_t n = 0;
+
+	for (n = 0; n < TEE_AES_BLOCK_SIZE; n++)
+		dst[n] = a[n] ^ b[n];
+}
+
+/*
+ * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV.
+ * The CBC chaining is done here on top of the AES ECB context to avoid a
+ * new key setup for each IV.
+ */
+TEE_Result tee_fs_fek_ctx_crypt_block(struct tee_fs_fek_ctx *ctx,
+				      uint8_t *out, const uint8_t *in,
+				      size_t size, uint16_t blk_idx)
 {
-	TEE_Result res;
-	uint8_t sha[TEE_SHA256_HASH_SIZE];
 	uint8_t pad_blkid[TEE_AES_BLOCK_SIZE] = { 0, };
+	uint8_t buf[TEE_AES_BLOCK_SIZE] = { };
+	uint8_t iv[TEE_AES_BLOCK_SIZE] = { };
+	TEE_Result res = TEE_SUCCESS;
+	const uint8_t *prev = NULL;
+	size_t n = 0;
 
-	res = sha256(sha, sizeof(sha), fek, TEE_FS_KM_FEK_SIZE);
-	if (res != TEE_SUCCESS)
-		return res;
+	if (size % TEE_AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
 
+	DMSG("%scrypt block #%u",
+	     (ctx->mode == TEE_MODE_ENCRYPT) ? "En" : "De", blk_idx);
+
+	/* Compute initialization vector for this block */
 	pad_blkid[0] = (blk_idx & 0xFF);
 	pad_blkid[1] = (blk_idx & 0xFF00) >> 8;
 
-	res = aes_ecb(iv, pad_blkid, sha, 16);
+	res = crypto_cipher_update(ctx->essiv_ctx, TEE_MODE_ENCRYPT, false,
+				   pad_blkid, sizeof(pad_blkid), iv);
+	if (res != TEE_SUCCESS)
+		goto out;
 
-	memzero_explicit(sha, sizeof(sha));
+	if (ctx->mode == TEE_MODE_ENCRYPT) {
+		prev = iv;
+		for (n = 0; n < size; n += TEE_AES_BLOCK_SIZE) {
+			xor_block(buf, in + n, prev);
+			res = crypto_cipher_update(ctx->fek_ctx, ctx->mode,
+						   false, buf, sizeof(buf),
+						   out + n);
+			if (res != TEE_SUCCESS)
+				goto out;
+			prev = out + n;
+		}
+	} else {
+		/* Backwards so that @out may be the same buffer as @in */
+		for (n = size; n; n -= TEE_AES_BLOCK_SIZE) {
+			res = crypto_cipher_update(ctx->fek_ctx, ctx->mode,
+						   false,
+						   in + n - TEE_AES_BLOCK_SIZE,
+						   sizeof(buf), buf);
+			if (res != TEE_SUCCESS)
+				goto out;
+			if (n > TEE_AES_BLOCK_SIZE)
+				prev = in + n - 2 * TEE_AES_BLOCK_SIZE;
+			else
+				prev = iv;
+			xor_block(out + n - TEE_AES_BLOCK_SIZE, buf, prev);
+		}
+	}
+
+out:
+	memzero_explicit(buf, sizeof(buf));
+	memzero_explicit(iv, sizeof(iv));
 	return res;
 }
 
-/*
- * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV.
- */
+void tee_fs_fek_ctx_final(struct tee_fs_fek_ctx *ctx)
+{
+	crypto_cipher_free_ctx(ctx->essiv_ctx);
+	crypto_cipher_free_ctx(ctx->fek_ctx);
+	ctx->essiv_ctx = NULL;
+	ctx->fek_ctx = NULL;
+}
+
 TEE_Result tee_fs_crypt_block(const TEE_UUID *uuid, uint8_t *out,
 			      const uint8_t *in, size_t size,
 			      uint16_t blk_idx, const uint8_t *encrypted_fek,
 			      TEE_OperationMode mode)
 {
-	TEE_Result res;
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
-	uint8_t iv[TEE_AES_BLOCK_SIZE];
-	void *ctx;
-
-	DMSG("%scrypt block #%u", (mode == TEE_MODE_ENCRYPT) ? "En" : "De",
-	     blk_idx);
-
-	/* Decrypt FEK */
-	res = tee_fs_fek_crypt(uuid, TEE_MODE_DECRYPT, encrypted_fek,
-			       TEE_FS_KM_FEK_SIZE, fek);
-	if (res != TEE_SUCCESS)
-		goto wipe;
-
-	/* Compute initialization vector for this block */
-	res = essiv(iv, fek, blk_idx);
-	if (res != TEE_SUCCESS)
-		goto wipe;
-
-	/* Run AES CBC */
-	res = crypto_cipher_alloc_ctx(&ctx, TEE_ALG_AES_CBC_NOPAD);
-	if (res != TEE_SUCCESS)
-		goto wipe;
+	struct tee_fs_fek_ctx ctx = { };
+	TEE_Result res = TEE_SUCCESS;
 
-	res = crypto_cipher_init(ctx, mode, fek, sizeof(fek), NULL,
-				 0, iv, TEE_AES_BLOCK_SIZE);
+	res = tee_fs_fek_ctx_init(&ctx, uuid, encrypted_fek, mode);
 	if (res != TEE_SUCCESS)
-		goto exit;
-	res = crypto_cipher_update(ctx, mode, true, in, size, out);
-	if (res != TEE_SUCCESS)
-		goto exit;
+		return res;
 
-	crypto_cipher_final(ctx);
+	res = tee_fs_fek_ctx_crypt_block(&ctx, out, in, size, blk_idx);
+	tee_fs_fek_ctx_final(&ctx);
 
-exit:
-	crypto_cipher_free_ctx(ctx);
-wipe:
-	memzero_explicit(fek, sizeof(fek));
-	memzero_explicit(iv, sizeof(iv));
 	return res;
 }
 
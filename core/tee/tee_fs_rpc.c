@@ -24,6 +24,9 @@ struct tee_fs_dir {
 	struct tee_fs_dirent d;
 };
 
+/* Set when tee-supplicant turns out not to support vectored requests */
+static bool fs_rpc_no_vectored;
+
 /* "/dirf.db" or "/<file number>" */
 static TEE_Result create_filename(void *buf, size_t blen,
 				  const struct tee_fs_dirfile_fileh *dfh)
@@ -46,7 +49,21 @@ static TEE_Result create_filename(void *buf, size_t blen,
 
 static TEE_Result operation_commit(struct tee_fs_rpc_operation *op)
 {
-	return thread_rpc_cmd(op->id, op->num_params, op->params);
+	TEE_Result res = thread_rpc_cmd(op->id, op->num_params, op->params);
+	uint32_t cmd = op->params[0].u.value.a;
+
+	/*
+	 * An older tee-supplicant rejects the unknown vectored commands,
+	 * stop trying and let the caller fall back to one extent at a time.
+	 */
+	if ((cmd == OPTEE_RPC_FS_READV || cmd == OPTEE_RPC_FS_WRITEV) &&
+	    (res == TEE_ERROR_NOT_SUPPORTED ||
+	     res == TEE_ERROR_BAD_PARAMETERS)) {
+		fs_rpc_no_vectored = true;
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+
+	return res;
 }
 
 static TEE_Result operation_open_dfh(uint32_t id, unsigned int cmd,
@@ -181,6 +198,80 @@ TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op)
 	return operation_commit(op);
 }
 
+/*
+ * Allocates a shared buffer holding the data of all extents followed by
+ * the extent array.
+ */
+static TEE_Result operation_vector_init(struct tee_fs_rpc_operation *op,
+					uint32_t id, unsigned int cmd, int fd,
+					const struct tee_fs_rpc_extent *ext,
+					size_t num_ext, void **data)
+{
+	struct mobj *mobj = NULL;
+	size_t data_len = 0;
+	size_t ext_offs = 0;
+	size_t ext_len = 0;
+	uint8_t *va = NULL;
+	size_t sz = 0;
+	size_t n = 0;
+
+	if (fs_rpc_no_vectored)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	if (!num_ext)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	for (n = 0; n < num_ext; n++)
+		if (ADD_OVERFLOW(data_len, ext[n].len, &data_len))
+			return TEE_ERROR_BAD_PARAMETERS;
+
+	ext_offs = ROUNDUP(data_len, sizeof(uint64_t));
+	if (MUL_OVERFLOW(num_ext, sizeof(*ext), &ext_len) ||
+	    ADD_OVERFLOW(ext_offs, ext_len, &sz))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	va = thread_rpc_shm_cache_alloc(THREAD_SHM_CACHE_USER_FS,
+					THREAD_SHM_TYPE_APPLICATION,
+					sz, &mobj);
+	if (!va)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	memcpy(va + ext_offs, ext, ext_len);
+
+	*op = (struct tee_fs_rpc_operation){
+		.id = id, .num_params = 3, .params = {
+			[0] = THREAD_PARAM_VALUE(IN, cmd, fd, num_ext),
+			[2] = THREAD_PARAM_MEMREF(IN, mobj, ext_offs, ext_len),
+		},
+	};
+	if (cmd == OPTEE_RPC_FS_READV)
+		op->params[1] = THREAD_PARAM_MEMREF(OUT, mobj, 0, data_len);
+	else
+		op->params[1] = THREAD_PARAM_MEMREF(IN, mobj, 0, data_len);
+
+	*data = va;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_readv_init(struct tee_fs_rpc_operation *op,
+				 uint32_t id, int fd,
+				 const struct tee_fs_rpc_extent *ext,
+				 size_t num_ext, void **out_data)
+{
+	return operation_vector_init(op, id, OPTEE_RPC_FS_READV, fd, ext,
+				     num_ext, out_data);
+}
+
+TEE_Result tee_fs_rpc_writev_init(struct tee_fs_rpc_operation *op,
+				  uint32_t id, int fd,
+				  const struct tee_fs_rpc_extent *ext,
+				  size_t num_ext, void **data)
+{
+	return operation_vector_init(op, id, OPTEE_RPC_FS_WRITEV, fd, ext,
+				     num_ext, data);
+}
+
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len)
 {
 	struct tee_fs_rpc_operation op = {
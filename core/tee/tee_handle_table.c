@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <tee/tee_handle_table.h>
+#include <util.h>
+
+/* Grow when there's on average more than this many handles per bucket */
+#define MAX_LOAD	2
+
+static size_t hash_id(struct tee_handle_table *table, vaddr_t id)
+{
+	/* Objects are at least 8 byte aligned, the low bits carry nothing */
+	uint32_t h = (uint32_t)(id >> 3) ^ (uint32_t)((uint64_t)id >> 32);
+
+	return (h * 0x9e3779b1U) >> (32 - table->shift);
+}
+
+void tee_handle_table_init(struct tee_handle_table *table)
+{
+	memset(table, 0, sizeof(*table));
+	table->shift = TEE_HANDLE_TABLE_MIN_SHIFT;
+	table->buckets = table->min_buckets;
+}
+
+void tee_handle_table_final(struct tee_handle_table *table)
+{
+	if (table->buckets != table->min_buckets)
+		free(table->buckets);
+	tee_handle_table_init(table);
+}
+
+static void grow_table(struct tee_handle_table *table)
+{
+	struct tee_handle_bucket *old_buckets = table->buckets;
+	size_t old_num_buckets = BIT(table->shift);
+	struct tee_handle_bucket *buckets = NULL;
+	struct tee_handle_node *node = NULL;
+	size_t n = 0;
+
+	buckets = calloc(old_num_buckets * 2, sizeof(*buckets));
+	if (!buckets)
+		return;
+
+	table->buckets = buckets;
+	table->shift++;
+	for (n = 0; n < old_num_buckets; n++) {
+		while (!SLIST_EMPTY(old_buckets + n)) {
+			node = SLIST_FIRST(old_buckets + n);
+			SLIST_REMOVE_HEAD(old_buckets + n, link);
+			SLIST_INSERT_HEAD(buckets + hash_id(table, node->id),
+					  node, link);
+		}
+	}
+
+	if (old_buckets != table->min_buckets)
+		free(old_buckets);
+}
+
+void tee_handle_table_add(struct tee_handle_table *table,
+			  struct tee_handle_node *node, vaddr_t id,
+			  enum tee_handle_type type)
+{
+	if (table->num_nodes >= BIT(table->shift) * MAX_LOAD)
+		grow_table(table);
+
+	node->id = id;
+	node->type = type;
+	SLIST_INSERT_HEAD(table->buckets + hash_id(table, id), node, link);
+	table->num_nodes++;
+}
+
+void tee_handle_table_remove(struct tee_handle_table *table,
+			     struct tee_handle_node *node)
+{
+	SLIST_REMOVE(table->buckets + hash_id(table, node->id), node,
+		     tee_handle_node, link);
+	table->num_nodes--;
+}
+
+struct tee_handle_node *tee_handle_table_find(struct tee_handle_table *table,
+					      vaddr_t id,
+					      enum tee_handle_type type)
+{
+	struct tee_handle_node *node = NULL;
+
+	SLIST_FOREACH(node, table->buckets + hash_id(table, id), link)
+		if (node->id == id && node->type == type)
+			return node;
+
+	return NULL;
+}
@@ -16,25 +16,28 @@
 void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_INSERT_TAIL(&utc->objects, o, link);
+	tee_handle_table_add(&utc->handles, &o->handle, (vaddr_t)o,
+			     TEE_HANDLE_TYPE_OBJ);
 }
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, vaddr_t obj_id,
 		       struct tee_obj **obj)
 {
-	struct tee_obj *o;
+	struct tee_handle_node *node = NULL;
 
-	TAILQ_FOREACH(o, &utc->objects, link) {
-		if (obj_id == (vaddr_t)o) {
-			*obj = o;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_STATE;
+	node = tee_handle_table_find(&utc->handles, obj_id,
+				     TEE_HANDLE_TYPE_OBJ);
+	if (!node)
+		return TEE_ERROR_BAD_STATE;
+
+	*obj = container_of(node, struct tee_obj, handle);
+	return TEE_SUCCESS;
 }
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_REMOVE(&utc->objects, o, link);
+	tee_handle_table_remove(&utc->handles, &o->handle);
 
 	if ((o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT)) {
 		o->pobj->fops->close(&o->fh);
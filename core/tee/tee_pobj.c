@@ -6,6 +6,7 @@
 #include <kernel/mutex.h>
 #include <stdlib.h>
 #include <string.h>
+#include <tee_api_defines_extensions.h>
 #include <tee/tee_pobj.h>
 #include <trace.h>
 
@@ -54,6 +55,11 @@ static TEE_Result tee_pobj_check_access(uint32_t oflags, uint32_t nflags)
 	    (oflags & TEE_DATA_FLAG_SHARE_WRITE))
 		return TEE_ERROR_ACCESS_CONFLICT;
 
+	/* All handles must agree on when writes are committed */
+	if ((nflags & TEE_DATA_FLAG_DEFER_COMMIT) !=
+	    (oflags & TEE_DATA_FLAG_DEFER_COMMIT))
+		return TEE_ERROR_ACCESS_CONFLICT;
+
 	return TEE_SUCCESS;
 }
 
@@ -4,9 +4,11 @@
  */
 
 #include <assert.h>
+#include <atomic.h>
 #include <config.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
+#include <kernel/tee_time.h>
 #include <kernel/thread.h>
 #include <mempool.h>
 #include <mm/core_memprot.h>
@@ -17,6 +19,7 @@
 #include <string_ext.h>
 #include <string.h>
 #include <sys/queue.h>
+#include <tee_api_defines_extensions.h>
 #include <tee/fs_dirfile.h>
 #include <tee/fs_htree.h>
 #include <tee/tee_fs.h>
@@ -30,11 +33,24 @@
 
 #define BLOCK_SIZE	(1 << BLOCK_SHIFT)
 
+/*
+ * @mu serializes operations on the file handle, ree_fs_dirh_mutex is only
+ * taken while the dirfile is accessed.
+ *
+ * With @defer_commit set, written data stays uncommitted until
+ * ree_fs_commit() is called. @uncommitted is the number of bytes written
+ * since the last commit, the first of those writes was done at
+ * @uncommitted_since.
+ */
 struct tee_fs_fd {
 	struct tee_fs_htree *ht;
 	int fd;
 	struct tee_fs_dirfile_fileh dfh;
 	const TEE_UUID *uuid;
+	struct mutex mu;
+	bool defer_commit;
+	size_t uncommitted;
+	TEE_Time uncommitted_since;
 };
 
 struct tee_fs_dir {
@@ -49,8 +65,6 @@ static int pos_to_block_num(int position)
 	return position >> BLOCK_SHIFT;
 }
 
-static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
-
 static void *get_tmp_block(void)
 {
 	return mempool_alloc(mempool_default, BLOCK_SIZE);
@@ -87,10 +101,30 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_write = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t num_blocks = remain_bytes / BLOCK_SIZE;
 
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
+		/*
+		 * Whole blocks are written directly from the caller's
+		 * buffer, several blocks per RPC.
+		 */
+		if (data_ptr && !offset && num_blocks) {
+			res = tee_fs_htree_write_blocks(&fdp->ht,
+							start_block_num,
+							num_blocks, data_ptr);
+			if (res != TEE_SUCCESS)
+				goto exit;
+
+			size_to_write = num_blocks * BLOCK_SIZE;
+			data_ptr += size_to_write;
+			remain_bytes -= size_to_write;
+			start_block_num += num_blocks;
+			pos += size_to_write;
+			continue;
+		}
+
 		if (start_block_num * BLOCK_SIZE <
 		    ROUNDUP(meta->length, BLOCK_SIZE)) {
 			res = tee_fs_htree_read_block(&fdp->ht,
@@ -248,12 +282,87 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 				     offs, size, data);
 }
 
+/*
+ * Fills in one extent per data block, merging blocks which happen to be
+ * adjacent in the file. The number of extents is returned in @num_ext.
+ */
+static TEE_Result get_block_extents(size_t idx, size_t num,
+				    const uint8_t *vers,
+				    struct tee_fs_rpc_extent *ext,
+				    size_t *num_ext)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t offs = 0;
+	size_t size = 0;
+	size_t n = 0;
+	size_t e = 0;
+
+	if (num > TEE_FS_HTREE_MAX_RPC_BLOCKS)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	for (n = 0; n < num; n++) {
+		res = get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx + n, vers[n],
+				    &offs, &size);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		if (e && ext[e - 1].offs + ext[e - 1].len == offs) {
+			ext[e - 1].len += size;
+		} else {
+			ext[e].offs = offs;
+			ext[e].len = size;
+			e++;
+		}
+	}
+
+	*num_ext = e;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ree_fs_rpc_readv_init(void *aux,
+					struct tee_fs_rpc_operation *op,
+					size_t idx, size_t num,
+					const uint8_t *vers, void **data)
+{
+	struct tee_fs_rpc_extent ext[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	struct tee_fs_fd *fdp = aux;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_ext = 0;
+
+	res = get_block_extents(idx, num, vers, ext, &num_ext);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_fs_rpc_readv_init(op, OPTEE_RPC_CMD_FS, fdp->fd,
+				     ext, num_ext, data);
+}
+
+static TEE_Result ree_fs_rpc_writev_init(void *aux,
+					 struct tee_fs_rpc_operation *op,
+					 size_t idx, size_t num,
+					 const uint8_t *vers, void **data)
+{
+	struct tee_fs_rpc_extent ext[TEE_FS_HTREE_MAX_RPC_BLOCKS] = { };
+	struct tee_fs_fd *fdp = aux;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_ext = 0;
+
+	res = get_block_extents(idx, num, vers, ext, &num_ext);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_fs_rpc_writev_init(op, OPTEE_RPC_CMD_FS, fdp->fd,
+				      ext, num_ext, data);
+}
+
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.block_size = BLOCK_SIZE,
 	.rpc_read_init = ree_fs_rpc_read_init,
 	.rpc_read_final = tee_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
 	.rpc_write_final = tee_fs_rpc_write_final,
+	.rpc_readv_init = ree_fs_rpc_readv_init,
+	.rpc_writev_init = ree_fs_rpc_writev_init,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
@@ -332,10 +441,33 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t num_blocks = remain_bytes / BLOCK_SIZE;
 
 		if (size_to_read + offset > BLOCK_SIZE)
 			size_to_read = BLOCK_SIZE - offset;
 
+		/*
+		 * Whole blocks are decrypted directly into the caller's
+		 * buffer, several blocks per RPC. Don't leave anything
+		 * unauthenticated behind if that fails.
+		 */
+		if (!offset && num_blocks) {
+			size_to_read = num_blocks * BLOCK_SIZE;
+			res = tee_fs_htree_read_blocks(&fdp->ht,
+						       start_block_num,
+						       num_blocks, data_ptr);
+			if (res != TEE_SUCCESS) {
+				memzero_explicit(data_ptr, size_to_read);
+				goto exit;
+			}
+
+			data_ptr += size_to_read;
+			remain_bytes -= size_to_read;
+			pos += size_to_read;
+			start_block_num += num_blocks;
+			continue;
+		}
+
 		res = tee_fs_htree_read_block(&fdp->ht, start_block_num, block);
 		if (res != TEE_SUCCESS)
 			goto exit;
@@ -358,11 +490,12 @@ exit:
 static TEE_Result ree_fs_read(struct tee_file_handle *fh, size_t pos,
 			      void *buf, size_t *len)
 {
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 	TEE_Result res;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&fdp->mu);
 	res = ree_fs_read_primitive(fh, pos, buf, len);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mu);
 
 	return res;
 }
@@ -404,6 +537,7 @@ static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	fdp->fd = -1;
 	fdp->uuid = uuid;
+	mutex_init(&fdp->mu);
 
 	if (create)
 		res = tee_fs_rpc_create_dfh(OPTEE_RPC_CMD_FS,
@@ -430,6 +564,7 @@ out:
 			tee_fs_rpc_close(OPTEE_RPC_CMD_FS, fdp->fd);
 		if (create)
 			tee_fs_rpc_remove_dfh(OPTEE_RPC_CMD_FS, dfh);
+		mutex_destroy(&fdp->mu);
 		free(fdp);
 	}
 
@@ -443,6 +578,7 @@ static void ree_fs_close_primitive(struct tee_file_handle *fh)
 	if (fdp) {
 		tee_fs_htree_close(&fdp->ht);
 		tee_fs_rpc_close(OPTEE_RPC_CMD_FS, fdp->fd);
+		mutex_destroy(&fdp->mu);
 		free(fdp);
 	}
 }
@@ -461,16 +597,45 @@ static TEE_Result ree_dirf_commit_writes(struct tee_file_handle *fh,
 	return res;
 }
 
+/*
+ * The dirfile is read by several threads at a time while
+ * ree_fs_dirh_mutex is held for reading, serialize on the handle.
+ */
+static TEE_Result ree_dirf_read(struct tee_file_handle *fh, size_t pos,
+				void *buf, size_t *len)
+{
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+	TEE_Result res = TEE_ERROR_CORRUPT_OBJECT;
+
+	mutex_lock(&fdp->mu);
+	/* A failed read closes the hash tree */
+	if (fdp->ht)
+		res = ree_fs_read_primitive(fh, pos, buf, len);
+	mutex_unlock(&fdp->mu);
+
+	return res;
+}
+
 static const struct tee_fs_dirfile_operations ree_dirf_ops = {
 	.open = ree_fs_open_primitive,
 	.close = ree_fs_close_primitive,
-	.read = ree_fs_read_primitive,
+	.read = ree_dirf_read,
 	.write = ree_fs_write_primitive,
 	.commit_writes = ree_dirf_commit_writes,
 };
 
+/*
+ * ree_fs_dirh_mutex protects ree_fs_dirh and the content of the dirfile.
+ * Lookups hold it for reading, anything updating the dirfile or opening
+ * and closing ree_fs_dirh holds it for writing. When both are needed
+ * struct tee_fs_fd::mu is taken before ree_fs_dirh_mutex.
+ *
+ * ree_fs_dirh_refcount is updated atomically as references are also
+ * taken with ree_fs_dirh_mutex held for reading.
+ */
+static struct mutex ree_fs_dirh_mutex = MUTEX_INITIALIZER;
 static struct tee_fs_dirfile_dirh *ree_fs_dirh;
-static size_t ree_fs_dirh_refcount;
+static uint32_t ree_fs_dirh_refcount;
 
 #ifdef CFG_RPMB_FS
 static struct tee_file_handle *ree_fs_rpmb_fh;
@@ -568,6 +733,7 @@ static void close_dirh(struct tee_fs_dirfile_dirh **dirh)
 }
 #endif /*!CFG_RPMB_FS*/
 
+/* Called with ree_fs_dirh_mutex held for writing */
 static TEE_Result get_dirh(struct tee_fs_dirfile_dirh **dirh)
 {
 	if (!ree_fs_dirh) {
@@ -578,13 +744,43 @@ static TEE_Result get_dirh(struct tee_fs_dirfile_dirh **dirh)
 			return res;
 		}
 	}
-	ree_fs_dirh_refcount++;
+	atomic_inc32(&ree_fs_dirh_refcount);
 	assert(ree_fs_dirh);
 	assert(ree_fs_dirh_refcount);
 	*dirh = ree_fs_dirh;
 	return TEE_SUCCESS;
 }
 
+/*
+ * Returns with ree_fs_dirh_mutex held for reading and a reference to
+ * ree_fs_dirh on success. If ree_fs_dirh needs to be opened that is done
+ * with the mutex held for writing first.
+ */
+static TEE_Result get_dirh_shared(struct tee_fs_dirfile_dirh **dirh)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	while (true) {
+		mutex_read_lock(&ree_fs_dirh_mutex);
+		if (ree_fs_dirh) {
+			atomic_inc32(&ree_fs_dirh_refcount);
+			*dirh = ree_fs_dirh;
+			return TEE_SUCCESS;
+		}
+		mutex_read_unlock(&ree_fs_dirh_mutex);
+
+		mutex_lock(&ree_fs_dirh_mutex);
+		if (!ree_fs_dirh)
+			res = open_dirh(&ree_fs_dirh);
+		mutex_unlock(&ree_fs_dirh_mutex);
+		if (res) {
+			*dirh = NULL;
+			return res;
+		}
+	}
+}
+
+/* Called with ree_fs_dirh_mutex held for writing */
 static void put_dirh_primitive(bool close)
 {
 	assert(ree_fs_dirh_refcount);
@@ -601,8 +797,9 @@ static void put_dirh_primitive(bool close)
 	 * only to this function, put_dirh_primitive(), and in this case
 	 * ree_fs_dirh may actually be NULL.
 	 */
-	ree_fs_dirh_refcount--;
-	if (ree_fs_dirh && (!ree_fs_dirh_refcount || close))
+	if (!atomic_dec32(&ree_fs_dirh_refcount))
+		close = true;
+	if (ree_fs_dirh && close)
 		close_dirh(&ree_fs_dirh);
 }
 
@@ -621,11 +818,9 @@ static TEE_Result ree_fs_open(struct tee_pobj *po, size_t *size,
 	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_dirfile_fileh dfh;
 
-	mutex_lock(&ree_fs_mutex);
-
-	res = get_dirh(&dirh);
+	res = get_dirh_shared(&dirh);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	res = tee_fs_dirfile_find(dirh, &po->uuid, po->obj_id, po->obj_id_len,
 				  &dfh);
@@ -639,16 +834,22 @@ static TEE_Result ree_fs_open(struct tee_pobj *po, size_t *size,
 		 * treat it as corrupt.
 		 */
 		res = TEE_ERROR_CORRUPT_OBJECT;
-	} else if (!res && size) {
+	} else if (!res) {
 		struct tee_fs_fd *fdp = (struct tee_fs_fd *)*fh;
 
-		*size = tee_fs_htree_get_meta(fdp->ht)->length;
+		fdp->defer_commit = po->flags & TEE_DATA_FLAG_DEFER_COMMIT;
+		if (size)
+			*size = tee_fs_htree_get_meta(fdp->ht)->length;
 	}
 
 out:
-	if (res)
-		put_dirh(dirh, true);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_read_unlock(&ree_fs_dirh_mutex);
+
+	if (res) {
+		mutex_lock(&ree_fs_dirh_mutex);
+		put_dirh_primitive(true);
+		mutex_unlock(&ree_fs_dirh_mutex);
+	}
 
 	return res;
 }
@@ -690,18 +891,6 @@ static TEE_Result set_name(struct tee_fs_dirfile_dirh *dirh,
 	return TEE_SUCCESS;
 }
 
-static void ree_fs_close(struct tee_file_handle **fh)
-{
-	if (*fh) {
-		mutex_lock(&ree_fs_mutex);
-		put_dirh_primitive(false);
-		ree_fs_close_primitive(*fh);
-		*fh = NULL;
-		mutex_unlock(&ree_fs_mutex);
-
-	}
-}
-
 static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 				const void *head, size_t head_size,
 				const void *attr, size_t attr_size,
@@ -715,7 +904,11 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 	size_t pos = 0;
 
 	*fh = NULL;
-	mutex_lock(&ree_fs_mutex);
+	/*
+	 * The temporary dirfile index isn't reserved until set_name(), so
+	 * the dirfile is locked during the entire creation.
+	 */
+	mutex_lock(&ree_fs_dirh_mutex);
 
 	res = get_dirh(&dirh);
 	if (res)
@@ -755,6 +948,8 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 		goto out;
 
 	res = set_name(dirh, fdp, po, overwrite);
+	if (!res)
+		fdp->defer_commit = po->flags & TEE_DATA_FLAG_DEFER_COMMIT;
 out:
 	if (res) {
 		put_dirh(dirh, true);
@@ -764,43 +959,148 @@ out:
 			tee_fs_rpc_remove_dfh(OPTEE_RPC_CMD_FS, &dfh);
 		}
 	}
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_mutex);
 
 	return res;
 }
 
-static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
-			       const void *buf, size_t len)
+/*
+ * Records the new hash of a modified file in the dirfile, called with
+ * struct tee_fs_fd::mu held.
+ */
+static TEE_Result update_dirh_hash(struct tee_fs_fd *fdp)
 {
-	TEE_Result res;
 	struct tee_fs_dirfile_dirh *dirh = NULL;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+	TEE_Result res = TEE_SUCCESS;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_mutex);
 
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
 
-	res = ree_fs_write_primitive(fh, pos, buf, len);
+	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
 	if (res)
 		goto out;
+	res = commit_dirh_writes(dirh);
+out:
+	put_dirh(dirh, res);
+	mutex_unlock(&ree_fs_dirh_mutex);
+
+	return res;
+}
+
+/*
+ * Commits the hash tree and records the new hash in the dirfile. This is
+ * the commit point of all writes since the last commit. Called with
+ * struct tee_fs_fd::mu held.
+ */
+static TEE_Result ree_fs_commit(struct tee_fs_fd *fdp)
+{
+	TEE_Result res = TEE_SUCCESS;
 
 	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
 	if (res)
-		goto out;
+		return res;
 
-	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
+	res = update_dirh_hash(fdp);
+	if (res)
+		return res;
+
+	fdp->uncommitted = 0;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Accounts @len written bytes and returns true if the commit can be
+ * deferred further.
+ */
+static bool defer_commit(struct tee_fs_fd *fdp, size_t len)
+{
+	TEE_Time t = { };
+	uint64_t ms = 0;
+
+	if (!fdp->defer_commit || tee_time_get_sys_time(&t))
+		return false;
+
+	if (!fdp->uncommitted)
+		fdp->uncommitted_since = t;
+	if (ADD_OVERFLOW(fdp->uncommitted, len, &fdp->uncommitted) ||
+	    fdp->uncommitted >= CFG_REE_FS_DEFER_COMMIT_BYTES)
+		return false;
+
+	ms = ((uint64_t)t.seconds * 1000 + t.millis) -
+	     ((uint64_t)fdp->uncommitted_since.seconds * 1000 +
+	      fdp->uncommitted_since.millis);
+
+	return ms < CFG_REE_FS_DEFER_COMMIT_MS;
+}
+
+static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
+			       const void *buf, size_t len)
+{
+	TEE_Result res;
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+
+	mutex_lock(&fdp->mu);
+
+	res = ree_fs_write_primitive(fh, pos, buf, len);
 	if (res)
 		goto out;
-	res = commit_dirh_writes(dirh);
+
+	if (!defer_commit(fdp, len))
+		res = ree_fs_commit(fdp);
 out:
-	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mu);
 
 	return res;
 }
 
+static TEE_Result ree_fs_sync(struct tee_file_handle *fh)
+{
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+	TEE_Result res = TEE_SUCCESS;
+
+	mutex_lock(&fdp->mu);
+	if (fdp->uncommitted)
+		res = ree_fs_commit(fdp);
+	mutex_unlock(&fdp->mu);
+
+	return res;
+}
+
+/*
+ * Forgets the writes deferred since the last commit, they are never
+ * committed. Used before the object is removed so that closing the handle
+ * doesn't update the removed dirfile entry.
+ */
+static void ree_fs_discard(struct tee_file_handle *fh)
+{
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+
+	mutex_lock(&fdp->mu);
+	fdp->uncommitted = 0;
+	mutex_unlock(&fdp->mu);
+}
+
+static void ree_fs_close(struct tee_file_handle **fh)
+{
+	if (*fh) {
+		TEE_Result res = ree_fs_sync(*fh);
+
+		if (res)
+			EMSG("Failed to commit deferred writes: %#"PRIx32, res);
+
+		mutex_lock(&ree_fs_dirh_mutex);
+		put_dirh_primitive(false);
+		mutex_unlock(&ree_fs_dirh_mutex);
+
+		ree_fs_close_primitive(*fh);
+		*fh = NULL;
+
+	}
+}
+
 static TEE_Result ree_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 				bool overwrite)
 {
@@ -812,7 +1112,7 @@ static TEE_Result ree_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 	if (!new)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_mutex);
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
@@ -849,7 +1149,7 @@ static TEE_Result ree_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 
 out:
 	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_mutex);
 
 	return res;
 
@@ -861,7 +1161,7 @@ static TEE_Result ree_fs_remove(struct tee_pobj *po)
 	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_dirfile_fileh dfh;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_mutex);
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
@@ -885,7 +1185,7 @@ static TEE_Result ree_fs_remove(struct tee_pobj *po)
 				   &dfh));
 out:
 	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_mutex);
 
 	return res;
 }
@@ -893,30 +1193,21 @@ out:
 static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 {
 	TEE_Result res;
-	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	mutex_lock(&ree_fs_mutex);
-
-	res = get_dirh(&dirh);
-	if (res)
-		goto out;
+	mutex_lock(&fdp->mu);
 
 	res = ree_fs_ftruncate_internal(fdp, len);
 	if (res)
 		goto out;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
-	if (res)
-		goto out;
-
-	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
-	if (res)
-		goto out;
-	res = commit_dirh_writes(dirh);
+	/*
+	 * The file may have been truncated in storage already, so this is
+	 * always committed right away, together with any pending writes.
+	 */
+	res = ree_fs_commit(fdp);
 out:
-	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mu);
 
 	return res;
 }
@@ -933,11 +1224,11 @@ static TEE_Result ree_fs_opendir_rpc(const TEE_UUID *uuid,
 
 	d->uuid = uuid;
 
-	mutex_lock(&ree_fs_mutex);
-
-	res = get_dirh(&d->dirh);
-	if (res)
-		goto out;
+	res = get_dirh_shared(&d->dirh);
+	if (res) {
+		free(d);
+		return res;
+	}
 
 	/* See that there's at least one file */
 	d->idx = -1;
@@ -946,15 +1237,16 @@ static TEE_Result ree_fs_opendir_rpc(const TEE_UUID *uuid,
 				      &d->d.oidlen);
 	d->idx = -1;
 
-out:
+	mutex_read_unlock(&ree_fs_dirh_mutex);
+
 	if (!res) {
 		*dir = d;
 	} else {
-		if (d)
-			put_dirh(d->dirh, false);
+		mutex_lock(&ree_fs_dirh_mutex);
+		put_dirh_primitive(false);
+		mutex_unlock(&ree_fs_dirh_mutex);
 		free(d);
 	}
-	mutex_unlock(&ree_fs_mutex);
 
 	return res;
 }
@@ -962,12 +1254,12 @@ out:
 static void ree_fs_closedir_rpc(struct tee_fs_dir *d)
 {
 	if (d) {
-		mutex_lock(&ree_fs_mutex);
+		mutex_lock(&ree_fs_dirh_mutex);
 
 		put_dirh(d->dirh, false);
 		free(d);
 
-		mutex_unlock(&ree_fs_mutex);
+		mutex_unlock(&ree_fs_dirh_mutex);
 	}
 }
 
@@ -976,7 +1268,7 @@ static TEE_Result ree_fs_readdir_rpc(struct tee_fs_dir *d,
 {
 	TEE_Result res;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_read_lock(&ree_fs_dirh_mutex);
 
 	d->d.oidlen = sizeof(d->d.oid);
 	res = tee_fs_dirfile_get_next(d->dirh, d->uuid, &d->idx, d->d.oid,
@@ -984,7 +1276,7 @@ static TEE_Result ree_fs_readdir_rpc(struct tee_fs_dir *d,
 	if (res == TEE_SUCCESS)
 		*ent = &d->d;
 
-	mutex_unlock(&ree_fs_mutex);
+	mutex_read_unlock(&ree_fs_dirh_mutex);
 
 	return res;
 }
@@ -996,6 +1288,8 @@ const struct tee_file_operations ree_fs_ops = {
 	.read = ree_fs_read,
 	.write = ree_fs_write,
 	.truncate = ree_fs_truncate,
+	.sync = ree_fs_sync,
+	.discard = ree_fs_discard,
 	.rename = ree_fs_rename,
 	.remove = ree_fs_remove,
 	.opendir = ree_fs_opendir_rpc,
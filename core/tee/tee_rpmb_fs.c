@@ -101,6 +101,39 @@ struct rpmb_fat_entry_dir {
 	bool last_reached;
 };
 
+#define RPMB_FAT_INDEX_NONE		UINT32_MAX
+#define RPMB_FAT_INDEX_MIN_BUCKETS	16
+
+/**
+ * In-memory summary of a FAT FS entry. Slot n describes the entry at
+ * RPMB_FS_FAT_START_ADDRESS + n * sizeof(struct rpmb_fat_entry).
+ */
+struct rpmb_fat_slot {
+	/* Hash of the filename and of its leading "/TA_uuid/" part */
+	uint32_t name_hash;
+	uint32_t dir_hash;
+	uint32_t start_address;
+	uint32_t data_size;
+	uint32_t flags;
+	/* Next active slot in the same bucket, in ascending order */
+	uint32_t next;
+};
+
+/**
+ * Index of the FAT FS entries. It's built by traversing the FAT once and
+ * is then kept coherent by write_fat_entry(). Active entries are chained
+ * in buckets selected by the hash of the filename, so a file is found
+ * with a single read of its FAT entry from RPMB storage. The slots also
+ * describe the allocated data areas.
+ */
+struct rpmb_fat_index {
+	struct rpmb_fat_slot *slots;
+	uint32_t num_slots;
+	uint32_t max_slots;
+	uint32_t *buckets;
+	uint32_t num_buckets;
+};
+
 /**
  * FAT entry context with reference to a FAT entry and its
  * location in RPMB.
@@ -147,6 +180,7 @@ struct tee_fs_dir {
 
 static struct rpmb_fs_parameters *fs_par;
 static struct rpmb_fat_entry_dir *fat_entry_dir;
+static struct rpmb_fat_index *fat_index;
 
 /*
  * Lower interface to RPMB device
@@ -185,6 +219,16 @@ static struct rpmb_fat_entry_dir *fat_entry_dir;
 /* RPMB internal commands */
 #define RPMB_CMD_DATA_REQ      0x00
 #define RPMB_CMD_GET_DEV_INFO  0x01
+/*
+ * A sequence of authenticated data write requests sent back to back, each
+ * made up of the number of frames in its block_count field. The requests
+ * are performed in order until one fails, one response frame is returned
+ * per request.
+ */
+#define RPMB_CMD_DATA_REQ_BATCH 0x02
+
+/* Maximum number of data frames in a RPMB_CMD_DATA_REQ_BATCH request */
+#define RPMB_WRITE_BATCH_MAX_FRAMES	64
 
 #define RPMB_SIZE_SINGLE (128 * 1024)
 
@@ -273,6 +317,9 @@ static struct tee_rpmb_ctx *rpmb_ctx;
 /* If set to true, don't try to access RPMB until rebooted */
 static bool rpmb_dead;
 
+/* Set if the supplicant doesn't support RPMB_CMD_DATA_REQ_BATCH */
+static bool rpmb_no_write_batch;
+
 /*
  * Mutex to serialize the operations exported by this file.
  * It protects rpmb_ctx and prevents overlapping operations on eMMC devices with
@@ -486,26 +533,42 @@ static bool is_zero(const uint8_t *buf, size_t size)
 }
 
 static TEE_Result encrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek,
-				const TEE_UUID *uuid)
+				uint16_t blk_idx, struct tee_fs_fek_ctx *fek_ctx)
 {
-	return tee_fs_crypt_block(uuid, out, in, RPMB_DATA_SIZE,
-				  blk_idx, fek, TEE_MODE_ENCRYPT);
+	return tee_fs_fek_ctx_crypt_block(fek_ctx, out, in, RPMB_DATA_SIZE,
+					  blk_idx);
 }
 
 static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek,
-				const TEE_UUID *uuid)
+				uint16_t blk_idx, struct tee_fs_fek_ctx *fek_ctx)
 {
-	return tee_fs_crypt_block(uuid, out, in, RPMB_DATA_SIZE,
-				  blk_idx, fek, TEE_MODE_DECRYPT);
+	return tee_fs_fek_ctx_crypt_block(fek_ctx, out, in, RPMB_DATA_SIZE,
+					  blk_idx);
+}
+
+/*
+ * Sets up fek_ctx for decryption of the data blocks of one request. No
+ * key is set up if fek is NULL, the blocks are then not encrypted (not
+ * file data blocks).
+ */
+static TEE_Result decrypt_init(struct tee_fs_fek_ctx *fek_ctx,
+			       const uint8_t *fek, const TEE_UUID *uuid)
+{
+	if (!fek)
+		return TEE_SUCCESS;
+
+	/* The file was created with encryption disabled */
+	if (is_zero(fek, TEE_FS_KM_FEK_SIZE))
+		return TEE_ERROR_SECURITY;
+
+	return tee_fs_fek_ctx_init(fek_ctx, uuid, fek, TEE_MODE_DECRYPT);
 }
 
 /* Decrypt/copy at most one block of data */
 static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 			  size_t size, size_t offset,
-			  uint16_t blk_idx __maybe_unused, const uint8_t *fek,
-			  const TEE_UUID *uuid)
+			  uint16_t blk_idx __maybe_unused,
+			  struct tee_fs_fek_ctx *fek_ctx)
 {
 	uint8_t *tmp __maybe_unused;
 	TEE_Result res = TEE_SUCCESS;
@@ -514,12 +577,9 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 	if ((size + offset < size) || (size + offset > RPMB_DATA_SIZE))
 		panic("invalid size or offset");
 
-	if (!fek) {
+	if (!fek_ctx->fek_ctx) {
 		/* Block is not encrypted (not a file data block) */
 		memcpy(out, frm->data + offset, size);
-	} else if (is_zero(fek, TEE_FS_KM_FEK_SIZE)) {
-		/* The file was created with encryption disabled */
-		return TEE_ERROR_SECURITY;
 	} else {
 		/* Block is encrypted */
 		if (size < RPMB_DATA_SIZE) {
@@ -530,28 +590,33 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 			tmp = malloc(RPMB_DATA_SIZE);
 			if (!tmp)
 				return TEE_ERROR_OUT_OF_MEMORY;
-			res = decrypt_block(tmp, frm->data, blk_idx, fek, uuid);
+			res = decrypt_block(tmp, frm->data, blk_idx, fek_ctx);
 			if (res == TEE_SUCCESS)
 				memcpy(out, tmp + offset, size);
 			free(tmp);
 		} else {
-			res = decrypt_block(out, frm->data, blk_idx, fek, uuid);
+			res = decrypt_block(out, frm->data, blk_idx, fek_ctx);
 		}
 	}
 
 	return res;
 }
 
-static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
-				    struct rpmb_raw_data *rawdata,
-				    uint16_t nbr_frms, uint16_t dev_id,
-				    const uint8_t *fek, const TEE_UUID *uuid)
+/*
+ * Packs nbr_frms data frames described by rawdata, including the MAC of a
+ * write request, and copies them to out.
+ */
+static TEE_Result tee_rpmb_frames_pack(void *out,
+				       struct rpmb_raw_data *rawdata,
+				       uint16_t nbr_frms, const uint8_t *fek,
+				       const TEE_UUID *uuid)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
+	struct tee_fs_fek_ctx fek_ctx = { };
 	int i;
 	struct rpmb_data_frame *datafrm;
 
-	if (!req || !rawdata || !nbr_frms)
+	if (!out || !rawdata || !nbr_frms)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	/*
@@ -565,14 +630,18 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 		return TEE_ERROR_GENERIC;
 	}
 
-	req->cmd = RPMB_CMD_DATA_REQ;
-	req->dev_id = dev_id;
-
 	/* Allocate memory for construct all data packets and calculate MAC. */
 	datafrm = calloc(nbr_frms, RPMB_DATA_FRAME_SIZE);
 	if (!datafrm)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
+	if (rawdata->data && fek) {
+		res = tee_fs_fek_ctx_init(&fek_ctx, uuid, fek,
+					  TEE_MODE_ENCRYPT);
+		if (res != TEE_SUCCESS)
+			goto func_exit;
+	}
+
 	for (i = 0; i < nbr_frms; i++) {
 		u16_to_bytes(rawdata->msg_type, datafrm[i].msg_type);
 
@@ -604,7 +673,7 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 						    rawdata->data +
 						    (i * RPMB_DATA_SIZE),
 						    *rawdata->blk_idx + i,
-						    fek, uuid);
+						    &fek_ctx);
 				if (res != TEE_SUCCESS)
 					goto func_exit;
 			} else {
@@ -629,8 +698,7 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 		       rawdata->key_mac, RPMB_KEY_MAC_SIZE);
 	}
 
-	memcpy(TEE_RPMB_REQ_DATA(req), datafrm,
-	       nbr_frms * RPMB_DATA_FRAME_SIZE);
+	memcpy(out, datafrm, nbr_frms * RPMB_DATA_FRAME_SIZE);
 
 	if (IS_ENABLED(CFG_RPMB_FS_DEBUG_DATA)) {
 		for (i = 0; i < nbr_frms; i++) {
@@ -642,14 +710,31 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 
 	res = TEE_SUCCESS;
 func_exit:
+	tee_fs_fek_ctx_final(&fek_ctx);
 	free(datafrm);
 	return res;
 }
 
+static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
+				    struct rpmb_raw_data *rawdata,
+				    uint16_t nbr_frms, uint16_t dev_id,
+				    const uint8_t *fek, const TEE_UUID *uuid)
+{
+	if (!req)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	req->cmd = RPMB_CMD_DATA_REQ;
+	req->dev_id = dev_id;
+
+	return tee_rpmb_frames_pack(TEE_RPMB_REQ_DATA(req), rawdata, nbr_frms,
+				    fek, uuid);
+}
+
 static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 				       struct rpmb_data_frame *frm,
 				       const uint8_t *fek, const TEE_UUID *uuid)
 {
+	struct tee_fs_fek_ctx fek_ctx = { };
 	TEE_Result res;
 	uint8_t *data;
 	uint16_t idx;
@@ -662,11 +747,16 @@ static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	res = decrypt_init(&fek_ctx, fek, uuid);
+	if (res != TEE_SUCCESS)
+		return res;
+
 	data = rawdata->data;
 	bytes_to_u16(frm->address, &idx);
 
-	res = decrypt(data, frm, rawdata->len, rawdata->byte_offset, idx, fek,
-		      uuid);
+	res = decrypt(data, frm, rawdata->len, rawdata->byte_offset, idx,
+		      &fek_ctx);
+	tee_fs_fek_ctx_final(&fek_ctx);
 	return res;
 }
 
@@ -678,6 +768,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 					     const TEE_UUID *uuid)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
+	struct tee_fs_fek_ctx fek_ctx = { };
 	int i;
 	void *ctx = NULL;
 	uint16_t offset;
@@ -704,6 +795,10 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
+	res = decrypt_init(&fek_ctx, fek, uuid);
+	if (res != TEE_SUCCESS)
+		goto func_exit;
+
 	/*
 	 * Note: JEDEC JESD84-B51: "In every packet the address is the start
 	 * address of the full access (not address of the individual half a
@@ -736,7 +831,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 		}
 
 		res = decrypt(data, &localfrm, size, offset, start_idx + i,
-			      fek, uuid);
+			      &fek_ctx);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 
@@ -747,8 +842,8 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	size = (rawdata->len + rawdata->byte_offset) % RPMB_DATA_SIZE;
 	if (size == 0)
 		size = RPMB_DATA_SIZE;
-	res = decrypt(data, lastfrm, size, 0, start_idx + nbr_frms - 1, fek,
-		      uuid);
+	res = decrypt(data, lastfrm, size, 0, start_idx + nbr_frms - 1,
+		      &fek_ctx);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -764,6 +859,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	res = TEE_SUCCESS;
 
 func_exit:
+	tee_fs_fek_ctx_final(&fek_ctx);
 	crypto_mac_free_ctx(ctx);
 	return res;
 }
@@ -1375,6 +1471,146 @@ out_of_retries:
 	return TEE_ERROR_COMMUNICATION;
 }
 
+/*
+ * Writes blkcnt blocks split in reliable writes with a single
+ * RPMB_CMD_DATA_REQ_BATCH request. The write counter is incremented by
+ * each write so the frames and MACs of all the writes are computed before
+ * the request is sent. On return blks_written holds the number of blocks
+ * in the leading writes which are verified as completed.
+ */
+static TEE_Result write_batch(uint16_t dev_id, uint16_t blk_idx,
+			      const uint8_t *data_blks, uint16_t blkcnt,
+			      const uint8_t *fek, const TEE_UUID *uuid,
+			      uint16_t *blks_written)
+{
+	uint16_t rel_wr_blkcnt = rpmb_ctx->rel_wr_blkcnt;
+	uint32_t nbr_writes = ROUNDUP_DIV(blkcnt, rel_wr_blkcnt);
+	uint8_t hmac[RPMB_KEY_MAC_SIZE] = { };
+	struct rpmb_data_frame *resp = NULL;
+	struct rpmb_raw_data rawdata = { };
+	struct tee_rpmb_mem mem = { };
+	TEE_Result res = TEE_SUCCESS;
+	struct rpmb_req *req = NULL;
+	uint8_t *frms = NULL;
+	uint16_t tmp_blk_idx = 0;
+	uint16_t tmp_blkcnt = 0;
+	uint32_t wr_cnt = 0;
+	uint32_t n = 0;
+
+	*blks_written = 0;
+
+	res = tee_rpmb_alloc(sizeof(struct rpmb_req) +
+			     blkcnt * RPMB_DATA_FRAME_SIZE,
+			     nbr_writes * RPMB_DATA_FRAME_SIZE, &mem,
+			     (void *)&req, (void *)&resp);
+	if (res)
+		return res;
+
+	req->cmd = RPMB_CMD_DATA_REQ_BATCH;
+	req->dev_id = dev_id;
+	req->block_count = blkcnt;
+	frms = TEE_RPMB_REQ_DATA(req);
+
+	for (n = 0; n < nbr_writes; n++) {
+		tmp_blk_idx = blk_idx + n * rel_wr_blkcnt;
+		tmp_blkcnt = MIN(rel_wr_blkcnt, blkcnt - n * rel_wr_blkcnt);
+		wr_cnt = rpmb_ctx->wr_cnt + n;
+
+		memset(&rawdata, 0, sizeof(struct rpmb_raw_data));
+		rawdata.msg_type = RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE;
+		rawdata.block_count = &tmp_blkcnt;
+		rawdata.blk_idx = &tmp_blk_idx;
+		rawdata.write_counter = &wr_cnt;
+		rawdata.key_mac = hmac;
+		rawdata.data = (uint8_t *)data_blks +
+			       n * rel_wr_blkcnt * RPMB_DATA_SIZE;
+
+		res = tee_rpmb_frames_pack(frms + n * rel_wr_blkcnt *
+						  RPMB_DATA_FRAME_SIZE,
+					   &rawdata, tmp_blkcnt, fek, uuid);
+		if (res)
+			goto out;
+	}
+
+	res = tee_rpmb_invoke(&mem);
+	if (res) {
+		/* Older supplicants only know the single request commands */
+		if (res == TEE_ERROR_BAD_PARAMETERS ||
+		    res == TEE_ERROR_NOT_SUPPORTED) {
+			rpmb_no_write_batch = true;
+			res = TEE_ERROR_NOT_SUPPORTED;
+		}
+		goto out;
+	}
+
+	for (n = 0; n < nbr_writes; n++) {
+		tmp_blk_idx = blk_idx + n * rel_wr_blkcnt;
+		tmp_blkcnt = MIN(rel_wr_blkcnt, blkcnt - n * rel_wr_blkcnt);
+		wr_cnt = rpmb_ctx->wr_cnt;
+
+		memset(&rawdata, 0, sizeof(struct rpmb_raw_data));
+		rawdata.msg_type = RPMB_MSG_TYPE_RESP_AUTH_DATA_WRITE;
+		rawdata.block_count = &tmp_blkcnt;
+		rawdata.blk_idx = &tmp_blk_idx;
+		rawdata.write_counter = &wr_cnt;
+		rawdata.key_mac = hmac;
+
+		res = tee_rpmb_resp_unpack_verify(resp + n, &rawdata, 1, NULL,
+						  NULL);
+		if (res)
+			goto out;
+
+		*blks_written += tmp_blkcnt;
+	}
+
+out:
+	tee_rpmb_free(&mem);
+	return res;
+}
+
+/*
+ * Writes as much as possible of the blocks with batched requests and
+ * advances blk_idx, data_blks and blkcnt past the blocks written. Any
+ * remaining blocks are left to be written one reliable write at a time.
+ */
+static TEE_Result write_blk_batched(uint16_t dev_id, uint16_t *blk_idx,
+				    const uint8_t **data_blks,
+				    uint16_t *blkcnt, const uint8_t *fek,
+				    const TEE_UUID *uuid)
+{
+	uint16_t rel_wr_blkcnt = rpmb_ctx->rel_wr_blkcnt;
+	uint16_t max_blkcnt = MAX(rel_wr_blkcnt,
+				  (uint16_t)ROUNDDOWN(
+					RPMB_WRITE_BATCH_MAX_FRAMES,
+					rel_wr_blkcnt));
+	TEE_Result res = TEE_SUCCESS;
+	uint16_t blks_written = 0;
+
+	while (*blkcnt > rel_wr_blkcnt && !rpmb_no_write_batch) {
+		res = write_batch(dev_id, *blk_idx, *data_blks,
+				  MIN(*blkcnt, max_blkcnt), fek, uuid,
+				  &blks_written);
+
+		*blk_idx += blks_written;
+		*data_blks += blks_written * RPMB_DATA_SIZE;
+		*blkcnt -= blks_written;
+
+		if (res) {
+			if (res == TEE_ERROR_NOT_SUPPORTED)
+				return TEE_SUCCESS;
+			/*
+			 * Some of the unverified writes may have been
+			 * performed, resync the write counter and let the
+			 * remaining blocks be written again one by one.
+			 */
+			rpmb_ctx->wr_cnt_synced = false;
+			return tee_rpmb_init(dev_id);
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
 				     const uint8_t *fek, const TEE_UUID *uuid)
@@ -1400,6 +1636,11 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	res = write_blk_batched(dev_id, &blk_idx, &data_blks, &blkcnt, fek,
+				uuid);
+	if (res != TEE_SUCCESS || !blkcnt)
+		return res;
+
 	/*
 	 * We need to split data when block count
 	 * is bigger than reliable block write count.
@@ -1877,6 +2118,220 @@ post_read_in:
 	return TEE_SUCCESS;
 }
 
+/* 32-bit FNV-1a hash of at most @len characters of @name */
+static uint32_t fat_name_hash(const char *name, size_t len)
+{
+	uint32_t h = 0x811c9dc5;
+	size_t n = 0;
+
+	for (n = 0; n < len && name[n]; n++) {
+		h ^= (uint8_t)name[n];
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+/* Hash of the "/TA_uuid/" part of "/TA_uuid/object_id" */
+static uint32_t fat_dir_hash(const char *name)
+{
+	size_t n = 1;
+
+	while (n < TEE_RPMB_FS_FILENAME_LENGTH && name[n] && name[n] != '/')
+		n++;
+	if (n < TEE_RPMB_FS_FILENAME_LENGTH && name[n] == '/')
+		n++;
+
+	return fat_name_hash(name, n);
+}
+
+static uint32_t fat_index_address(uint32_t idx)
+{
+	return RPMB_FS_FAT_START_ADDRESS + idx * sizeof(struct rpmb_fat_entry);
+}
+
+static uint32_t *fat_index_bucket(uint32_t name_hash)
+{
+	return fat_index->buckets + (name_hash & (fat_index->num_buckets - 1));
+}
+
+static void fat_index_link(uint32_t idx)
+{
+	struct rpmb_fat_slot *slots = fat_index->slots;
+	uint32_t *p = fat_index_bucket(slots[idx].name_hash);
+
+	while (*p != RPMB_FAT_INDEX_NONE && *p < idx)
+		p = &slots[*p].next;
+
+	slots[idx].next = *p;
+	*p = idx;
+}
+
+static void fat_index_unlink(uint32_t idx)
+{
+	struct rpmb_fat_slot *slots = fat_index->slots;
+	uint32_t *p = fat_index_bucket(slots[idx].name_hash);
+
+	while (*p != RPMB_FAT_INDEX_NONE) {
+		if (*p == idx) {
+			*p = slots[idx].next;
+			return;
+		}
+		p = &slots[*p].next;
+	}
+}
+
+static TEE_Result fat_index_rehash(uint32_t num_buckets)
+{
+	uint32_t *buckets = NULL;
+	uint32_t n = 0;
+
+	buckets = malloc(num_buckets * sizeof(*buckets));
+	if (!buckets)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < num_buckets; n++)
+		buckets[n] = RPMB_FAT_INDEX_NONE;
+
+	free(fat_index->buckets);
+	fat_index->buckets = buckets;
+	fat_index->num_buckets = num_buckets;
+
+	for (n = 0; n < fat_index->num_slots; n++)
+		if (fat_index->slots[n].flags & FILE_IS_ACTIVE)
+			fat_index_link(n);
+
+	return TEE_SUCCESS;
+}
+
+static void fat_index_set_slot(uint32_t idx, const struct rpmb_fat_entry *fe)
+{
+	struct rpmb_fat_slot *slot = fat_index->slots + idx;
+
+	slot->name_hash = fat_name_hash(fe->filename, sizeof(fe->filename));
+	slot->dir_hash = fat_dir_hash(fe->filename);
+	slot->start_address = fe->start_address;
+	slot->data_size = fe->data_size;
+	slot->flags = fe->flags;
+	slot->next = RPMB_FAT_INDEX_NONE;
+}
+
+static TEE_Result fat_index_append(const struct rpmb_fat_entry *fe)
+{
+	uint32_t idx = fat_index->num_slots;
+	struct rpmb_fat_slot *slots = NULL;
+	uint32_t max_slots = 0;
+
+	if (idx == fat_index->max_slots) {
+		max_slots = MAX(2 * fat_index->max_slots,
+				(uint32_t)RPMB_FAT_INDEX_MIN_BUCKETS);
+		slots = realloc(fat_index->slots, max_slots * sizeof(*slots));
+		if (!slots)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		fat_index->slots = slots;
+		fat_index->max_slots = max_slots;
+	}
+
+	fat_index_set_slot(idx, fe);
+	fat_index->num_slots++;
+
+	/* Keep the average chain length below two */
+	if (fat_index->num_slots > 2 * fat_index->num_buckets)
+		return fat_index_rehash(2 * fat_index->num_buckets);
+
+	if (fe->flags & FILE_IS_ACTIVE)
+		fat_index_link(idx);
+
+	return TEE_SUCCESS;
+}
+
+/**
+ * fat_index_free: Free the FAT index, it's rebuilt by the next
+ * fat_index_init().
+ */
+static void fat_index_free(void)
+{
+	if (fat_index) {
+		free(fat_index->slots);
+		free(fat_index->buckets);
+		free(fat_index);
+		fat_index = NULL;
+	}
+}
+
+/**
+ * fat_index_init: Build the FAT index by traversing the FAT unless it's
+ * already available.
+ */
+static TEE_Result fat_index_init(void)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	struct rpmb_fat_entry *fe = NULL;
+
+	if (fat_index)
+		return TEE_SUCCESS;
+
+	res = fat_entry_dir_init();
+	if (res)
+		return res;
+
+	fat_index = calloc(1, sizeof(*fat_index));
+	if (!fat_index) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	res = fat_index_rehash(RPMB_FAT_INDEX_MIN_BUCKETS);
+	if (res)
+		goto out;
+
+	while (true) {
+		res = fat_entry_dir_get_next(&fe, NULL);
+		if (res || !fe)
+			break;
+
+		res = fat_index_append(fe);
+		if (res)
+			break;
+	}
+
+	if (!res && !fat_index->num_slots)
+		res = TEE_ERROR_CORRUPT_OBJECT;
+out:
+	fat_entry_dir_deinit();
+	if (res)
+		fat_index_free();
+	return res;
+}
+
+/**
+ * fat_index_update: Updates the FAT index with the FAT FS entry fat_entry
+ * that was written to address fat_address onto RPMB storage.
+ */
+static void fat_index_update(const struct rpmb_fat_entry *fat_entry,
+			     uint32_t fat_address)
+{
+	uint32_t idx = 0;
+
+	if (!fat_index)
+		return;
+
+	idx = (fat_address - RPMB_FS_FAT_START_ADDRESS) /
+	      sizeof(struct rpmb_fat_entry);
+
+	if (idx < fat_index->num_slots) {
+		if (fat_index->slots[idx].flags & FILE_IS_ACTIVE)
+			fat_index_unlink(idx);
+		fat_index_set_slot(idx, fat_entry);
+		if (fat_entry->flags & FILE_IS_ACTIVE)
+			fat_index_link(idx);
+		return;
+	}
+
+	if (idx > fat_index->num_slots || fat_index_append(fat_entry))
+		fat_index_free();
+}
+
 #if (TRACE_LEVEL >= TRACE_FLOW)
 static void dump_fat(void)
 {
@@ -2014,6 +2469,15 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 
 	dump_fat();
 
+	/*
+	 * The entry may or may not have reached RPMB storage if the write
+	 * failed, so in that case rebuild the index on next use.
+	 */
+	if (res)
+		fat_index_free();
+	else
+		fat_index_update(&fh->fat_entry, fh->rpmb_fat_address);
+
 	/* If caching enabled, update a successfully written entry in cache. */
 	if (CFG_RPMB_FS_CACHE_ENTRIES && !res)
 		res = fat_entry_dir_update(&fh->fat_entry,
@@ -2168,6 +2632,119 @@ static TEE_Result get_fat_start_address(uint32_t *addr)
  * Build up memory pool and return matching entry for write operation.
  * "Last FAT entry" can be returned during write.
  */
+/**
+ * reserve_fat: Represent the FAT table in the memory pool.
+ * last_fat_address is the address of the entry flagged FILE_IS_LAST_ENTRY.
+ * If expand_fat is true the last entry has been chosen to store a file and
+ * a new last entry is written after it.
+ */
+static TEE_Result reserve_fat(tee_mm_pool_t *p, uint32_t last_fat_address,
+			      bool expand_fat)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	/*
+	 * Since last_fat_address is the start of the last entry it needs
+	 * to be moved up by an entry.
+	 */
+	uint32_t fat_address = last_fat_address + sizeof(struct rpmb_fat_entry);
+	struct rpmb_file_handle last_fh;
+
+	/* Make room for yet a FAT entry and add to memory pool. */
+	if (expand_fat)
+		fat_address += sizeof(struct rpmb_fat_entry);
+
+	if (!tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	if (expand_fat) {
+		/* Point fat_address to the beginning of the new entry. */
+		fat_address -= sizeof(struct rpmb_fat_entry);
+		memset(&last_fh, 0, sizeof(last_fh));
+		last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
+		last_fh.rpmb_fat_address = fat_address;
+		res = write_fat_entry(&last_fh, true);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/**
+ * read_fat_indexed: Same as read_fat() but using the FAT index. Only the
+ * FAT entries with a matching filename hash are read from RPMB storage.
+ */
+static TEE_Result read_fat_indexed(struct rpmb_file_handle *fh,
+				   tee_mm_pool_t *p)
+{
+	uint32_t name_hash = fat_name_hash(fh->filename, sizeof(fh->filename));
+	struct rpmb_fat_slot *slots = fat_index->slots;
+	TEE_Result res = TEE_ERROR_GENERIC;
+	struct rpmb_fat_entry fe = { };
+	uint32_t fat_address = 0;
+	bool expand_fat = false;
+	uint32_t idx = 0;
+
+	for (idx = *fat_index_bucket(name_hash); idx != RPMB_FAT_INDEX_NONE;
+	     idx = slots[idx].next) {
+		if (slots[idx].name_hash != name_hash)
+			continue;
+
+		fat_address = fat_index_address(idx);
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+				    (uint8_t *)&fe, sizeof(fe), NULL, NULL);
+		if (res)
+			return res;
+
+		if (!strcmp(fh->filename, fe.filename) &&
+		    (fe.flags & FILE_IS_ACTIVE)) {
+			fh->rpmb_fat_address = fat_address;
+			memcpy(&fh->fat_entry, &fe, sizeof(fe));
+			break;
+		}
+	}
+
+	if (p) {
+		for (idx = 0; idx < fat_index->num_slots; idx++) {
+			fat_address = fat_index_address(idx);
+
+			/* Add existing files to memory pool. (write) */
+			if ((slots[idx].flags & FILE_IS_ACTIVE) &&
+			    slots[idx].data_size > 0 &&
+			    !tee_mm_alloc2(p, slots[idx].start_address,
+					   slots[idx].data_size))
+				return TEE_ERROR_OUT_OF_MEMORY;
+
+			/*
+			 * Unused FAT entries can be reused (write), they
+			 * are cleared when the file is removed.
+			 */
+			if (!(slots[idx].flags & FILE_IS_ACTIVE) &&
+			    !fh->rpmb_fat_address) {
+				fh->rpmb_fat_address = fat_address;
+				memset(&fh->fat_entry, 0,
+				       sizeof(struct rpmb_fat_entry));
+				fh->fat_entry.flags = slots[idx].flags;
+			}
+
+			if (slots[idx].flags & FILE_IS_LAST_ENTRY) {
+				expand_fat = fh->rpmb_fat_address ==
+					     fat_address;
+				break;
+			}
+		}
+
+		res = reserve_fat(p, fat_address, expand_fat);
+		if (res)
+			return res;
+	}
+
+	if (!fh->rpmb_fat_address)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
@@ -2176,10 +2753,13 @@ static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 	uint32_t fat_address;
 	bool entry_found = false;
 	bool expand_fat = false;
-	struct rpmb_file_handle last_fh;
 
 	DMSG("fat_address %d", fh->rpmb_fat_address);
 
+	/* Fall back to traversing the FAT if the index can't be built */
+	if (!fat_index_init())
+		return read_fat_indexed(fh, p);
+
 	res = fat_entry_dir_init();
 	if (res)
 		goto out;
@@ -2247,39 +2827,12 @@ static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 
 	if (res)
 		goto out;
-	/*
-	 * Represent the FAT table in the pool.
-	 */
-	if (p) {
-		/*
-		 * Since fat_address is the start of the last entry it needs to
-		 * be moved up by an entry.
-		 */
-		fat_address += sizeof(struct rpmb_fat_entry);
-
-		/* Make room for yet a FAT entry and add to memory pool. */
-		if (expand_fat)
-			fat_address += sizeof(struct rpmb_fat_entry);
 
-		mm = tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address);
-		if (!mm) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
+	/* Represent the FAT table in the pool. */
+	if (p) {
+		res = reserve_fat(p, fat_address, expand_fat);
+		if (res)
 			goto out;
-		}
-
-		if (expand_fat) {
-			/*
-			 * Point fat_address to the beginning of the new
-			 * entry.
-			 */
-			fat_address -= sizeof(struct rpmb_fat_entry);
-			memset(&last_fh, 0, sizeof(last_fh));
-			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
-			last_fh.rpmb_fat_address = fat_address;
-			res = write_fat_entry(&last_fh, true);
-			if (res != TEE_SUCCESS)
-				goto out;
-		}
 	}
 
 	if (!fh->rpmb_fat_address)
@@ -2419,6 +2972,12 @@ out:
 	return res;
 }
 
+/*
+ * Writes the file with the new data at its new location. Whole RPMB
+ * blocks of new data are written straight from the caller's buffer,
+ * the temporary buffer is only used for the blocks which also hold old
+ * data.
+ */
 static TEE_Result update_write_helper(struct rpmb_file_handle *fh,
 				      size_t pos, const void *buf,
 				      size_t size, uintptr_t new_fat,
@@ -2438,15 +2997,34 @@ static TEE_Result update_write_helper(struct rpmb_file_handle *fh,
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	while (blk_offset < new_size) {
-		uint8_t *copy_dst = blk_buf;
+		size_t copy_offset = 0;
 		size_t copy_size = 0;
 		size_t rd_size = 0;
 
+		/*
+		 * Once past pos, rem_buf holds the data for blk_offset and
+		 * new_fat + blk_offset is block aligned.
+		 */
+		if (blk_offset >= pos && rem_size >= RPMB_DATA_SIZE) {
+			blk_size = ROUNDDOWN(rem_size, RPMB_DATA_SIZE);
+			res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID,
+					     new_fat + blk_offset, rem_buf,
+					     blk_size, fh->fat_entry.fek,
+					     fh->uuid);
+			if (res != TEE_SUCCESS)
+				break;
+
+			rem_buf += blk_size;
+			rem_size -= blk_size;
+			blk_offset += blk_size;
+			continue;
+		}
+
 		blk_size = MIN(TMP_BLOCK_SIZE, new_size - blk_offset);
 		memset(blk_buf, 0, blk_size);
 
 		/* Possibly read old RPMB data in temporary buffer */
-		if (blk_offset < pos && blk_offset < old_size) {
+		if (blk_offset < old_size) {
 			rd_size = MIN(blk_size, old_size - blk_offset);
 
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
@@ -2458,22 +3036,12 @@ static TEE_Result update_write_helper(struct rpmb_file_handle *fh,
 		}
 
 		/* Possibly update data in temporary buffer */
-		if ((blk_offset + TMP_BLOCK_SIZE > pos) &&
-		    (blk_offset < pos + size)) {
-			size_t offset = 0;
+		if (rem_size && blk_offset + blk_size > pos) {
+			if (blk_offset < pos)
+				copy_offset = pos - blk_offset;
+			copy_size = MIN(blk_size - copy_offset, rem_size);
 
-			copy_dst = blk_buf;
-			copy_size = TMP_BLOCK_SIZE;
-
-			if (blk_offset < pos) {
-				offset = pos - blk_offset;
-
-				copy_dst += offset;
-				copy_size -= offset;
-			}
-			copy_size = MIN(copy_size, rem_size);
-
-			memcpy(copy_dst, rem_buf, copy_size);
+			memcpy(blk_buf + copy_offset, rem_buf, copy_size);
 			rem_buf += copy_size;
 			rem_size -= copy_size;
 		}
@@ -2795,66 +3363,118 @@ static void rpmb_fs_dir_free(struct tee_fs_dir *dir)
 	}
 }
 
+/**
+ * rpmb_fs_dir_add: Queue the active FAT FS entry fe in dir if its filename
+ * is in the directory path. Sets *added if the entry was queued.
+ */
+static TEE_Result rpmb_fs_dir_add(const char *path, uint32_t pathlen,
+				  struct rpmb_fat_entry *fe,
+				  struct tee_fs_dir *dir, bool *added)
+{
+	struct tee_rpmb_fs_dirent *next = NULL;
+	char *filename = fe->filename;
+	bool matched = false;
+	uint32_t filelen = 0;
+	char temp = 0;
+
+	filelen = strlen(filename);
+	if (filelen > pathlen) {
+		temp = filename[pathlen];
+		filename[pathlen] = '\0';
+		if (strcmp(filename, path) == 0)
+			matched = true;
+
+		filename[pathlen] = temp;
+	}
+
+	if (!matched)
+		return TEE_SUCCESS;
+
+	next = malloc(sizeof(*next));
+	if (!next)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	next->entry.oidlen = tee_hs2b((uint8_t *)&filename[pathlen],
+				      next->entry.oid, filelen - pathlen,
+				      sizeof(next->entry.oid));
+	if (next->entry.oidlen) {
+		SIMPLEQ_INSERT_TAIL(&dir->next, next, link);
+		*added = true;
+	} else {
+		free(next);
+	}
+
+	return TEE_SUCCESS;
+}
+
+/**
+ * rpmb_fs_dir_populate_indexed: Same as rpmb_fs_dir_populate() but only
+ * reads the active FAT FS entries in the directory according to the FAT
+ * index.
+ */
+static TEE_Result rpmb_fs_dir_populate_indexed(const char *path,
+					       uint32_t pathlen,
+					       struct tee_fs_dir *dir,
+					       bool *added)
+{
+	struct rpmb_fat_slot *slots = fat_index->slots;
+	uint32_t dir_hash = fat_dir_hash(path);
+	TEE_Result res = TEE_SUCCESS;
+	struct rpmb_fat_entry fe = { };
+	uint32_t idx = 0;
+
+	for (idx = 0; idx < fat_index->num_slots; idx++) {
+		if (slots[idx].flags & FILE_IS_LAST_ENTRY)
+			break;
+		if (!(slots[idx].flags & FILE_IS_ACTIVE) ||
+		    slots[idx].dir_hash != dir_hash)
+			continue;
+
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_index_address(idx),
+				    (uint8_t *)&fe, sizeof(fe), NULL, NULL);
+		if (res)
+			return res;
+
+		if (fe.flags & FILE_IS_ACTIVE) {
+			res = rpmb_fs_dir_add(path, pathlen, &fe, dir, added);
+			if (res)
+				return res;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result rpmb_fs_dir_populate(const char *path,
 				       struct tee_fs_dir *dir)
 {
-	struct tee_rpmb_fs_dirent *current = NULL;
 	struct rpmb_fat_entry *fe = NULL;
 	uint32_t fat_address;
-	uint32_t filelen;
-	char *filename;
-	bool matched;
-	struct tee_rpmb_fs_dirent *next = NULL;
+	bool added = false;
 	uint32_t pathlen;
 	TEE_Result res = TEE_ERROR_GENERIC;
-	char temp;
 
 	mutex_lock(&rpmb_mutex);
 
-	res = fat_entry_dir_init();
-	if (res)
-		goto out;
-
 	pathlen = strlen(path);
 
-	while (true) {
-		res = fat_entry_dir_get_next(&fe, &fat_address);
-		if (res || !fe)
-			break;
-
-		filename = fe->filename;
-		if (fe->flags & FILE_IS_ACTIVE) {
-			matched = false;
-			filelen = strlen(filename);
-			if (filelen > pathlen) {
-				temp = filename[pathlen];
-				filename[pathlen] = '\0';
-				if (strcmp(filename, path) == 0)
-					matched = true;
-
-				filename[pathlen] = temp;
-			}
+	if (!fat_index_init()) {
+		res = rpmb_fs_dir_populate_indexed(path, pathlen, dir, &added);
+	} else {
+		res = fat_entry_dir_init();
+		if (res)
+			goto out;
 
-			if (matched) {
-				next = malloc(sizeof(*next));
-				if (!next) {
-					res = TEE_ERROR_OUT_OF_MEMORY;
-					goto out;
-				}
+		while (true) {
+			res = fat_entry_dir_get_next(&fe, &fat_address);
+			if (res || !fe)
+				break;
 
-				next->entry.oidlen = tee_hs2b((uint8_t *)
-						&filename[pathlen],
-						next->entry.oid,
-						filelen - pathlen,
-						sizeof(next->entry.oid));
-				if (next->entry.oidlen) {
-					SIMPLEQ_INSERT_TAIL(&dir->next,
-							    next, link);
-					current = next;
-				} else {
-					free(next);
-					next = NULL;
-				}
+			if (fe->flags & FILE_IS_ACTIVE) {
+				res = rpmb_fs_dir_add(path, pathlen, fe, dir,
+						      &added);
+				if (res)
+					break;
 			}
 		}
 	}
@@ -2862,7 +3482,7 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 	if (res)
 		goto out;
 
-	if (current)
+	if (added)
 		res = TEE_SUCCESS;
 	else
 		res = TEE_ERROR_ITEM_NOT_FOUND; /* No directories were found. */
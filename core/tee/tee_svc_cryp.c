@@ -43,6 +43,7 @@ enum cryp_state {
 typedef void (*tee_cryp_ctx_finalize_func_t) (void *ctx);
 struct tee_cryp_state {
 	TAILQ_ENTRY(tee_cryp_state) link;
+	struct tee_handle_node handle;
 	uint32_t algo;
 	uint32_t mode;
 	vaddr_t key1;
@@ -2009,16 +2010,16 @@ static TEE_Result tee_svc_cryp_get_state(struct ts_session *sess,
 					 vaddr_t state_id,
 					 struct tee_cryp_state **state)
 {
-	struct tee_cryp_state *s;
 	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
+	struct tee_handle_node *node = NULL;
 
-	TAILQ_FOREACH(s, &utc->cryp_states, link) {
-		if (state_id == (vaddr_t)s) {
-			*state = s;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	node = tee_handle_table_find(&utc->handles, state_id,
+				     TEE_HANDLE_TYPE_CRYP_STATE);
+	if (!node)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*state = container_of(node, struct tee_cryp_state, handle);
+	return TEE_SUCCESS;
 }
 
 static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
@@ -2031,6 +2032,7 @@ static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
 		tee_obj_close(utc, o);
 
 	TAILQ_REMOVE(&utc->cryp_states, cs, link);
+	tee_handle_table_remove(&utc->handles, &cs->handle);
 	if (cs->ctx_finalize != NULL)
 		cs->ctx_finalize(cs->ctx);
 
@@ -2195,6 +2197,8 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	if (!cs)
 		return TEE_ERROR_OUT_OF_MEMORY;
 	TAILQ_INSERT_TAIL(&utc->cryp_states, cs, link);
+	tee_handle_table_add(&utc->handles, &cs->handle, (vaddr_t)cs,
+			     TEE_HANDLE_TYPE_CRYP_STATE);
 	cs->algo = algo;
 	cs->mode = mode;
 	cs->state = CRYP_STATE_UNINITIALIZED;
@@ -35,6 +35,7 @@ struct tee_svc_storage_head {
 
 struct tee_storage_enum {
 	TAILQ_ENTRY(tee_storage_enum) link;
+	struct tee_handle_node handle;
 	struct tee_fs_dir *dir;
 	const struct tee_file_operations *fops;
 };
@@ -43,15 +44,15 @@ static TEE_Result tee_svc_storage_get_enum(struct user_ta_ctx *utc,
 					   vaddr_t enum_id,
 					   struct tee_storage_enum **e_out)
 {
-	struct tee_storage_enum *e;
+	struct tee_handle_node *node = NULL;
 
-	TAILQ_FOREACH(e, &utc->storage_enums, link) {
-		if (enum_id == (vaddr_t)e) {
-			*e_out = e;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	node = tee_handle_table_find(&utc->handles, enum_id,
+				     TEE_HANDLE_TYPE_STORAGE_ENUM);
+	if (!node)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*e_out = container_of(node, struct tee_storage_enum, handle);
+	return TEE_SUCCESS;
 }
 
 static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
@@ -61,6 +62,7 @@ static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	TAILQ_REMOVE(&utc->storage_enums, e, link);
+	tee_handle_table_remove(&utc->handles, &e->handle);
 
 	if (e->fops)
 		e->fops->closedir(e->dir);
@@ -169,7 +171,8 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 					  TEE_DATA_FLAG_ACCESS_WRITE |
 					  TEE_DATA_FLAG_ACCESS_WRITE_META |
 					  TEE_DATA_FLAG_SHARE_READ |
-					  TEE_DATA_FLAG_SHARE_WRITE;
+					  TEE_DATA_FLAG_SHARE_WRITE |
+					  TEE_DATA_FLAG_DEFER_COMMIT;
 	const struct tee_file_operations *fops =
 			tee_svc_storage_file_ops(storage_id);
 	struct ts_session *sess = ts_get_current_session();
@@ -314,7 +317,8 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 					  TEE_DATA_FLAG_ACCESS_WRITE_META |
 					  TEE_DATA_FLAG_SHARE_READ |
 					  TEE_DATA_FLAG_SHARE_WRITE |
-					  TEE_DATA_FLAG_OVERWRITE;
+					  TEE_DATA_FLAG_OVERWRITE |
+					  TEE_DATA_FLAG_DEFER_COMMIT;
 	const struct tee_file_operations *fops =
 			tee_svc_storage_file_ops(storage_id);
 	struct ts_session *sess = ts_get_current_session();
@@ -448,6 +452,14 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 		free(data);
 	}
 
+	/*
+	 * Deferred writes are dropped rather than committed since the
+	 * object is removed, and the dirfile entry they would update on
+	 * close is gone after that.
+	 */
+	if (o->pobj->fops->discard)
+		o->pobj->fops->discard(o->fh);
+
 	res = o->pobj->fops->remove(o->pobj);
 	tee_obj_close(utc, o);
 
@@ -533,6 +545,8 @@ TEE_Result syscall_storage_alloc_enum(uint32_t *obj_enum)
 	e->dir = NULL;
 	e->fops = NULL;
 	TAILQ_INSERT_TAIL(&utc->storage_enums, e, link);
+	tee_handle_table_add(&utc->handles, &e->handle, (vaddr_t)e,
+			     TEE_HANDLE_TYPE_STORAGE_ENUM);
 
 	return copy_kaddr_to_uref(obj_enum, e);
 }
@@ -833,6 +847,27 @@ exit:
 	return res;
 }
 
+TEE_Result syscall_storage_obj_sync(unsigned long obj)
+{
+	struct ts_session *sess = ts_get_current_session();
+	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_obj *o = NULL;
+
+	res = tee_obj_get(utc, uref_to_vaddr(obj), &o);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!(o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT))
+		return TEE_ERROR_BAD_STATE;
+
+	/* Nothing is deferred unless the file system supports it */
+	if (!o->pobj->fops->sync)
+		return TEE_SUCCESS;
+
+	return o->pobj->fops->sync(o->fh);
+}
+
 TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 				    unsigned long whence)
 {
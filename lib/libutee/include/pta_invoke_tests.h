@@ -103,5 +103,40 @@
  */
 #define PTA_INVOKE_TESTS_CMD_MEMREF_NULL	10
 
+/*
+ * tee_mm allocator performance test, the pool is fragmented with
+ * value[0].a / 2 one page holes before the timed operations.
+ *
+ * [in]     value[0].a	Number of single page entries
+ * [in]     value[0].b	0: normal pool, 1: TEE_MM_POOL_HI_ALLOC pool
+ * [out]    value[1].a	Microseconds to allocate value[0].a / 2
+ *			two page entries
+ * [out]    value[1].b	Microseconds to tee_mm_find() every page
+ * [out]    value[2].a	Microseconds to free all entries
+ */
+#define PTA_INVOKE_TESTS_CMD_MM_PERF		11
+
+/*
+ * FS hash-tree performance test, an object is written and then opened
+ * repeatedly to measure reading and verifying the hash-tree.
+ *
+ * [in]     value[0].a	Number of blocks in the object
+ * [in]     value[0].b	Number of times the object is opened
+ * [out]    value[1].a	Microseconds to open the object value[0].b times
+ * [out]    value[1].b	Microseconds to sync the written object
+ */
+#define PTA_INVOKE_TESTS_CMD_FS_HTREE_PERF	12
+
+/*
+ * RPMB storage throughput test, an object is created in RPMB storage,
+ * written and read repeatedly and then removed.
+ *
+ * [in]     value[0].a	Size of the object in bytes
+ * [in]     value[0].b	Number of times the object is written and read
+ * [out]    value[1].a	Microseconds to write the object value[0].b times
+ * [out]    value[1].b	Microseconds to read the object value[0].b times
+ */
+#define PTA_INVOKE_TESTS_CMD_RPMB_PERF		13
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
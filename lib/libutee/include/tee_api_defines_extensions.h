@@ -20,6 +20,17 @@
  */
 #define TEE_ERROR_DEFER_DRIVER_INIT	0x80000000
 
+/*
+ * Persistent object flag, TEE_DATA_FLAG_DEFER_COMMIT lets writes to the
+ * object data be committed to storage later than when
+ * TEE_WriteObjectData() returns. Pending writes are committed together
+ * by TEE_SyncPersistentObject(), TEE_TruncateObjectData(),
+ * TEE_CloseObject() or when a size or time limit is reached. Until then
+ * other handles of the object and a restarted TEE see the previously
+ * committed object data. All handles of an object must agree on this flag.
+ */
+#define TEE_DATA_FLAG_DEFER_COMMIT	0x80000000
+
 /*
  * HMAC-based Extract-and-Expand Key Derivation Function (HKDF)
  */
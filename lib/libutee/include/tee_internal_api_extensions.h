@@ -35,6 +35,12 @@ TEE_Result TEE_CacheClean(char *buf, size_t len);
 TEE_Result TEE_CacheFlush(char *buf, size_t len);
 TEE_Result TEE_CacheInvalidate(char *buf, size_t len);
 
+/*
+ * TEE_SyncPersistentObject() - commit pending writes of a persistent object
+ * opened or created with TEE_DATA_FLAG_DEFER_COMMIT
+ */
+TEE_Result TEE_SyncPersistentObject(TEE_ObjectHandle object);
+
 /*
  * tee_map_zi() - Map zero initialized memory
  * @len:	Number of bytes
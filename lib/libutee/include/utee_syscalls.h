@@ -286,6 +286,9 @@ TEE_Result _utee_se_channel_close(unsigned long c);
 /* op is of type enum _utee_cache_operation */
 TEE_Result _utee_cache_operation(void *va, size_t l, unsigned long op);
 
+/* obj is of type TEE_ObjectHandle */
+TEE_Result _utee_storage_obj_sync(unsigned long obj);
+
 TEE_Result _utee_gprof_send(void *buf, size_t size, uint32_t *id);
 
 #endif /* UTEE_SYSCALLS_H */
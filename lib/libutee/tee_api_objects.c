@@ -707,6 +707,27 @@ out:
 	return res;
 }
 
+TEE_Result TEE_SyncPersistentObject(TEE_ObjectHandle object)
+{
+	TEE_Result res;
+
+	if (object == TEE_HANDLE_NULL) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
+	}
+
+	res = _utee_storage_obj_sync((unsigned long)object);
+
+out:
+	if (res != TEE_SUCCESS &&
+	    res != TEE_ERROR_STORAGE_NO_SPACE &&
+	    res != TEE_ERROR_CORRUPT_OBJECT &&
+	    res != TEE_ERROR_STORAGE_NOT_AVAILABLE)
+		TEE_Panic(res);
+
+	return res;
+}
+
 TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
 			      TEE_Whence whence)
 {
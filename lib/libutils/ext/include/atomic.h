@@ -63,4 +63,13 @@ static inline void atomic_store_u32(uint32_t *p, uint32_t val)
 	__compiler_atomic_store(p, val);
 }
 
+/*
+ * Clears the bits of *p not in val, memory accesses before this are
+ * completed first. Returns the previous value of *p.
+ */
+static inline uint32_t atomic_fetch_and_release_u32(uint32_t *p, uint32_t val)
+{
+	return __compiler_atomic_fetch_and_release(p, val);
+}
+
 #endif /*__ATOMIC_H*/
@@ -246,6 +246,8 @@
 				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) \
 
 #define __compiler_atomic_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define __compiler_atomic_fetch_and_release(p, val) \
+	__atomic_fetch_and((p), (val), __ATOMIC_RELEASE)
 #define __compiler_atomic_store(p, val) \
 	__atomic_store_n((p), (val), __ATOMIC_RELAXED)
 
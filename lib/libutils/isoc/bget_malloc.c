@@ -90,6 +90,7 @@
 #if defined(__KERNEL__)
 /* Compiling for TEE Core */
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/thread.h>
 #include <kernel/spinlock.h>
 #include <kernel/unwind.h>
@@ -141,6 +142,46 @@ static __maybe_unused void *memcpy_unchecked(void *dst, const void *src,
 
 #include "bget.c"		/* this is ugly, but this is bget */
 
+/*
+ * Magazines are small per-CPU (TEE Core) or per-context (TA) stacks of
+ * free buffers, one per size class, kept in front of bget. A malloc() or
+ * free() of a small buffer is served from the magazine of the current CPU
+ * without taking the global malloc lock or walking the bget free list.
+ * Buffers in a magazine are still allocated as far as bget is concerned.
+ */
+#if !defined(ENABLE_MDBG) && \
+	((defined(__KERNEL__) && defined(CFG_CORE_MALLOC_MAGAZINE)) || \
+	 (!defined(__KERNEL__) && !defined(__LDELF__) && \
+	  defined(CFG_TA_MALLOC_MAGAZINE)))
+#define WITH_MAGAZINE
+#endif
+
+#ifdef WITH_MAGAZINE
+#ifdef __KERNEL__
+#define MAG_NUM_CACHES		CFG_TEE_CORE_NB_CORE
+#else
+#define MAG_NUM_CACHES		1
+#endif
+/* Size classes are SizeQuant, 2 * SizeQuant, ..., 32 * SizeQuant */
+#define MAG_NUM_CLASSES		6
+#define MAG_NUM_SLOTS		8
+/* Number of buffers moved to or from bget when a magazine is empty/full */
+#define MAG_BATCH		(MAG_NUM_SLOTS / 2)
+
+struct malloc_mag {
+	size_t count;
+	void *slots[MAG_NUM_SLOTS];
+};
+
+struct malloc_mag_cache {
+#ifdef __KERNEL__
+	unsigned int lock;
+#endif
+	size_t cached_bytes;
+	struct malloc_mag mag[MAG_NUM_CLASSES];
+};
+#endif /*WITH_MAGAZINE*/
+
 struct malloc_pool {
 	void *buf;
 	size_t len;
@@ -156,6 +197,10 @@ struct malloc_ctx {
 #ifdef __KERNEL__
 	unsigned int spinlock;
 #endif
+#ifdef WITH_MAGAZINE
+	/* Array of MAG_NUM_CACHES, NULL for contexts without magazines */
+	struct malloc_mag_cache *mag_cache;
+#endif
 };
 
 #ifdef __KERNEL__
@@ -184,14 +229,28 @@ static void malloc_unlock(struct malloc_ctx *ctx __unused,
 
 #endif	/* __KERNEL__ */
 
+#ifdef WITH_MAGAZINE
+#define MAG_CTX_INIT(name)	, .mag_cache = name##_mag_cache
+#else
+#define MAG_CTX_INIT(name)
+#endif
+
 #define DEFINE_CTX(name) struct malloc_ctx name =		\
 	{ .poolset = { .freelist = { {0, 0},			\
 			{&name.poolset.freelist,		\
-			 &name.poolset.freelist}}}}
+			 &name.poolset.freelist}}}		\
+	  MAG_CTX_INIT(name) }
 
+#ifdef WITH_MAGAZINE
+static struct malloc_mag_cache malloc_ctx_mag_cache[MAG_NUM_CACHES];
+#endif
 static DEFINE_CTX(malloc_ctx);
 
 #ifdef CFG_VIRTUALIZATION
+#ifdef WITH_MAGAZINE
+static __nex_bss struct malloc_mag_cache
+	nex_malloc_ctx_mag_cache[MAG_NUM_CACHES];
+#endif
 static __nex_data DEFINE_CTX(nex_malloc_ctx);
 #endif
 
@@ -203,21 +262,362 @@ static void print_oom(size_t req_size __maybe_unused, void *ctx __maybe_unused)
 #endif
 }
 
+/* Most of the stuff in this function is copied from bgetr() in bget.c */
+static __maybe_unused bufsize bget_buf_size(void *buf)
+{
+	bufsize osize;          /* Old size of buffer */
+	struct bhead *b;
+
+	b = BH(((char *)buf) - sizeof(struct bhead));
+	osize = -b->bsize;
+#ifdef BECtl
+	if (osize == 0) {
+		/*  Buffer acquired directly through acqfcn. */
+		struct bdhead *bd;
+
+		bd = BDH(((char *)buf) - sizeof(struct bdhead));
+		osize = bd->tsize - sizeof(struct bdhead) - bd->offs;
+	} else
+#endif
+		osize -= sizeof(struct bhead);
+	assert(osize > 0);
+	return osize;
+}
+
+#ifdef WITH_MAGAZINE
+
+#ifdef __KERNEL__
+
+static struct malloc_mag_cache *mag_cache_lock(struct malloc_ctx *ctx,
+					       uint32_t *exceptions)
+{
+	struct malloc_mag_cache *mc = NULL;
+
+	/* Masking exceptions keeps us on this CPU until unlocked */
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	mc = ctx->mag_cache + get_core_pos();
+	cpu_spin_lock(&mc->lock);
+
+	return mc;
+}
+
+static void mag_cache_unlock(struct malloc_mag_cache *mc, uint32_t exceptions)
+{
+	cpu_spin_unlock(&mc->lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+static bool mag_cache_trylock(struct malloc_mag_cache *mc)
+{
+	return cpu_spin_trylock(&mc->lock);
+}
+
+static void mag_cache_unlock_nox(struct malloc_mag_cache *mc)
+{
+	cpu_spin_unlock(&mc->lock);
+}
+
+#else  /* __KERNEL__ */
+
+static struct malloc_mag_cache *mag_cache_lock(struct malloc_ctx *ctx,
+					       uint32_t *exceptions)
+{
+	*exceptions = 0;
+	return ctx->mag_cache;
+}
+
+static void mag_cache_unlock(struct malloc_mag_cache *mc __unused,
+			     uint32_t exceptions __unused)
+{
+}
+
+static bool mag_cache_trylock(struct malloc_mag_cache *mc __unused)
+{
+	/*
+	 * A TA is single threaded and mag_reclaim() is never called from
+	 * within a magazine operation.
+	 */
+	return true;
+}
+
+static void mag_cache_unlock_nox(struct malloc_mag_cache *mc __unused)
+{
+}
+
+#endif /* __KERNEL__ */
+
+static size_t mag_class_size(size_t cls)
+{
+	return (size_t)SizeQuant << cls;
+}
+
+/* Returns the smallest class able to hold @size bytes */
+static bool mag_class_for_alloc(size_t size, size_t *cls)
+{
+	size_t n = 0;
+
+	for (n = 0; n < MAG_NUM_CLASSES; n++) {
+		if (size <= mag_class_size(n)) {
+			*cls = n;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Returns the class of a buffer with @bsize usable bytes, that is the
+ * largest class not larger than the buffer. Buffers more than twice the
+ * size of the class are not cached to bound the waste.
+ */
+static bool mag_class_for_free(size_t bsize, size_t *cls)
+{
+	size_t n = MAG_NUM_CLASSES;
+
+	while (n) {
+		n--;
+		if (bsize >= mag_class_size(n)) {
+			if (bsize >= 2 * mag_class_size(n))
+				return false;
+			*cls = n;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void mag_push(struct malloc_mag_cache *mc, size_t cls, void *buf)
+{
+	struct malloc_mag *mag = mc->mag + cls;
+	size_t bsize = bget_buf_size(buf);
+
+	assert(mag->count < MAG_NUM_SLOTS);
+	tag_asan_free(buf, bsize);
+	mag->slots[mag->count] = buf;
+	mag->count++;
+	/* Count the bget header too to match poolset.totalloc */
+	mc->cached_bytes += bsize + sizeof(struct bhead);
+}
+
+static void *mag_pop(struct malloc_mag_cache *mc, size_t cls)
+{
+	struct malloc_mag *mag = mc->mag + cls;
+	void *buf = NULL;
+
+	if (!mag->count)
+		return NULL;
+
+	mag->count--;
+	buf = mag->slots[mag->count];
+	mc->cached_bytes -= bget_buf_size(buf) + sizeof(struct bhead);
+
+	return buf;
+}
+
+static __maybe_unused size_t mag_cached_bytes(struct malloc_ctx *ctx)
+{
+	size_t ret = 0;
+	size_t n = 0;
+
+	if (!ctx->mag_cache)
+		return 0;
+
+	/* Unlocked, each counter is only an approximation anyway */
+	for (n = 0; n < MAG_NUM_CACHES; n++)
+		ret += ctx->mag_cache[n].cached_bytes;
+
+	return ret;
+}
+
+/* Called with the global malloc lock held */
+static void mag_update_max_allocated(struct malloc_ctx *ctx __maybe_unused)
+{
 #ifdef BufStats
+	/* Buffers left in the magazines aren't in use */
+	size_t in_use = ctx->poolset.totalloc - mag_cached_bytes(ctx);
+
+	if (in_use > ctx->mstats.max_allocated)
+		ctx->mstats.max_allocated = in_use;
+#endif
+}
+
+/*
+ * Called with the magazine locked, takes the global malloc lock. Refills
+ * the magazine and returns one of the buffers, or NULL if bget is out of
+ * memory.
+ */
+static void *mag_refill(struct malloc_ctx *ctx, struct malloc_mag_cache *mc,
+			size_t cls)
+{
+	uint32_t exceptions = malloc_lock(ctx);
+	void *buf = NULL;
+	size_t n = 0;
+
+	for (n = 0; n < MAG_BATCH; n++) {
+		buf = bget(SizeQ, 0, mag_class_size(cls), &ctx->poolset);
+		if (!buf)
+			break;
+		mag_push(mc, cls, buf);
+	}
+	buf = mag_pop(mc, cls);
+	mag_update_max_allocated(ctx);
+	malloc_unlock(ctx, exceptions);
+
+	return buf;
+}
+
+/* Called with the magazine locked and the global malloc lock held */
+static void mag_flush_unlocked(struct malloc_ctx *ctx,
+			       struct malloc_mag_cache *mc, size_t cls,
+			       size_t num)
+{
+	void *buf = NULL;
+
+	while (num) {
+		buf = mag_pop(mc, cls);
+		if (!buf)
+			break;
+		brel(buf, &ctx->poolset, false /* !wipe */);
+		num--;
+	}
+}
+
+/* Called with the magazine locked, takes the global malloc lock */
+static void mag_flush(struct malloc_ctx *ctx, struct malloc_mag_cache *mc,
+		      size_t cls, size_t num)
+{
+	uint32_t exceptions = malloc_lock(ctx);
+
+	mag_flush_unlocked(ctx, mc, cls, num);
+	malloc_unlock(ctx, exceptions);
+}
+
+static void *mag_malloc(struct malloc_ctx *ctx, size_t size)
+{
+	struct malloc_mag_cache *mc = NULL;
+	uint32_t exceptions = 0;
+	size_t cls = 0;
+	void *buf = NULL;
+
+	if (!ctx->mag_cache || !mag_class_for_alloc(size, &cls))
+		return NULL;
+
+	mc = mag_cache_lock(ctx, &exceptions);
+	buf = mag_pop(mc, cls);
+	if (!buf)
+		buf = mag_refill(ctx, mc, cls);
+	mag_cache_unlock(mc, exceptions);
+
+	if (buf)
+		tag_asan_alloced(buf, size);
+
+	return buf;
+}
+
+static bool mag_free(struct malloc_ctx *ctx, void *ptr)
+{
+	struct malloc_mag_cache *mc = NULL;
+	uint32_t exceptions = 0;
+	size_t cls = 0;
+
+	if (!ctx->mag_cache || !ptr ||
+	    !mag_class_for_free(bget_buf_size(ptr), &cls))
+		return false;
+
+	mc = mag_cache_lock(ctx, &exceptions);
+	if (mc->mag[cls].count == MAG_NUM_SLOTS)
+		mag_flush(ctx, mc, cls, MAG_BATCH);
+	mag_push(mc, cls, ptr);
+	mag_cache_unlock(mc, exceptions);
+
+	return true;
+}
+
+/*
+ * Called with the global malloc lock held when bget fails to find a free
+ * buffer. Returns all cached buffers of the magazines which can be locked
+ * without waiting to bget. Returns true if anything was returned.
+ *
+ * Waiting for a magazine lock here could deadlock since the magazine lock
+ * is taken before the global malloc lock in mag_refill() and mag_flush().
+ */
+static bool mag_reclaim(struct malloc_ctx *ctx)
+{
+	struct malloc_mag_cache *mc = NULL;
+	bool ret = false;
+	size_t n = 0;
+	size_t cls = 0;
+
+	if (!ctx->mag_cache)
+		return false;
+
+	for (n = 0; n < MAG_NUM_CACHES; n++) {
+		mc = ctx->mag_cache + n;
+		if (!mag_cache_trylock(mc))
+			continue;
+		if (mc->cached_bytes) {
+			for (cls = 0; cls < MAG_NUM_CLASSES; cls++)
+				mag_flush_unlocked(ctx, mc, cls,
+						   MAG_NUM_SLOTS);
+			ret = true;
+		}
+		mag_cache_unlock_nox(mc);
+	}
+
+	return ret;
+}
+
+#else /*WITH_MAGAZINE*/
+
+static void *mag_malloc(struct malloc_ctx *ctx __unused, size_t size __unused)
+{
+	return NULL;
+}
+
+static bool mag_free(struct malloc_ctx *ctx __unused, void *ptr __unused)
+{
+	return false;
+}
+
+static bool mag_reclaim(struct malloc_ctx *ctx __unused)
+{
+	return false;
+}
+
+static __maybe_unused size_t mag_cached_bytes(struct malloc_ctx *ctx __unused)
+{
+	return 0;
+}
+
+#endif /*WITH_MAGAZINE*/
+
+#ifdef BufStats
+
+/*
+ * Buffers cached in magazines are still allocated as far as bget is
+ * concerned, but free from the caller's view.
+ */
+static size_t malloc_in_use(struct malloc_ctx *ctx)
+{
+	return ctx->poolset.totalloc - mag_cached_bytes(ctx);
+}
 
 static void raw_malloc_return_hook(void *p, size_t requested_size,
 				   struct malloc_ctx *ctx)
 {
-	if (ctx->poolset.totalloc > ctx->mstats.max_allocated)
-		ctx->mstats.max_allocated = ctx->poolset.totalloc;
+	size_t in_use = malloc_in_use(ctx);
+
+	if (in_use > ctx->mstats.max_allocated)
+		ctx->mstats.max_allocated = in_use;
 
 	if (!p) {
 		ctx->mstats.num_alloc_fail++;
 		print_oom(requested_size, ctx);
 		if (requested_size > ctx->mstats.biggest_alloc_fail) {
 			ctx->mstats.biggest_alloc_fail = requested_size;
-			ctx->mstats.biggest_alloc_fail_used =
-				ctx->poolset.totalloc;
+			ctx->mstats.biggest_alloc_fail_used = in_use;
 		}
 	}
 }
@@ -244,7 +644,7 @@ static void gen_malloc_get_stats(struct malloc_ctx *ctx,
 	uint32_t exceptions = malloc_lock(ctx);
 
 	memcpy_unchecked(stats, &ctx->mstats, sizeof(*stats));
-	stats->allocated = ctx->poolset.totalloc;
+	stats->allocated = malloc_in_use(ctx);
 	malloc_unlock(ctx, exceptions);
 }
 
@@ -366,6 +766,8 @@ void *raw_memalign(size_t hdr_size, size_t ftr_size, size_t alignment,
 		s++;
 
 	ptr = bget(alignment, hdr_size, s, &ctx->poolset);
+	if (!ptr && mag_reclaim(ctx))
+		ptr = bget(alignment, hdr_size, s, &ctx->poolset);
 out:
 	raw_malloc_return_hook(ptr, pl_size, ctx);
 
@@ -409,6 +811,8 @@ void *raw_calloc(size_t hdr_size, size_t ftr_size, size_t pl_nmemb,
 		s++;
 
 	ptr = bgetz(0, hdr_size, s, &ctx->poolset);
+	if (!ptr && mag_reclaim(ctx))
+		ptr = bgetz(0, hdr_size, s, &ctx->poolset);
 out:
 	raw_malloc_return_hook(ptr, pl_nmemb * pl_size, ctx);
 
@@ -434,34 +838,14 @@ void *raw_realloc(void *ptr, size_t hdr_size, size_t ftr_size,
 		s++;
 
 	p = bgetr(ptr, 0, 0, s, &ctx->poolset);
+	if (!p && mag_reclaim(ctx))
+		p = bgetr(ptr, 0, 0, s, &ctx->poolset);
 out:
 	raw_malloc_return_hook(p, pl_size, ctx);
 
 	return p;
 }
 
-/* Most of the stuff in this function is copied from bgetr() in bget.c */
-static __maybe_unused bufsize bget_buf_size(void *buf)
-{
-	bufsize osize;          /* Old size of buffer */
-	struct bhead *b;
-
-	b = BH(((char *)buf) - sizeof(struct bhead));
-	osize = -b->bsize;
-#ifdef BECtl
-	if (osize == 0) {
-		/*  Buffer acquired directly through acqfcn. */
-		struct bdhead *bd;
-
-		bd = BDH(((char *)buf) - sizeof(struct bdhead));
-		osize = bd->tsize - sizeof(struct bdhead) - bd->offs;
-	} else
-#endif
-		osize -= sizeof(struct bhead);
-	assert(osize > 0);
-	return osize;
-}
-
 #ifdef ENABLE_MDBG
 
 struct mdbg_hdr {
@@ -714,8 +1098,13 @@ void *realloc(void *ptr, size_t size)
 void *malloc(size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
 
+	p = mag_malloc(&malloc_ctx, size);
+	if (p)
+		return p;
+
+	exceptions = malloc_lock(&malloc_ctx);
 	p = raw_malloc(0, 0, size, &malloc_ctx);
 	malloc_unlock(&malloc_ctx, exceptions);
 	return p;
@@ -723,7 +1112,13 @@ void *malloc(size_t size)
 
 static void free_helper(void *ptr, bool wipe)
 {
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions;
+
+	/* Wiped buffers go straight back to bget which does the wiping */
+	if (!wipe && mag_free(&malloc_ctx, ptr))
+		return;
+
+	exceptions = malloc_lock(&malloc_ctx);
 
 	raw_free(ptr, &malloc_ctx, wipe);
 	malloc_unlock(&malloc_ctx, exceptions);
@@ -732,7 +1127,16 @@ static void free_helper(void *ptr, bool wipe)
 void *calloc(size_t nmemb, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	size_t s;
+	uint32_t exceptions;
+
+	if (!MUL_OVERFLOW(nmemb, size, &s)) {
+		p = mag_malloc(&malloc_ctx, s);
+		if (p)
+			return memset(p, 0, s);
+	}
+
+	exceptions = malloc_lock(&malloc_ctx);
 
 	p = raw_calloc(0, 0, nmemb, size, &malloc_ctx);
 	malloc_unlock(&malloc_ctx, exceptions);
@@ -936,8 +1340,13 @@ bool malloc_buffer_overlaps_heap(void *buf, size_t len)
 void *nex_malloc(size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
+	uint32_t exceptions;
 
+	p = mag_malloc(&nex_malloc_ctx, size);
+	if (p)
+		return p;
+
+	exceptions = malloc_lock(&nex_malloc_ctx);
 	p = raw_malloc(0, 0, size, &nex_malloc_ctx);
 	malloc_unlock(&nex_malloc_ctx, exceptions);
 	return p;
@@ -946,7 +1355,16 @@ void *nex_malloc(size_t size)
 void *nex_calloc(size_t nmemb, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
+	size_t s;
+	uint32_t exceptions;
+
+	if (!MUL_OVERFLOW(nmemb, size, &s)) {
+		p = mag_malloc(&nex_malloc_ctx, s);
+		if (p)
+			return memset(p, 0, s);
+	}
+
+	exceptions = malloc_lock(&nex_malloc_ctx);
 
 	p = raw_calloc(0, 0, nmemb, size, &nex_malloc_ctx);
 	malloc_unlock(&nex_malloc_ctx, exceptions);
@@ -975,8 +1393,12 @@ void *nex_memalign(size_t alignment, size_t size)
 
 void nex_free(void *ptr)
 {
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
+	uint32_t exceptions;
+
+	if (mag_free(&nex_malloc_ctx, ptr))
+		return;
 
+	exceptions = malloc_lock(&nex_malloc_ctx);
 	raw_free(ptr, &nex_malloc_ctx, false /* !wipe */);
 	malloc_unlock(&nex_malloc_ctx, exceptions);
 }
@@ -112,6 +112,11 @@ CFG_WITH_SOFTWARE_PRNG ?= y
 # Number of threads
 CFG_NUM_THREADS ?= 2
 
+# Number of buckets in the hash table used to look up open TA sessions by
+# session id. Each bucket has its own mutex, invokes of sessions in
+# different buckets don't contend.
+CFG_TA_SESSION_HASH_BUCKETS ?= 64
+
 # API implementation version
 CFG_TEE_API_VERSION ?= GPD-1.1-dev
 
@@ -153,6 +158,18 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Number of decrypted data blocks of 4 KiB cached per open REE FS object.
+# Repeated reads of a cached block need neither an RPC nor decryption.
+# Set to 0 to disable the cache.
+CFG_REE_FS_HTREE_CACHE_BLOCKS ?= 2
+
+# Limits for writes to REE FS objects opened with TEE_DATA_FLAG_DEFER_COMMIT.
+# Pending writes are committed once CFG_REE_FS_DEFER_COMMIT_BYTES or more
+# bytes have been written, or at the first write more than
+# CFG_REE_FS_DEFER_COMMIT_MS milliseconds after the first pending write.
+CFG_REE_FS_DEFER_COMMIT_BYTES ?= 65536
+CFG_REE_FS_DEFER_COMMIT_MS ?= 1000
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -377,6 +394,22 @@ CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 # TAG and IV in order to reduce heap usage.
 CFG_CORE_PAGE_TAG_AND_IV ?= $(CFG_PAGED_USER_TA)
 
+# Page replacement policy of the pager. With CLOCK (second chance) the
+# oldest pages are hidden one by one until one is found which hasn't been
+# used since it was hidden, that page is then evicted. When disabled a
+# third of the pages are hidden on each fault and the oldest page is
+# evicted.
+CFG_CORE_PAGER_CLOCK ?= y
+
+# Number of pages following a page fault to load in advance when the
+# faults in a paged region are sequential. 0 disables fault-around.
+CFG_CORE_PAGER_FAULT_AROUND ?= 4
+
+# With CFG_WITH_STATS, also measure the time spent in physical page lookups
+# of the pager. Reading the counter costs more than the lookup itself so
+# this is only meant for debugging.
+CFG_CORE_PAGER_LOOKUP_TIMING ?= n
+
 # Runtime lock dependency checker: ensures that a proper locking hierarchy is
 # used in the TEE core when acquiring and releasing mutexes. Any violation will
 # cause a panic as soon as the invalid locking condition is detected. If
@@ -391,6 +424,14 @@ CFG_LOCKDEP_RECORD_STACK ?= y
 # with the pager enabled or lockdep
 CFG_CORE_BGET_BESTFIT ?= $(call cfg-one-enabled, CFG_WITH_PAGER CFG_LOCKDEP)
 
+# Small allocations (up to 32 times the bget size quantum) are served from
+# per-CPU (TEE core) or per-context (TA) magazine caches in front of bget,
+# avoiding the global malloc lock and the bget free list walk. Ignored when
+# malloc debug is enabled. Cached buffers stay allocated in bget, this adds
+# up to about 8 KiB of heap per CPU (TEE core) or per TA.
+CFG_CORE_MALLOC_MAGAZINE ?= n
+CFG_TA_MALLOC_MAGAZINE ?= n
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -778,5 +819,12 @@ endif
 # CFG_CORE_ASYNC_NOTIF_GIC_INTID defined.
 CFG_CORE_ASYNC_NOTIF ?= n
 
+# CFG_CORE_INVOKE_RING, when enabled, lets normal world queue invoke
+# commands in a ring in shared memory and have several of them served by a
+# single yielding call, completions are signalled with an asynchronous
+# notification. See struct optee_msg_ring.
+CFG_CORE_INVOKE_RING ?= n
+$(eval $(call cfg-depends-all,CFG_CORE_INVOKE_RING,CFG_CORE_ASYNC_NOTIF))
+
 $(eval $(call cfg-enable-all-depends,CFG_MEMPOOL_REPORT_LAST_OFFSET, \
 	 CFG_WITH_STATS))
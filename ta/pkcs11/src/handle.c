@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
+#include <util.h>
 
 #include "handle.h"
 
@@ -17,6 +18,15 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+#define HANDLE_DB_MAX_PTRS		BIT(HANDLE_DB_INDEX_BITS)
+#define HANDLE_DB_GEN_MASK		(UINT32_MAX >> HANDLE_DB_INDEX_BITS)
+
+/* Handle value of the slot at index @idx, index 0 is reserved as invalid */
+static uint32_t slot_handle(struct handle_db *db, uint32_t idx)
+{
+	return (db->slots[idx].gen << HANDLE_DB_INDEX_BITS) | idx;
+}
+
 void handle_db_init(struct handle_db *db)
 {
 	TEE_MemFill(db, 0, sizeof(*db));
@@ -25,66 +35,101 @@ void handle_db_init(struct handle_db *db)
 void handle_db_destroy(struct handle_db *db)
 {
 	if (db) {
-		TEE_Free(db->ptrs);
-		db->ptrs = NULL;
+		TEE_Free(db->slots);
+		db->slots = NULL;
 		db->max_ptrs = 0;
+		db->first_free = 0;
 	}
 }
 
-uint32_t handle_get(struct handle_db *db, void *ptr)
+static bool grow_db(struct handle_db *db)
 {
-	uint32_t n = 0;
-	void *p = NULL;
 	uint32_t new_max_ptrs = 0;
+	void *p = NULL;
+	uint32_t n = 0;
 
-	if (!db || !ptr)
-		return 0;
-
-	/* Try to find an empty location (index 0 is reserved as invalid) */
-	for (n = 1; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
-
-	/* No location available, grow the ptrs array */
 	if (db->max_ptrs)
 		new_max_ptrs = db->max_ptrs * 2;
 	else
 		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max_ptrs > HANDLE_DB_MAX_PTRS)
+		return false;
 
-	p = TEE_Realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	p = TEE_Realloc(db->slots, new_max_ptrs * sizeof(*db->slots));
 	if (!p)
-		return 0;
-	db->ptrs = p;
-	TEE_MemFill(db->ptrs + db->max_ptrs, 0,
-		    (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+		return false;
+	db->slots = p;
+	TEE_MemFill(db->slots + db->max_ptrs, 0,
+		    (new_max_ptrs - db->max_ptrs) * sizeof(*db->slots));
+
+	/* Chain the new slots so the lowest index is used first */
+	for (n = new_max_ptrs - 1; n >= db->max_ptrs && n; n--) {
+		db->slots[n].next_free = db->first_free;
+		db->first_free = n;
+	}
 	db->max_ptrs = new_max_ptrs;
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
-	db->ptrs[n] = ptr;
-	return n;
+	return true;
+}
+
+static struct handle_db_slot *find_slot(struct handle_db *db, uint32_t handle)
+{
+	uint32_t idx = handle & (HANDLE_DB_MAX_PTRS - 1);
+
+	if (!db || !idx || idx >= db->max_ptrs)
+		return NULL;
+
+	if (!db->slots[idx].ptr || slot_handle(db, idx) != handle)
+		return NULL;
+
+	return db->slots + idx;
+}
+
+uint32_t handle_get(struct handle_db *db, void *ptr)
+{
+	struct handle_db_slot *slot = NULL;
+	uint32_t idx = 0;
+
+	if (!db || !ptr)
+		return 0;
+
+	if (!db->first_free && !grow_db(db))
+		return 0;
+
+	idx = db->first_free;
+	slot = db->slots + idx;
+	db->first_free = slot->next_free;
+	slot->next_free = 0;
+	slot->ptr = ptr;
+
+	return slot_handle(db, idx);
 }
 
 void *handle_put(struct handle_db *db, uint32_t handle)
 {
+	struct handle_db_slot *slot = find_slot(db, handle);
 	void *p = NULL;
 
-	if (!db || !handle || handle >= db->max_ptrs)
+	if (!slot)
 		return NULL;
 
-	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	p = slot->ptr;
+	slot->ptr = NULL;
+	slot->gen = (slot->gen + 1) & HANDLE_DB_GEN_MASK;
+	slot->next_free = db->first_free;
+	db->first_free = slot - db->slots;
+
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, uint32_t handle)
 {
-	if (!db || !handle || handle >= db->max_ptrs)
+	struct handle_db_slot *slot = find_slot(db, handle);
+
+	if (!slot)
 		return NULL;
 
-	return db->ptrs[handle];
+	return slot->ptr;
 }
 
 uint32_t handle_lookup_handle(struct handle_db *db, void *ptr)
@@ -93,8 +138,8 @@ uint32_t handle_lookup_handle(struct handle_db *db, void *ptr)
 
 	if (ptr) {
 		for (n = 1; n < db->max_ptrs; n++)
-			if (db->ptrs[n] == ptr)
-				return n;
+			if (db->slots[n].ptr == ptr)
+				return slot_handle(db, n);
 	}
 
 	return 0;
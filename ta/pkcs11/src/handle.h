@@ -7,10 +7,25 @@
 #define PKCS11_TA_HANDLE_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A handle is made of a slot index in the low HANDLE_DB_INDEX_BITS bits
+ * and a generation counter of the slot in the bits above, so a stale
+ * handle isn't accepted once its slot is reused.
+ */
+#define HANDLE_DB_INDEX_BITS	20
+
+struct handle_db_slot {
+	void *ptr;
+	uint32_t gen;
+	uint32_t next_free;	/* Index of next free slot, 0 at end */
+};
 
 struct handle_db {
-	void **ptrs;
+	struct handle_db_slot *slots;
 	uint32_t max_ptrs;
+	uint32_t first_free;	/* Index of first free slot, 0 if none */
 };
 
 /*